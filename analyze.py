@@ -10,7 +10,7 @@ plt.switch_backend("Agg")
 def analyze(filename):
     print(f"\nLoading file: {filename}\n")
 
-    df = pd.read_csv(filename, header=None, encoding = "utf-16")
+    df = pd.read_csv(filename, header=None, encoding = "utf-16", comment='#')
     col = df.columns[0]
 
     iat = pd.to_numeric(df[col], errors="coerce").dropna()
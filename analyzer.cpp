@@ -0,0 +1,270 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "dataset.h"
+#include "detectors.h"
+
+// Prints min/max/mean/median/std of one score column, skipping NaN windows,
+// in the layout of eppsim.py's summary.
+void print_summary(double epsilon, const std::vector<double>& column)
+{
+    std::vector<double> values;
+    for (size_t i = 0; i < column.size(); ++i)
+    {
+        if (column[i] == column[i])
+            values.push_back(column[i]);
+    }
+    if (values.empty())
+    {
+        std::cout << "eps=" << epsilon << ": no scored windows" << std::endl;
+        return;
+    }
+
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < values.size(); ++i)
+        sum += values[i];
+    double mean = sum / values.size();
+    double var = 0.0;
+    for (size_t i = 0; i < values.size(); ++i)
+        var += (values[i] - mean) * (values[i] - mean);
+    size_t mid = values.size() / 2;
+    double median = values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+
+    std::cout << "eps=" << epsilon << ": " << std::fixed << std::setprecision(3)
+              << "min=" << values.front() << ", max=" << values.back()
+              << ", mean=" << mean << ", median=" << median
+              << ", std=" << std::sqrt(var / values.size()) << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+int run_eps_mode(const std::string& logfile, size_t window_size, bool improved)
+{
+    std::vector<double> iats;
+    std::string error;
+    if (!load_iats(logfile, iats, error))
+    {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+    if (iats.empty())
+    {
+        std::cout << "Error: No numeric samples in " << logfile << std::endl;
+        return 1;
+    }
+
+    const size_t eps_count = DEFAULT_EPSILON_COUNT;
+    const size_t windows = (iats.size() + window_size - 1) / window_size; // last window may be partial
+    std::vector<std::vector<double> > results(eps_count, std::vector<double>(windows));
+
+    std::vector<double> sorted;
+    std::vector<double> ratios;
+    std::vector<double> scores(eps_count);
+    for (size_t w = 0; w < windows; ++w)
+    {
+        size_t begin = w * window_size;
+        size_t n = std::min(window_size, iats.size() - begin);
+        epsilon_similarity(&iats[begin], n, DEFAULT_EPSILONS, eps_count, improved, sorted, ratios, &scores[0]);
+        for (size_t k = 0; k < eps_count; ++k)
+            results[k][w] = scores[k];
+    }
+
+    std::string output = std::string("scores_") + (improved ? "improved_" : "original_") + dataset_stem(logfile) + ".csv";
+    if (logfile == "-")
+        output = std::string("scores_") + (improved ? "improved_" : "original_") + "stdin.csv";
+    std::ofstream out(output.c_str());
+    if (!out.is_open())
+    {
+        std::cout << "Error: Cannot open output file " << output << std::endl;
+        return 1;
+    }
+    for (size_t k = 0; k < eps_count; ++k)
+        out << (k ? "," : "") << format_double(DEFAULT_EPSILONS[k]);
+    out << '\n';
+    for (size_t w = 0; w < windows; ++w)
+    {
+        for (size_t k = 0; k < eps_count; ++k)
+            out << (k ? "," : "") << format_double(results[k][w]);
+        out << '\n';
+    }
+    out.close();
+
+    std::cout << "Dataset info:" << std::endl;
+    std::cout << "Total traffic points: " << iats.size() << std::endl;
+    std::cout << "Window size: " << window_size << std::endl;
+    std::cout << "Number of windows: " << windows << std::endl;
+    std::cout << "\nSummary statistics (" << (improved ? "Improved" : "Original") << " eps-similarity):" << std::endl;
+    for (size_t k = 0; k < eps_count; ++k)
+        print_summary(DEFAULT_EPSILONS[k], results[k]);
+    std::cout << "\nScores written to " << output << std::endl;
+    return 0;
+}
+
+// Scores compressibility over sliding windows. Files are scored in one go
+// and written to scores_compress_<name>.csv; stdin is read line by line and
+// each score is printed as its window closes, so live receiver output can be
+// piped in (tail -f jitter_log.csv | analyzer -compress - 512 64 ms).
+int run_compress_mode(const std::string& logfile, size_t window_size, size_t stride, double to_seconds)
+{
+    SlidingCompressibility detector(window_size, stride);
+    double score;
+
+    if (logfile == "-")
+    {
+        std::string line;
+        size_t windows = 0;
+        while (std::getline(std::cin, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            char* parsed;
+            double value = strtod(line.c_str(), &parsed);
+            if (parsed == line.c_str())
+                continue;
+            if (detector.push(value * to_seconds, score))
+            {
+                std::cout << "Window " << windows++ << ": " << format_double(score) << std::endl;
+            }
+        }
+        if (detector.flush_partial(score))
+            std::cout << "Window " << windows << " (partial): " << format_double(score) << std::endl;
+        return 0;
+    }
+
+    std::vector<double> iats;
+    std::string error;
+    if (!load_iats(logfile, iats, error))
+    {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+
+    std::vector<double> scores;
+    for (size_t i = 0; i < iats.size(); ++i)
+    {
+        if (detector.push(iats[i] * to_seconds, score))
+            scores.push_back(score);
+    }
+    if (detector.flush_partial(score))
+        scores.push_back(score);
+
+    std::string output = "scores_compress_" + dataset_stem(logfile) + ".csv";
+    std::ofstream out(output.c_str());
+    if (!out.is_open())
+    {
+        std::cout << "Error: Cannot open output file " << output << std::endl;
+        return 1;
+    }
+    out << "Compressibility\n";
+    for (size_t i = 0; i < scores.size(); ++i)
+        out << format_double(scores[i]) << '\n';
+    out.close();
+
+    std::cout << "Dataset info:" << std::endl;
+    std::cout << "Total traffic points: " << iats.size() << std::endl;
+    std::cout << "Window size: " << window_size << ", stride: " << stride << std::endl;
+    std::cout << "Number of windows: " << scores.size() << std::endl;
+    std::cout << "\nSummary statistics (compressibility):" << std::endl;
+    std::vector<double> values;
+    for (size_t i = 0; i < scores.size(); ++i)
+    {
+        if (scores[i] == scores[i])
+            values.push_back(scores[i]);
+    }
+    if (!values.empty())
+    {
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (size_t i = 0; i < values.size(); ++i)
+            sum += values[i];
+        std::cout << std::fixed << std::setprecision(3) << "min=" << values.front() << ", max=" << values.back()
+                  << ", mean=" << sum / values.size() << ", median=" << values[values.size() / 2] << std::endl;
+    }
+    std::cout << "\nScores written to " << output << std::endl;
+    return 0;
+}
+
+void print_usage(const char* program)
+{
+    std::cout << "Epsilon-Similarity Usage:" << std::endl;
+    std::cout << "  " << program << " -eps <LOGFILE|-> [WINDOW_SIZE] [original|improved]" << std::endl;
+    std::cout << "Compressibility Usage:" << std::endl;
+    std::cout << "  " << program << " -compress <LOGFILE|-> [WINDOW_SIZE] [STRIDE] [s|ms]" << std::endl;
+    std::cout << "Example:" << std::endl;
+    std::cout << "  " << program << " -eps data/past_data/timings_7_fuzzed.csv 2000" << std::endl;
+    std::cout << "  " << program << " -compress data/past_data/timings_1_fuzzed.csv 512" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 2 && std::string(argv[1]) == "-eps")
+    {
+        if (argc < 3 || argc > 5)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        size_t window_size = 2000;
+        if (argc >= 4)
+            window_size = (size_t)atol(argv[3]);
+        bool improved = false;
+        if (argc == 5)
+        {
+            std::string variant = argv[4];
+            if (variant != "original" && variant != "improved")
+            {
+                print_usage(argv[0]);
+                return 1;
+            }
+            improved = variant == "improved";
+        }
+        if (window_size < 2)
+        {
+            std::cout << "Error: Window size must be at least 2" << std::endl;
+            return 1;
+        }
+        return run_eps_mode(argv[2], window_size, improved);
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "-compress")
+    {
+        if (argc < 3 || argc > 6)
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+        size_t window_size = 512;
+        if (argc >= 4)
+            window_size = (size_t)atol(argv[3]);
+        size_t stride = window_size;
+        if (argc >= 5)
+            stride = (size_t)atol(argv[4]);
+        double to_seconds = 1.0;
+        if (argc == 6)
+        {
+            std::string unit = argv[5];
+            if (unit != "s" && unit != "ms")
+            {
+                print_usage(argv[0]);
+                return 1;
+            }
+            to_seconds = unit == "ms" ? 1e-3 : 1.0;
+        }
+        if (window_size < 1 || stride < 1)
+        {
+            std::cout << "Error: Window size and stride must be positive" << std::endl;
+            return 1;
+        }
+        return run_compress_mode(argv[2], window_size, stride, to_seconds);
+    }
+
+    print_usage(argv[0]);
+    return 1;
+}
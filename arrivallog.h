@@ -0,0 +1,293 @@
+// Arrival log behind `receiver -log`, `-logbin` and `-detect`.
+//
+// The receive loop only copies (sequence, type, arrival time) into a
+// preallocated single-producer/single-consumer ring. A writer thread formats
+// the IAT CSV or binary records and does all the disk I/O, flushing after
+// every pass, so a slow disk never holds up the socket read. When the writer
+// falls behind, records are counted and dropped.
+//
+// With rotation, the log is split into parts once a part reaches a size or
+// spans a stretch of arrival time. The first part keeps the requested name;
+// later parts insert their number before the extension (jitter.1.csv,
+// jitter.2.csv, ...). Every CSV part starts with its own comment and "Time"
+// lines, and its first IAT continues from the last packet of the previous
+// part, so the parts concatenate back into the unrotated log. Binary parts
+// are complete logs of their own.
+#ifndef ARRIVALLOG_H
+#define ARRIVALLOG_H
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binlog.h"
+
+// Where to split a long capture; zero leaves that limit off
+struct LogRotation {
+    int64_t max_bytes;
+    int64_t max_ns;
+};
+
+// Takes the -rotate argument: a size with a K, M or G suffix, or a span of
+// arrival time with an s, min or h suffix ("512M", "3600s", "1h")
+inline bool parse_rotation(const std::string& text, LogRotation& rotation)
+{
+    char* end;
+    double value = strtod(text.c_str(), &end);
+    std::string unit = end;
+    if (text.empty() || end == text.c_str() || !(value > 0)) return false;
+    rotation.max_bytes = 0;
+    rotation.max_ns = 0;
+    if (unit == "K" || unit == "k") rotation.max_bytes = (int64_t)(value * 1024);
+    else if (unit == "M") rotation.max_bytes = (int64_t)(value * 1024 * 1024);
+    else if (unit == "G") rotation.max_bytes = (int64_t)(value * 1024 * 1024 * 1024);
+    else if (unit == "s") rotation.max_ns = (int64_t)(value * 1e9);
+    else if (unit == "min") rotation.max_ns = (int64_t)(value * 60e9);
+    else if (unit == "h") rotation.max_ns = (int64_t)(value * 3600e9);
+    else return false;
+    return rotation.max_bytes > 0 || rotation.max_ns > 0;
+}
+
+// Name of part `index` of a rotated log: the name itself for part 0
+inline std::string rotated_log_name(const std::string& path, int index)
+{
+    if (index == 0) return path;
+    size_t slash = path.find_last_of("/\\");
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == 0 || dot == slash + 1)
+        return path + "." + std::to_string(index);
+    return path.substr(0, dot) + "." + std::to_string(index) + path.substr(dot);
+}
+
+// Ctrl+C (and SIGTERM) only raise a flag for the receive loop to notice, so
+// it can drain the log; a second one kills the process as usual
+inline volatile sig_atomic_t& stop_flag()
+{
+    static volatile sig_atomic_t flag = 0;
+    return flag;
+}
+
+extern "C" inline void handle_stop_signal(int sig)
+{
+    stop_flag() = 1;
+    signal(sig, SIG_DFL);
+}
+
+inline void install_stop_handler()
+{
+#if defined(__linux__) || defined(__APPLE__)
+    // Without SA_RESTART, so a blocked receive returns at once
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+#else
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+#endif
+}
+
+inline bool stop_requested()
+{
+    return stop_flag() != 0;
+}
+
+class ArrivalLog {
+public:
+    static const size_t CAPACITY = 1 << 18; // records, 4 MiB
+
+    ArrivalLog() : ring(CAPACITY), head(0), tail(0), dropped(0), stopping(false), binary(false),
+                   port(0), source(0), source_name("user"), resolution_ns(0), epoch_ns(0), clock_ns(0),
+                   csv(NULL), part(0), part_bytes(0), part_records(0), part_start_ns(0), last_arrival_ns(0),
+                   written(0), lost(0), failed(false) {
+        rotation.max_bytes = 0;
+        rotation.max_ns = 0;
+    }
+
+    ~ArrivalLog() { stop(); }
+
+    // Opens the first part and starts the writer. The binary header takes the
+    // port, the clock resolution and a (wall clock, arrival clock) pair.
+    bool start(const std::string& filename, bool binary_log, const LogRotation& split, uint16_t port_number,
+               uint8_t timestamp_source, const char* timestamp_source_name, int64_t clock_resolution_ns,
+               int64_t start_epoch_ns, int64_t start_clock_ns) {
+        path = filename;
+        binary = binary_log;
+        rotation = split;
+        port = port_number;
+        source = timestamp_source;
+        source_name = timestamp_source_name;
+        resolution_ns = clock_resolution_ns;
+        epoch_ns = start_epoch_ns;
+        clock_ns = start_clock_ns;
+        if (!open_part()) return false;
+        writer = std::thread(&ArrivalLog::drain_loop, this);
+        return true;
+    }
+
+    // Settles the source recorded in the log (a hardware request that fell
+    // back). Call before the first push; the writer reads it after that.
+    void set_timestamp_source(uint8_t timestamp_source, const char* timestamp_source_name) {
+        source = timestamp_source;
+        source_name = timestamp_source_name;
+    }
+
+    // Never blocks the receive loop
+    void push(uint32_t seq, uint8_t packet_type, int64_t arrival_ns) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= ring.size()) {
+            dropped++;
+            return;
+        }
+        BinLogRecord& r = ring[h % ring.size()];
+        r.sequence_number = seq;
+        r.packet_type = packet_type;
+        r.reserved[0] = r.reserved[1] = r.reserved[2] = 0;
+        r.arrival_ns = arrival_ns;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // Writes out everything pushed so far and closes the current part
+    void stop() {
+        if (!writer.joinable()) return;
+        stopping.store(true);
+        writer.join();
+        close_part();
+    }
+
+    // Valid once stopped: records the ring had no room for, or that found no part to go to
+    size_t dropped_count() const { return dropped + lost; }
+    uint64_t written_count() const { return written; }
+    int part_count() const { return part + 1; }
+
+private:
+    bool open_part() {
+        std::string name = rotated_log_name(path, part);
+        part_bytes = 0;
+        part_records = 0;
+        if (binary) {
+            if (!binlog.open(name, port, source, resolution_ns, epoch_ns, clock_ns)) return false;
+            part_bytes = sizeof(BinLogHeader);
+            return true;
+        }
+        csv = fopen(name.c_str(), "w");
+        if (!csv) return false;
+        setvbuf(csv, NULL, _IOFBF, 1 << 20);
+        return true;
+    }
+
+    void close_part() {
+        if (binary) {
+            binlog.close();
+        } else if (csv) {
+            fclose(csv);
+            csv = NULL;
+        }
+    }
+
+    // Moves to the next part before `r` when the current one is full
+    bool rotate_if_due(const BinLogRecord& r) {
+        if (part_records == 0) return true;
+        bool due = (rotation.max_bytes > 0 && part_bytes >= rotation.max_bytes) ||
+                   (rotation.max_ns > 0 && r.arrival_ns - part_start_ns >= rotation.max_ns);
+        if (!due) return true;
+        close_part();
+        part++;
+        if (open_part()) return true;
+        std::cout << "Error: Cannot open log file " << rotated_log_name(path, part) << ", logging stopped" << std::endl;
+        failed = true;
+        return false;
+    }
+
+    void write_record(const BinLogRecord& r) {
+        if (failed || !rotate_if_due(r)) {
+            lost++;
+            return;
+        }
+        if (part_records == 0) part_start_ns = r.arrival_ns;
+
+        if (binary) {
+            if (part_records == 0) binlog.set_timestamp_source(source);
+            binlog.append(r.sequence_number, r.packet_type, r.arrival_ns);
+            part_bytes += sizeof(BinLogRecord);
+        } else {
+            char line[64];
+            int length;
+            if (part_records == 0) {
+                // Written once the first packet has settled the source, so hardware downgrades are recorded
+                length = snprintf(line, sizeof(line), "# timestamp_source=%s\nTime\n", source_name);
+                fwrite(line, 1, length, csv);
+                part_bytes += length;
+            }
+            if (written == 0)
+                length = snprintf(line, sizeof(line), "0.0\n");
+            else
+                length = snprintf(line, sizeof(line), "%.3f\n", (r.arrival_ns - last_arrival_ns) / 1e6);
+            fwrite(line, 1, length, csv);
+            part_bytes += length;
+        }
+        last_arrival_ns = r.arrival_ns;
+        part_records++;
+        written++;
+    }
+
+    void drain() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        if (t == h) return;
+        for (; t != h; ++t) write_record(ring[t % ring.size()]);
+        tail.store(t, std::memory_order_release);
+        if (binary) binlog.flush();
+        else if (csv) fflush(csv);
+    }
+
+    void drain_loop() {
+        while (!stopping.load()) {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        drain();
+    }
+
+    std::vector<BinLogRecord> ring;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    size_t dropped;
+    std::atomic<bool> stopping;
+    std::thread writer;
+
+    // Fixed by start(), or by set_timestamp_source() before the first push
+    std::string path;
+    bool binary;
+    LogRotation rotation;
+    uint16_t port;
+    uint8_t source;
+    const char* source_name;
+    int64_t resolution_ns;
+    int64_t epoch_ns;
+    int64_t clock_ns;
+
+    // Writer thread only
+    BinLogWriter binlog;
+    FILE* csv;
+    int part;
+    int64_t part_bytes;
+    uint64_t part_records;
+    int64_t part_start_ns;
+    int64_t last_arrival_ns;
+    uint64_t written;
+    size_t lost;
+    bool failed;
+};
+
+#endif
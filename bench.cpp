@@ -0,0 +1,423 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#include "symbols.h"
+#include "pacing.h"
+#include "histogram.h"
+
+#ifdef _WIN32
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+// Timing-fidelity benchmark for the sender's wait strategies. Each sample
+// asks a strategy to wake at now + target and records how late it woke. The
+// result is an error distribution per strategy and target delay. Use it to
+// size the spin margin for a host and to catch timing regressions.
+
+enum WaitStrategy
+{
+    WAIT_SLEEP,    // usleep/Sleep for the delay, as the original sender did
+    WAIT_COARSE,   // coarse_sleep_until: clock_nanosleep absolute / waitable timer
+    WAIT_HYBRID,   // sleep_until_deadline: coarse sleep then spin, as the sender does
+    WAIT_TIMERFD   // absolute timerfd, Linux only
+};
+
+struct StrategyInfo
+{
+    WaitStrategy strategy;
+    const char *name;
+};
+
+const StrategyInfo STRATEGIES[] = {
+    {WAIT_SLEEP, "sleep"},
+#ifdef _WIN32
+    {WAIT_COARSE, "waitable"},
+#elif defined(__linux__)
+    {WAIT_COARSE, "nanosleep"},
+#else
+    {WAIT_COARSE, "sleep_until"},
+#endif
+    {WAIT_HYBRID, "hybrid"},
+#ifdef __linux__
+    {WAIT_TIMERFD, "timerfd"},
+#endif
+};
+const size_t STRATEGY_COUNT = sizeof(STRATEGIES) / sizeof(STRATEGIES[0]);
+
+const char *DEFAULT_DELAYS = "0.1,0.2,0.5,1,2,5,10,20,50,100,150";
+const int DEFAULT_SAMPLES = 200;
+const int MIN_SAMPLES = 20;
+const double CELL_BUDGET_MS = 2000.0; // caps samples at long delays
+
+struct CellResult
+{
+    std::string strategy;
+    bool loaded;
+    double target_ms;
+    LatencyHistogram late_ns;
+    uint64_t early;
+    int64_t worst_early_ns;
+};
+
+class Waiter
+{
+public:
+    explicit Waiter(WaitStrategy strategy) : strategy(strategy)
+    {
+#ifdef __linux__
+        timer_fd = strategy == WAIT_TIMERFD ? timerfd_create(CLOCK_MONOTONIC, 0) : -1;
+#endif
+    }
+
+    ~Waiter()
+    {
+#ifdef __linux__
+        if (timer_fd >= 0)
+            close(timer_fd);
+#endif
+    }
+
+    bool ready() const
+    {
+#ifdef __linux__
+        return strategy != WAIT_TIMERFD || timer_fd >= 0;
+#else
+        return true;
+#endif
+    }
+
+    void wait(double target_ms, deadline_clock::time_point deadline)
+    {
+        switch (strategy)
+        {
+        case WAIT_SLEEP:
+#ifdef _WIN32
+            Sleep((DWORD)target_ms);
+#else
+            usleep((useconds_t)(target_ms * 1000));
+#endif
+            break;
+        case WAIT_COARSE:
+            coarse_sleep_until(deadline);
+            break;
+        case WAIT_HYBRID:
+            sleep_until_deadline(deadline);
+            break;
+        case WAIT_TIMERFD:
+#ifdef __linux__
+        {
+            int64_t since_epoch = deadline.time_since_epoch().count() + kernel_clock_offset_ns(CLOCK_MONOTONIC);
+            itimerspec spec = itimerspec();
+            spec.it_value.tv_sec = (time_t)(since_epoch / 1000000000LL);
+            spec.it_value.tv_nsec = (long)(since_epoch % 1000000000LL);
+            if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0)
+            {
+                uint64_t expirations;
+                while (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR)
+                {
+                }
+            }
+        }
+#endif
+            break;
+        }
+    }
+
+private:
+    WaitStrategy strategy;
+#ifdef __linux__
+    int timer_fd;
+#endif
+};
+
+// Busy threads on the other cores: arithmetic plus a walk over a buffer
+// larger than most L2 caches, so the timing thread sees contended caches and
+// a scheduler with runnable work
+class BackgroundLoad
+{
+public:
+    BackgroundLoad() : stopping(false) {}
+    ~BackgroundLoad() { stop(); }
+
+    void start()
+    {
+        unsigned cores = std::thread::hardware_concurrency();
+        unsigned threads = cores > 1 ? cores - 1 : 1;
+        stopping = false;
+        for (unsigned i = 0; i < threads; ++i)
+            workers.push_back(std::thread(&BackgroundLoad::spin, this));
+    }
+
+    void stop()
+    {
+        stopping = true;
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+        workers.clear();
+    }
+
+    size_t thread_count() const { return workers.size(); }
+
+private:
+    void spin()
+    {
+        std::vector<uint64_t> buffer(1 << 19); // 4 MB
+        uint64_t state = 88172645463325252ULL;
+        size_t index = 0;
+        while (!stopping.load(std::memory_order_relaxed))
+        {
+            for (int i = 0; i < 4096; ++i)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                index = (index + 4099) & (buffer.size() - 1);
+                buffer[index] += state;
+            }
+        }
+    }
+
+    std::atomic<bool> stopping;
+    std::vector<std::thread> workers;
+};
+
+void run_cell(WaitStrategy strategy, double target_ms, int samples, CellResult &result)
+{
+    Waiter waiter(strategy);
+    const auto target = ms_to_duration(target_ms);
+    for (int i = 0; i < samples; ++i)
+    {
+        auto deadline = deadline_clock::now() + target;
+        waiter.wait(target_ms, deadline);
+        int64_t error_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline_clock::now() - deadline).count();
+        if (error_ns < 0)
+        {
+            result.early++;
+            if (error_ns < result.worst_early_ns)
+                result.worst_early_ns = error_ns;
+        }
+        result.late_ns.record(error_ns);
+    }
+}
+
+void print_row(const CellResult &cell)
+{
+    std::cout << std::left << std::setw(12) << cell.strategy << std::right
+              << std::setw(10) << cell.target_ms
+              << std::setw(9) << cell.late_ns.count()
+              << std::fixed << std::setprecision(1)
+              << std::setw(11) << cell.late_ns.percentile(50) / 1000.0
+              << std::setw(11) << cell.late_ns.percentile(99) / 1000.0
+              << std::setw(11) << cell.late_ns.percentile(99.9) / 1000.0
+              << std::setw(11) << cell.late_ns.max() / 1000.0
+              << std::setw(8) << cell.early << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+void print_header(bool loaded, size_t load_threads)
+{
+    std::cout << "\nLoad: " << (loaded ? "busy (" + std::to_string(load_threads) + " threads)" : std::string("idle")) << std::endl;
+    std::cout << std::left << std::setw(12) << "Strategy" << std::right
+              << std::setw(10) << "Target ms" << std::setw(9) << "Samples"
+              << std::setw(11) << "p50 us" << std::setw(11) << "p99 us"
+              << std::setw(11) << "p99.9 us" << std::setw(11) << "max us"
+              << std::setw(8) << "Early" << std::endl;
+}
+
+bool write_csv(const std::string &filename, const std::vector<CellResult> &cells)
+{
+    std::ofstream out(filename.c_str());
+    if (!out.is_open())
+        return false;
+    out << "Strategy,Load,TargetMs,Samples,P50Us,P99Us,P999Us,MaxUs,Early,WorstEarlyUs\n";
+    for (size_t i = 0; i < cells.size(); ++i)
+    {
+        const CellResult &cell = cells[i];
+        out << cell.strategy << ',' << (cell.loaded ? "busy" : "idle") << ',' << cell.target_ms << ','
+            << cell.late_ns.count() << ',' << cell.late_ns.percentile(50) / 1000.0 << ','
+            << cell.late_ns.percentile(99) / 1000.0 << ',' << cell.late_ns.percentile(99.9) / 1000.0 << ','
+            << cell.late_ns.max() / 1000.0 << ',' << cell.early << ',' << cell.worst_early_ns / 1000.0 << '\n';
+    }
+    return true;
+}
+
+void print_usage(const char *program)
+{
+    std::cout << "Usage: " << program << " [-load idle|busy|both] [-csv FILE] [STRATEGIES|all] [DELAYS_MS] [SAMPLES]" << std::endl;
+    std::cout << "Strategies:";
+    for (size_t i = 0; i < STRATEGY_COUNT; ++i)
+        std::cout << ' ' << STRATEGIES[i].name;
+    std::cout << std::endl;
+    std::cout << "Defaults: all " << DEFAULT_DELAYS << " " << DEFAULT_SAMPLES << " (at most "
+              << CELL_BUDGET_MS / 1000 << " s per delay, at least " << MIN_SAMPLES << " samples)" << std::endl;
+    std::cout << "Example:" << std::endl;
+    std::cout << "  " << program << " -load both -csv bench.csv hybrid,nanosleep 0.5,1,10,100" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _WIN32
+    timeBeginPeriod(1); // same timer resolution as the sender
+#endif
+
+    bool run_idle = true;
+    bool run_busy = true;
+    std::string csv_file;
+    while (argc >= 3)
+    {
+        std::string option = argv[1];
+        if (option == "-load")
+        {
+            std::string load = argv[2];
+            run_idle = load == "idle" || load == "both";
+            run_busy = load == "busy" || load == "both";
+            if (!run_idle && !run_busy)
+            {
+                std::cout << "Error: -load must be idle, busy or both" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "-csv")
+        {
+            csv_file = argv[2];
+        }
+        else
+        {
+            break;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc > 4 || (argc >= 2 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")))
+    {
+        print_usage(argv[0]);
+        return argc > 4 ? 1 : 0;
+    }
+
+    std::vector<StrategyInfo> selected;
+    std::string names = argc >= 2 ? argv[1] : "all";
+    if (names == "all")
+    {
+        selected.assign(STRATEGIES, STRATEGIES + STRATEGY_COUNT);
+    }
+    else
+    {
+        std::stringstream stream(names);
+        std::string name;
+        while (std::getline(stream, name, ','))
+        {
+            size_t i = 0;
+            while (i < STRATEGY_COUNT && name != STRATEGIES[i].name)
+                ++i;
+            if (i == STRATEGY_COUNT)
+            {
+                std::cout << "Error: Unknown or unsupported strategy " << name << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+            selected.push_back(STRATEGIES[i]);
+        }
+    }
+
+    std::vector<double> delays;
+    if (!parse_ms_list(argc >= 3 ? argv[2] : DEFAULT_DELAYS, delays))
+    {
+        std::cout << "Error: Delays must be increasing positive values in ms, e.g. 0.1,1,10" << std::endl;
+        return 1;
+    }
+    int samples = argc >= 4 ? atoi(argv[3]) : DEFAULT_SAMPLES;
+    if (samples < 1)
+    {
+        std::cout << "Error: Sample count must be positive" << std::endl;
+        return 1;
+    }
+
+    init_timestamp_clock();
+    calibrate_spin_margin();
+    std::cout << "=== TIMING BENCHMARK ===" << std::endl;
+    std::cout << "Clock: " << timestamp_clock_name() << std::endl;
+    std::cout << "Spin margin: " << std::chrono::duration_cast<std::chrono::microseconds>(spin_margin()).count()
+              << "us (calibrated as the sender does)" << std::endl;
+    std::cout << "Error is wake-up time minus deadline; Early counts wake-ups before it" << std::endl;
+
+    std::vector<CellResult> cells;
+    BackgroundLoad load;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        bool loaded = pass == 1;
+        if ((loaded && !run_busy) || (!loaded && !run_idle))
+            continue;
+        if (loaded)
+            load.start();
+        print_header(loaded, load.thread_count());
+        for (size_t s = 0; s < selected.size(); ++s)
+        {
+            if (!Waiter(selected[s].strategy).ready())
+            {
+                std::cout << selected[s].name << ": unavailable on this host" << std::endl;
+                continue;
+            }
+            for (size_t d = 0; d < delays.size(); ++d)
+            {
+                int budget = (int)(CELL_BUDGET_MS / delays[d]);
+                int count = std::max(std::min(samples, budget), std::min(samples, MIN_SAMPLES));
+                CellResult cell;
+                cell.strategy = selected[s].name;
+                cell.loaded = loaded;
+                cell.target_ms = delays[d];
+                cell.early = 0;
+                cell.worst_early_ns = 0;
+                run_cell(selected[s].strategy, delays[d], count, cell);
+                print_row(cell);
+                cells.push_back(cell);
+            }
+        }
+        if (loaded)
+            load.stop();
+    }
+
+    // The spin margin has to cover the coarse sleep's tail overshoot
+    std::cout << std::endl;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        LatencyHistogram coarse;
+        for (size_t i = 0; i < cells.size(); ++i)
+        {
+            if (cells[i].loaded == (pass == 1) && cells[i].strategy == STRATEGIES[1].name)
+                coarse.merge(cells[i].late_ns);
+        }
+        if (coarse.count() == 0)
+            continue;
+        std::cout << STRATEGIES[1].name << " overshoot (" << (pass == 1 ? "busy" : "idle") << "): "
+                  << std::fixed << std::setprecision(1) << "p99.9=" << coarse.percentile(99.9) / 1000.0
+                  << "us, max=" << coarse.max() / 1000.0 << "us" << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    if (!csv_file.empty())
+    {
+        if (!write_csv(csv_file, cells))
+        {
+            std::cout << "Error: Cannot open output file " << csv_file << std::endl;
+            return 1;
+        }
+        std::cout << "\nResults written to " << csv_file << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Binary arrival log written by `receiver -logbin`.
+//
+// Layout: one BinLogHeader followed by fixed-width BinLogRecord entries in
+// arrival order. Both are 8-byte aligned so the file can be memory-mapped and
+// read as a record array. Raw arrival times are stored instead of IATs so
+// intervals can be recomputed after sorting by sequence number.
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#pragma pack(push, 1)
+struct BinLogHeader {
+    char magic[8];               // "CVTLOG1\0"
+    uint32_t version;
+    uint32_t header_size;        // sizeof(BinLogHeader), records start here
+    uint32_t record_size;        // sizeof(BinLogRecord)
+    uint16_t port;
+    uint8_t timestamp_source;    // 0 = user, 1 = kernel, 2 = hardware
+    uint8_t reserved;
+    int64_t clock_resolution_ns; // resolution of the clock behind arrival_ns
+    int64_t start_epoch_ns;      // wall clock (Unix epoch) when the log was opened
+    int64_t start_clock_ns;      // arrival clock reading at the same instant
+};
+
+struct BinLogRecord {
+    uint32_t sequence_number;    // host byte order
+    uint8_t packet_type;
+    uint8_t reserved[3];
+    int64_t arrival_ns;
+};
+#pragma pack(pop)
+
+const char BINLOG_MAGIC[8] = { 'C', 'V', 'T', 'L', 'O', 'G', '1', '\0' };
+const uint32_t BINLOG_VERSION = 1;
+
+// Appends records through a large userspace buffer. The buffer is written out
+// when full or when flush_interval_ns of arrival time has passed, so a killed
+// logger loses at most that much of the tail.
+class BinLogWriter {
+public:
+    static const size_t BUFFER_RECORDS = 64 * 1024; // 1 MiB
+
+    BinLogWriter() : file(NULL), used(0), last_flush_ns(0), flush_interval_ns(1000000000LL) {
+        memset(&header, 0, sizeof(header));
+        buffer.resize(BUFFER_RECORDS);
+    }
+
+    ~BinLogWriter() { close(); }
+
+    bool open(const std::string& filename, uint16_t port, uint8_t timestamp_source,
+              int64_t clock_resolution_ns, int64_t start_epoch_ns, int64_t start_clock_ns) {
+        file = fopen(filename.c_str(), "wb");
+        if (!file) return false;
+        memcpy(header.magic, BINLOG_MAGIC, sizeof(header.magic));
+        header.version = BINLOG_VERSION;
+        header.header_size = sizeof(BinLogHeader);
+        header.record_size = sizeof(BinLogRecord);
+        header.port = port;
+        header.timestamp_source = timestamp_source;
+        header.clock_resolution_ns = clock_resolution_ns;
+        header.start_epoch_ns = start_epoch_ns;
+        header.start_clock_ns = start_clock_ns;
+        last_flush_ns = start_clock_ns;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        fflush(file);
+        return ok;
+    }
+
+    // Rewrites the header in place when the timestamp source is settled late.
+    void set_timestamp_source(uint8_t timestamp_source) {
+        if (!file || header.timestamp_source == timestamp_source) return;
+        header.timestamp_source = timestamp_source;
+        flush();
+        long pos = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, file);
+        fseek(file, pos, SEEK_SET);
+    }
+
+    void append(uint32_t seq, uint8_t packet_type, int64_t arrival_ns) {
+        BinLogRecord& r = buffer[used++];
+        r.sequence_number = seq;
+        r.packet_type = packet_type;
+        r.reserved[0] = r.reserved[1] = r.reserved[2] = 0;
+        r.arrival_ns = arrival_ns;
+        if (used == buffer.size() || arrival_ns - last_flush_ns >= flush_interval_ns) {
+            flush();
+            last_flush_ns = arrival_ns;
+        }
+    }
+
+    void flush() {
+        if (!file) return;
+        if (used > 0) {
+            fwrite(&buffer[0], sizeof(BinLogRecord), used, file);
+            used = 0;
+        }
+        fflush(file);
+    }
+
+    void close() {
+        if (!file) return;
+        flush();
+        fclose(file);
+        file = NULL;
+    }
+
+private:
+    FILE* file;
+    BinLogHeader header;
+    std::vector<BinLogRecord> buffer;
+    size_t used;
+    int64_t last_flush_ns;
+    int64_t flush_interval_ns;
+};
+
+// Loads a whole binary log. Returns false with a message in `error` when the
+// file is missing, truncated or not a binary log.
+inline bool read_binlog(const std::string& filename, BinLogHeader& header,
+                        std::vector<BinLogRecord>& records, std::string& error) {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        error = "cannot open " + filename;
+        return false;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, BINLOG_MAGIC, sizeof(BINLOG_MAGIC)) != 0) {
+        error = filename + " is not a binary arrival log";
+        fclose(file);
+        return false;
+    }
+    if (header.version != BINLOG_VERSION || header.record_size != sizeof(BinLogRecord)) {
+        error = filename + " has an unsupported log version";
+        fclose(file);
+        return false;
+    }
+    fseek(file, header.header_size, SEEK_SET);
+
+    records.clear();
+    BinLogRecord chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, sizeof(BinLogRecord), 4096, file)) > 0) {
+        records.insert(records.end(), chunk, chunk + n);
+    }
+    fclose(file);
+    return true;
+}
+
+// True when the file starts with the binary log magic.
+inline bool is_binlog(const std::string& filename) {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) return false;
+    char magic[8];
+    bool match = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, BINLOG_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return match;
+}
+
+#endif
@@ -0,0 +1,284 @@
+// Low-overhead timestamp clock shared by the sender, receiver and bench.
+//
+// now_ns() is the one clock behind deadlines, send times and user-space
+// arrival stamps. On x86-64 Linux with an invariant TSC it is a single rdtscp
+// scaled by a rate calibrated against CLOCK_MONOTONIC_RAW. The rate is
+// re-measured every second from the whole run and any drift is slewed out,
+// so the clock never steps backward. On Windows it is QueryPerformanceCounter.
+// Elsewhere, or on a VM that hides the invariant TSC flag, it falls back to
+// CLOCK_MONOTONIC_RAW.
+//
+// The epoch is that of CLOCK_MONOTONIC_RAW (or of the counter), not of
+// CLOCK_MONOTONIC. Code handing absolute times to the kernel converts them
+// with kernel_clock_offset_ns().
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+    #ifndef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <time.h>
+    #if defined(__linux__) && defined(__x86_64__) && defined(__GNUC__)
+        #include <cpuid.h>
+        #include <x86intrin.h>
+        #define CLOCK_HAS_TSC 1
+    #endif
+#endif
+
+const int64_t CLOCK_CALIBRATE_NS = 10000000;  // first rate estimate, blocking
+const int64_t CLOCK_RESYNC_NS = 1000000000;   // between re-measurements
+const int64_t CLOCK_STEP_NS = 1000000;        // larger lags (suspend) are stepped, not slewed
+
+#ifndef _WIN32
+inline int64_t raw_clock_ns()
+{
+    timespec ts;
+    #ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    #else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    #endif
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+#endif
+
+#ifdef CLOCK_HAS_TSC
+// TSC-to-nanosecond conversion. The anchor (a TSC reading, its time and the
+// 32.32 fixed-point ns per tick) is replaced under a sequence lock by
+// whichever reader first passes the resync point; readers never block.
+class TscClock {
+public:
+    static TscClock& instance() {
+        static TscClock clock;
+        return clock;
+    }
+
+    bool usable() const { return invariant; }
+    double mhz() const { return 1000.0 * 4294967296.0 / (double)anchor_mult.load(std::memory_order_relaxed); }
+
+    int64_t now() {
+        unsigned seq;
+        uint64_t base_tsc, mult, sync_at;
+        int64_t base_ns;
+        do {
+            seq = sequence.load(std::memory_order_acquire);
+            base_tsc = anchor_tsc.load(std::memory_order_relaxed);
+            base_ns = anchor_ns.load(std::memory_order_relaxed);
+            mult = anchor_mult.load(std::memory_order_relaxed);
+            sync_at = next_sync.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || sequence.load(std::memory_order_relaxed) != seq);
+        // Read after the anchor, so it is never older than its TSC
+        uint64_t tsc = read_tsc();
+        int64_t ns = base_ns + scale(tsc - base_tsc, mult);
+        if (tsc >= sync_at) resync(seq, base_tsc, base_ns, mult);
+        return ns;
+    }
+
+private:
+    TscClock() : invariant(false), use_rdtscp(false), origin_tsc(0), origin_ns(0),
+                 sequence(0), anchor_tsc(0), anchor_ns(0), anchor_mult((uint64_t)1 << 32), next_sync(0) {
+        unsigned a, b, c, d;
+        invariant = __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1u << 8));
+        use_rdtscp = __get_cpuid(0x80000001, &a, &b, &c, &d) && (d & (1u << 27));
+        if (!invariant) return;
+        sample(origin_tsc, origin_ns);
+        while (raw_clock_ns() - origin_ns < CLOCK_CALIBRATE_NS) {
+        }
+        uint64_t tsc;
+        int64_t ns;
+        sample(tsc, ns);
+        if (tsc <= origin_tsc) {
+            invariant = false;
+            return;
+        }
+        uint64_t mult = (uint64_t)(((unsigned __int128)(ns - origin_ns) << 32) / (tsc - origin_tsc));
+        anchor_tsc.store(tsc);
+        anchor_ns.store(ns);
+        anchor_mult.store(mult);
+        next_sync.store(tsc + ticks_for(CLOCK_RESYNC_NS, mult));
+    }
+
+    uint64_t read_tsc() const {
+        if (use_rdtscp) {
+            unsigned aux;
+            return __rdtscp(&aux);
+        }
+        return __rdtsc();
+    }
+
+    // Reads the TSC and the reference together, keeping the tightest of a
+    // few brackets so a preempted read does not skew the rate
+    void sample(uint64_t& tsc, int64_t& ns) const {
+        uint64_t best = UINT64_MAX;
+        tsc = 0;
+        ns = 0;
+        for (int i = 0; i < 3; ++i) {
+            uint64_t before = read_tsc();
+            int64_t raw = raw_clock_ns();
+            uint64_t after = read_tsc();
+            if (after - before < best) {
+                best = after - before;
+                tsc = before + (after - before) / 2;
+                ns = raw;
+            }
+        }
+    }
+
+    static int64_t scale(uint64_t ticks, uint64_t mult) {
+        // Signed: another core's TSC may trail the anchor by a few ticks
+        return (int64_t)(((__int128)(int64_t)ticks * (__int128)mult) >> 32);
+    }
+
+    static uint64_t ticks_for(int64_t ns, uint64_t mult) {
+        return (uint64_t)(((unsigned __int128)ns << 32) / mult);
+    }
+
+    void resync(unsigned seq, uint64_t base_tsc, int64_t base_ns, uint64_t mult) {
+        if (!sequence.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire)) return;
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint64_t tsc;
+        int64_t raw;
+        sample(tsc, raw);
+        // Continue from the current estimate so no reader sees a step
+        int64_t estimate = base_ns + scale(tsc - base_tsc, mult);
+        // Rate over the whole run, so one noisy sample barely moves it
+        uint64_t rate = (uint64_t)(((unsigned __int128)(raw - origin_ns) << 32) / (tsc - origin_tsc));
+        int64_t error = raw - estimate;
+        if (error > CLOCK_STEP_NS) {
+            estimate = raw;
+            error = 0;
+        }
+        if (error < -CLOCK_RESYNC_NS / 2) error = -CLOCK_RESYNC_NS / 2;
+        // Slew the remaining error out over the next interval
+        uint64_t interval = ticks_for(CLOCK_RESYNC_NS, rate);
+        uint64_t corrected = (uint64_t)((int64_t)rate + (int64_t)(((__int128)error << 32) / (__int128)interval));
+
+        anchor_tsc.store(tsc, std::memory_order_relaxed);
+        anchor_ns.store(estimate, std::memory_order_relaxed);
+        anchor_mult.store(corrected, std::memory_order_relaxed);
+        next_sync.store(tsc + interval, std::memory_order_relaxed);
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    bool invariant;
+    bool use_rdtscp;
+    uint64_t origin_tsc; // calibration start, fixed after construction
+    int64_t origin_ns;
+
+    std::atomic<unsigned> sequence; // odd while the anchor is being replaced
+    std::atomic<uint64_t> anchor_tsc;
+    std::atomic<int64_t> anchor_ns;
+    std::atomic<uint64_t> anchor_mult;
+    std::atomic<uint64_t> next_sync;
+};
+#endif
+
+#ifdef _WIN32
+inline int64_t qpc_frequency()
+{
+    static int64_t frequency = 0;
+    if (frequency == 0) {
+        LARGE_INTEGER value;
+        QueryPerformanceFrequency(&value);
+        frequency = value.QuadPart;
+    }
+    return frequency;
+}
+#endif
+
+// Nanoseconds on the shared timestamp clock
+inline int64_t now_ns()
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    int64_t frequency = qpc_frequency();
+    return counter.QuadPart / frequency * 1000000000LL + counter.QuadPart % frequency * 1000000000LL / frequency;
+#elif defined(CLOCK_HAS_TSC)
+    TscClock& tsc = TscClock::instance();
+    return tsc.usable() ? tsc.now() : raw_clock_ns();
+#else
+    return raw_clock_ns();
+#endif
+}
+
+// Calibrates up front (10 ms with a TSC) rather than on the first timestamp
+inline void init_timestamp_clock()
+{
+    now_ns();
+}
+
+inline int64_t now_ns_resolution()
+{
+#ifdef _WIN32
+    int64_t step = 1000000000LL / qpc_frequency();
+    return step > 0 ? step : 1;
+#else
+    #ifdef CLOCK_HAS_TSC
+    if (TscClock::instance().usable()) return 1;
+    #endif
+    timespec res;
+    #ifdef CLOCK_MONOTONIC_RAW
+    if (clock_getres(CLOCK_MONOTONIC_RAW, &res) != 0) return 1;
+    #else
+    if (clock_getres(CLOCK_MONOTONIC, &res) != 0) return 1;
+    #endif
+    return (int64_t)res.tv_sec * 1000000000LL + res.tv_nsec;
+#endif
+}
+
+inline std::string timestamp_clock_name()
+{
+    char text[64];
+#ifdef _WIN32
+    snprintf(text, sizeof(text), "QueryPerformanceCounter (%.1f MHz)", qpc_frequency() / 1e6);
+#elif defined(CLOCK_HAS_TSC)
+    if (TscClock::instance().usable())
+        snprintf(text, sizeof(text), "invariant TSC (%.1f MHz)", TscClock::instance().mhz());
+    else
+        snprintf(text, sizeof(text), "CLOCK_MONOTONIC_RAW (no invariant TSC)");
+#else
+    snprintf(text, sizeof(text), "CLOCK_MONOTONIC_RAW");
+#endif
+    return text;
+}
+
+#ifdef __linux__
+// Offset from now_ns() to kernel clock `id`, for absolute kernel deadlines.
+// CLOCK_MONOTONIC is slewed by NTP, so re-read it for long-running schedules.
+inline int64_t kernel_clock_offset_ns(clockid_t id)
+{
+    int64_t before = now_ns();
+    timespec ts;
+    clock_gettime(id, &ts);
+    int64_t after = now_ns();
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - (before + (after - before) / 2);
+}
+#endif
+
+// now_ns() as a std::chrono clock, for deadline arithmetic
+struct timestamp_clock {
+    typedef std::chrono::nanoseconds duration;
+    typedef duration::rep rep;
+    typedef duration::period period;
+    typedef std::chrono::time_point<timestamp_clock> time_point;
+    static const bool is_steady = true;
+
+    static time_point now() { return time_point(duration(now_ns())); }
+};
+
+#endif
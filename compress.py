@@ -35,7 +35,7 @@ def compress(x):
 input_filename = "data/past_data/timings_1_fuzzed.csv"
 
 try:
-    input_df = pd.read_csv(input_filename, header=None)
+    input_df = pd.read_csv(input_filename, header=None, comment='#')
     iats_seconds = pd.to_numeric(input_df.iloc[:, 0], errors='coerce').dropna()
 
     # Step 2 from Cabuk et al.: drop all IATs over 1.0 sec
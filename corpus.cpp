@@ -0,0 +1,213 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "corpus.h"
+
+// Builds and fills the corpus cache shared with `evaluate -cache`: one
+// memory-mappable column per dataset and detector scores per window size,
+// so plots and ROC sweeps over unchanged data read scores instead of
+// rescoring the raw IATs.
+
+const char* DEFAULT_CACHE_DIR = "corpus_cache";
+
+// The listed files, or every CSV in data/ and data/past_data/ for "all"
+std::vector<std::string> dataset_files(const std::string& list)
+{
+    if (list != "all")
+        return split_list(list);
+    std::vector<std::string> files;
+    list_csv_files("data", files);
+    list_csv_files("data/past_data", files);
+    return files;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int run_index_mode(ScoreCache& cache, const std::vector<std::string>& files)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t rebuilt_count = 0;
+    std::string error;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        CorpusDataset info;
+        bool rebuilt;
+        if (!cache.dataset(files[i], info, rebuilt, error))
+        {
+            std::cout << "Error: " << error << std::endl;
+            return 1;
+        }
+        rebuilt_count += rebuilt;
+        std::cout << std::left << std::setw(48) << files[i] << std::right << std::setw(10) << info.samples
+                  << " IATs  " << hash_text(info.hash) << (rebuilt ? "  indexed" : "  up to date") << std::endl;
+    }
+    if (!cache.save(error))
+    {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+    std::cout << "\n" << files.size() << " datasets, " << rebuilt_count << " re-indexed in " << std::fixed
+              << std::setprecision(2) << seconds_since(start) << "s; columns in " << cache.directory() << "/columns"
+              << std::endl;
+    return 0;
+}
+
+// Scores every detector at every window size for each dataset, skipping
+// what is cached already
+int run_score_mode(ScoreCache& cache, const std::vector<std::string>& files, const std::vector<size_t>& window_sizes,
+                   size_t threads)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t hits = 0;
+    size_t misses = 0;
+    std::string error;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        CorpusDataset info;
+        bool rebuilt;
+        if (!cache.dataset(files[i], info, rebuilt, error))
+        {
+            std::cout << "Error: " << error << std::endl;
+            return 1;
+        }
+        Column column;
+        for (size_t s = 0; s < window_sizes.size(); ++s)
+        {
+            const size_t w = window_sizes[s];
+            const size_t windows = (size_t)info.samples / w;
+            std::vector<std::vector<double> > scores(DETECTOR_COUNT, std::vector<double>(windows));
+            bool cached = true;
+            for (size_t f = 0; f < DETECTOR_FAMILY_COUNT && cached; ++f)
+                cached = cache.load(info.hash, w, f, windows, scores);
+            std::cout << std::left << std::setw(48) << files[i] << std::right << std::setw(6) << w << std::setw(8)
+                      << windows << " windows  " << (cached ? "cached" : "scored") << std::endl;
+            if (cached)
+            {
+                hits++;
+                continue;
+            }
+            misses++;
+
+            if (column.size() == 0 && !column.map(info.column, error))
+            {
+                std::cout << "Error: " << error << std::endl;
+                return 1;
+            }
+            run_pool((windows + SHARD_WINDOWS - 1) / SHARD_WINDOWS, threads, [&](size_t i) {
+                size_t first = i * SHARD_WINDOWS;
+                score_windows(column.values(), w, first, std::min(SHARD_WINDOWS, windows - first), scores);
+            });
+
+            for (size_t f = 0; f < DETECTOR_FAMILY_COUNT; ++f)
+            {
+                if (!cache.store(info.hash, w, f, windows, scores, error))
+                {
+                    std::cout << "Error: " << error << std::endl;
+                    return 1;
+                }
+            }
+        }
+    }
+    if (!cache.save(error))
+    {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+    std::cout << "\n" << hits << " tables cached, " << misses << " scored on " << threads << " threads in " << std::fixed
+              << std::setprecision(2) << seconds_since(start) << "s; index in " << cache.directory() << "/scores.csv"
+              << std::endl;
+    return 0;
+}
+
+int run_list_mode(const ScoreCache& cache)
+{
+    const std::map<std::string, CorpusDataset>& datasets = cache.dataset_list();
+    const std::map<std::string, ScoreEntry>& entries = cache.entry_list();
+    std::cout << "Datasets (" << datasets.size() << "):" << std::endl;
+    for (std::map<std::string, CorpusDataset>::const_iterator it = datasets.begin(); it != datasets.end(); ++it)
+    {
+        std::cout << "  " << std::left << std::setw(48) << it->first << std::right << std::setw(10)
+                  << it->second.samples << " IATs  " << hash_text(it->second.hash) << std::endl;
+    }
+    std::cout << "Score entries (" << entries.size() << "):" << std::endl;
+    for (std::map<std::string, ScoreEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        const ScoreEntry& e = it->second;
+        std::cout << "  " << hash_text(e.hash) << "  " << std::left << std::setw(14) << e.detector << std::right
+                  << std::setw(6) << e.window_size << std::setw(8) << e.windows << " windows  " << e.file << std::endl;
+    }
+    return 0;
+}
+
+void print_usage(const char* program)
+{
+    std::cout << "Corpus Cache Usage:" << std::endl;
+    std::cout << "  " << program << " [-cache DIR] -index [FILES|all]" << std::endl;
+    std::cout << "  " << program << " [-cache DIR] -score <FILES|all> <WINDOW_SIZES> [THREADS]" << std::endl;
+    std::cout << "  " << program << " [-cache DIR] -list" << std::endl;
+    std::cout << "Lists are comma-separated; \"all\" is every CSV in data/ and data/past_data/." << std::endl;
+    std::cout << "The cache directory defaults to " << DEFAULT_CACHE_DIR << "." << std::endl;
+    std::cout << "Example:" << std::endl;
+    std::cout << "  " << program << " -index" << std::endl;
+    std::cout << "  " << program << " -score all 510,1000,2000" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* program = argv[0];
+    std::string cache_dir = DEFAULT_CACHE_DIR;
+    while (argc >= 3 && std::string(argv[1]) == "-cache")
+    {
+        cache_dir = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc < 2)
+    {
+        print_usage(program);
+        return 1;
+    }
+
+    std::string mode = argv[1];
+    ScoreCache cache(cache_dir);
+    std::string error;
+    if ((mode == "-index" || mode == "-score" || mode == "-list") && !cache.open(error))
+    {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+
+    if (mode == "-index" && argc <= 3)
+        return run_index_mode(cache, dataset_files(argc == 3 ? argv[2] : "all"));
+
+    if (mode == "-score" && (argc == 4 || argc == 5))
+    {
+        std::vector<size_t> window_sizes;
+        if (!parse_window_sizes(argv[3], window_sizes))
+        {
+            std::cout << "Error: Window sizes must be at least 2" << std::endl;
+            return 1;
+        }
+        size_t threads = parse_thread_count(argc == 5 ? argv[4] : NULL);
+        std::vector<std::string> files = dataset_files(argv[2]);
+        if (files.empty() || window_sizes.empty())
+        {
+            std::cout << "Error: Need at least one file and window size" << std::endl;
+            return 1;
+        }
+        return run_score_mode(cache, files, window_sizes, threads);
+    }
+
+    if (mode == "-list" && argc == 2)
+        return run_list_mode(cache);
+
+    print_usage(program);
+    return 1;
+}
@@ -0,0 +1,573 @@
+// Binary IAT columns and a persistent detector score cache for the data/
+// corpus, behind `corpus` and `evaluate -cache`.
+//
+// Each dataset is parsed once into a column file: a ColumnHeader followed by
+// its IATs as little-endian doubles, so it maps straight into an array (or
+// numpy.fromfile(..., offset=64)). Windows are fixed runs of samples, so
+// window i of size w starts at value i * w and the layout is its own index.
+//
+// Score entries are keyed by (column hash, detector, window size, detector
+// parameters). The hash is taken over the parsed values, so re-exporting a
+// file without changing its numbers keeps its scores. Entries are CSVs in
+// the layout of analyzer -eps output, one row per full window, listed with
+// their keys in scores.csv; datasets.csv maps each source file to its hash
+// and column. A source whose size or modification time changed is re-parsed.
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dataset.h"
+#include "detectors.h"
+
+#ifdef _WIN32
+    #include <direct.h>
+#else
+    #include <dirent.h>
+#endif
+
+#pragma pack(push, 1)
+struct ColumnHeader {
+    char magic[8];        // "IATCOL1\0"
+    uint32_t version;
+    uint32_t header_size; // sizeof(ColumnHeader), values start here
+    uint64_t samples;
+    uint64_t hash;        // column_hash() of the values
+    uint64_t source_size;
+    int64_t source_mtime; // seconds since the Unix epoch
+    uint8_t reserved[16];
+};
+#pragma pack(pop)
+
+const char COLUMN_MAGIC[8] = { 'I', 'A', 'T', 'C', 'O', 'L', '1', '\0' };
+const uint32_t COLUMN_VERSION = 1;
+
+// Per-window detector outputs: epsilon-similarity (original and improved) at
+// each default epsilon, then compressibility.
+const size_t DETECTOR_COUNT = 2 * DEFAULT_EPSILON_COUNT + 1;
+
+inline std::string detector_name(size_t d)
+{
+    if (d < DEFAULT_EPSILON_COUNT) return "eps_" + format_double(DEFAULT_EPSILONS[d]);
+    if (d < 2 * DEFAULT_EPSILON_COUNT) return "eps_improved_" + format_double(DEFAULT_EPSILONS[d - DEFAULT_EPSILON_COUNT]);
+    return "compress";
+}
+
+// The detectors whose columns are cached together: one entry holds the
+// scores of every epsilon of a variant, as an analyzer -eps file does.
+struct DetectorFamily {
+    const char* name;
+    size_t first; // first column in DETECTOR_COUNT order
+    size_t count;
+};
+
+const DetectorFamily DETECTOR_FAMILIES[] = {
+    { "eps", 0, DEFAULT_EPSILON_COUNT },
+    { "eps_improved", DEFAULT_EPSILON_COUNT, DEFAULT_EPSILON_COUNT },
+    { "compress", 2 * DEFAULT_EPSILON_COUNT, 1 },
+};
+const size_t DETECTOR_FAMILY_COUNT = sizeof(DETECTOR_FAMILIES) / sizeof(DETECTOR_FAMILIES[0]);
+
+// Everything besides the window size that changes a family's scores
+inline std::string family_params(size_t f)
+{
+    if (DETECTOR_FAMILIES[f].count == 1) return "max_iat=1;gzip=9";
+    std::string params = "eps=";
+    for (size_t k = 0; k < DEFAULT_EPSILON_COUNT; ++k) params += (k ? ";" : "") + format_double(DEFAULT_EPSILONS[k]);
+    return params;
+}
+
+// Column header line of a family's entry
+inline std::string family_header(size_t f)
+{
+    if (DETECTOR_FAMILIES[f].count == 1) return "Compressibility";
+    std::string header;
+    for (size_t k = 0; k < DEFAULT_EPSILON_COUNT; ++k) header += (k ? "," : "") + format_double(DEFAULT_EPSILONS[k]);
+    return header;
+}
+
+// Scores windows [first, first + count) of size w into scores[detector][window].
+// Scratch buffers and the deflate context are per call, so calls on
+// different windows run independently.
+inline void score_windows(const double* iats, size_t w, size_t first, size_t count,
+                          std::vector<std::vector<double> >& scores)
+{
+    std::vector<double> sorted;
+    std::vector<double> ratios;
+    std::vector<double> filtered;
+    double eps_scores[DEFAULT_EPSILON_COUNT];
+    CompressibilityScorer compress;
+
+    for (size_t i = first; i < first + count; ++i) {
+        const double* window = iats + i * w;
+
+        epsilon_similarity(window, w, DEFAULT_EPSILONS, DEFAULT_EPSILON_COUNT, false, sorted, ratios, eps_scores);
+        for (size_t k = 0; k < DEFAULT_EPSILON_COUNT; ++k) scores[k][i] = eps_scores[k];
+
+        // The improved variant is the top third of the same sorted window
+        size_t start = (size_t)std::floor(w * (2.0 / 3.0));
+        score_sorted_epsilon(&sorted[0] + start, w - start, DEFAULT_EPSILONS, DEFAULT_EPSILON_COUNT, ratios, eps_scores);
+        for (size_t k = 0; k < DEFAULT_EPSILON_COUNT; ++k) scores[DEFAULT_EPSILON_COUNT + k][i] = eps_scores[k];
+
+        // Cabuk et al.: IATs over 1 s are dropped before compressing
+        filtered.clear();
+        for (size_t j = 0; j < w; ++j) {
+            if (window[j] <= 1.0) filtered.push_back(window[j]);
+        }
+        scores[2 * DEFAULT_EPSILON_COUNT][i] =
+            filtered.empty() ? std::numeric_limits<double>::quiet_NaN() : compress.score(&filtered[0], filtered.size());
+    }
+}
+
+// Windows per unit of work when a pool scores a table
+const size_t SHARD_WINDOWS = 64;
+
+// Runs job(i) for each i in [0, jobs) on `threads` threads, each taking the
+// next unclaimed job
+template <typename Job>
+inline void run_pool(size_t jobs, size_t threads, Job job)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.push_back(std::thread([&]() {
+            size_t i;
+            while ((i = next.fetch_add(1)) < jobs) job(i);
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); ++t) pool[t].join();
+}
+
+// The non-empty items of a comma-separated list
+inline std::vector<std::string> split_list(const std::string& list)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > start) items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+// A comma-separated list of window sizes; false if one is below 2
+inline bool parse_window_sizes(const std::string& list, std::vector<size_t>& sizes)
+{
+    std::vector<std::string> items = split_list(list);
+    sizes.clear();
+    for (size_t i = 0; i < items.size(); ++i) {
+        long w = atol(items[i].c_str());
+        if (w < 2) return false;
+        sizes.push_back((size_t)w);
+    }
+    return true;
+}
+
+// A thread count argument, or every hardware thread without one
+inline size_t parse_thread_count(const char* text)
+{
+    size_t threads = text ? (size_t)atol(text) : std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
+
+// 64-bit FNV-1a over the value bytes
+inline uint64_t column_hash(const double* values, size_t n)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char* p = (const unsigned char*)values;
+    for (size_t i = 0; i < n * sizeof(double); ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+inline std::string hash_text(uint64_t hash)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+    return text;
+}
+
+// Size and modification time, to tell whether a source needs re-parsing
+inline bool file_stamp(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) return false;
+    size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    uint64_t ticks = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+    mtime = (int64_t)(ticks / 10000000ULL) - 11644473600LL; // 100 ns ticks since 1601
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = (uint64_t)st.st_size;
+    mtime = (int64_t)st.st_mtime;
+#endif
+    return true;
+}
+
+inline bool make_directory(const std::string& path)
+{
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+// The *.csv files directly inside `dir`, sorted
+inline void list_csv_files(const std::string& dir, std::vector<std::string>& files)
+{
+    std::vector<std::string> found;
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE search = FindFirstFileA((dir + "\\*.csv").c_str(), &entry);
+    if (search != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) found.push_back(dir + "/" + entry.cFileName);
+        } while (FindNextFileA(search, &entry));
+        FindClose(search);
+    }
+#else
+    DIR* handle = opendir(dir.c_str());
+    if (handle) {
+        while (dirent* entry = readdir(handle)) {
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) {
+                std::string path = dir + "/" + name;
+                struct stat st;
+                if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) found.push_back(path);
+            }
+        }
+        closedir(handle);
+    }
+#endif
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+inline bool write_column(const std::string& path, const std::vector<double>& values, uint64_t hash,
+                         uint64_t source_size, int64_t source_mtime, std::string& error)
+{
+    // Written aside and renamed, so a reader never maps a half-written column
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        error = "cannot create " + temp;
+        return false;
+    }
+    ColumnHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLUMN_MAGIC, sizeof(header.magic));
+    header.version = COLUMN_VERSION;
+    header.header_size = sizeof(ColumnHeader);
+    header.samples = values.size();
+    header.hash = hash;
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !values.empty()) ok = fwrite(&values[0], sizeof(double), values.size(), file) == values.size();
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    if (ok) remove(path.c_str());
+#endif
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+// A mapped column file; the values are read in place
+class Column {
+public:
+    Column() : header(NULL) {}
+
+    bool map(const std::string& path, std::string& error) {
+        header = NULL;
+        if (!file.map(path, error)) return false;
+        const ColumnHeader* h = (const ColumnHeader*)file.data();
+        if (file.size() < sizeof(ColumnHeader) || memcmp(h->magic, COLUMN_MAGIC, sizeof(h->magic)) != 0 ||
+            h->version != COLUMN_VERSION || h->header_size != sizeof(ColumnHeader) ||
+            file.size() != sizeof(ColumnHeader) + h->samples * sizeof(double)) {
+            error = path + " is not a valid column file";
+            file.unmap();
+            return false;
+        }
+        header = h;
+        return true;
+    }
+
+    const double* values() const { return (const double*)(file.data() + sizeof(ColumnHeader)); }
+    size_t size() const { return header ? (size_t)header->samples : 0; }
+    uint64_t hash() const { return header ? header->hash : 0; }
+
+private:
+    MappedFile file;
+    const ColumnHeader* header;
+};
+
+// One row of datasets.csv
+struct CorpusDataset {
+    std::string path;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t hash;
+    uint64_t samples;
+    std::string column; // column file path
+};
+
+// One row of scores.csv
+struct ScoreEntry {
+    uint64_t hash;
+    std::string detector;
+    size_t window_size;
+    std::string params;
+    size_t windows;
+    std::string file;
+};
+
+// The cache directory: columns/ and scores/ with datasets.csv and scores.csv
+// listing them. Changes to the lists are written by save().
+class ScoreCache {
+public:
+    explicit ScoreCache(const std::string& directory) : dir(directory), dirty(false) {}
+
+    const std::string& directory() const { return dir; }
+
+    bool open(std::string& error) {
+        if (!make_directory(dir) || !make_directory(dir + "/columns") || !make_directory(dir + "/scores")) {
+            error = "cannot create cache directory " + dir;
+            return false;
+        }
+        std::vector<std::vector<std::string> > rows;
+        read_rows(dir + "/datasets.csv", rows);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (rows[i].size() != 6) continue;
+            CorpusDataset d;
+            d.path = rows[i][0];
+            d.source_size = strtoull(rows[i][1].c_str(), NULL, 10);
+            d.source_mtime = strtoll(rows[i][2].c_str(), NULL, 10);
+            d.hash = strtoull(rows[i][3].c_str(), NULL, 16);
+            d.samples = strtoull(rows[i][4].c_str(), NULL, 10);
+            d.column = rows[i][5];
+            datasets[d.path] = d;
+        }
+        rows.clear();
+        read_rows(dir + "/scores.csv", rows);
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (rows[i].size() != 6) continue;
+            ScoreEntry e;
+            e.hash = strtoull(rows[i][0].c_str(), NULL, 16);
+            e.detector = rows[i][1];
+            e.window_size = (size_t)strtoull(rows[i][2].c_str(), NULL, 10);
+            e.params = rows[i][3];
+            e.windows = (size_t)strtoull(rows[i][4].c_str(), NULL, 10);
+            e.file = rows[i][5];
+            entries[entry_key(e.hash, e.detector, e.window_size, e.params)] = e;
+        }
+        return true;
+    }
+
+    // Brings the column of `path` up to date, re-parsing the source only when
+    // its size or modification time changed. `rebuilt` says whether it did.
+    bool dataset(const std::string& path, CorpusDataset& info, bool& rebuilt, std::string& error) {
+        rebuilt = false;
+        uint64_t size;
+        int64_t mtime;
+        if (!file_stamp(path, size, mtime)) {
+            error = "cannot open " + path;
+            return false;
+        }
+        std::map<std::string, CorpusDataset>::const_iterator it = datasets.find(path);
+        uint64_t stamp_size;
+        int64_t stamp_mtime;
+        if (it != datasets.end() && it->second.source_size == size && it->second.source_mtime == mtime &&
+            file_stamp(it->second.column, stamp_size, stamp_mtime) &&
+            stamp_size == sizeof(ColumnHeader) + it->second.samples * sizeof(double)) {
+            info = it->second;
+            return true;
+        }
+
+        std::vector<double> iats;
+        if (!load_iats(path, iats, error)) return false;
+        info.path = path;
+        info.source_size = size;
+        info.source_mtime = mtime;
+        info.hash = column_hash(iats.empty() ? NULL : &iats[0], iats.size());
+        info.samples = iats.size();
+        info.column = dir + "/columns/" + column_name(path);
+        if (!write_column(info.column, iats, info.hash, size, mtime, error)) return false;
+        datasets[path] = info;
+        dirty = true;
+        rebuilt = true;
+        return true;
+    }
+
+    // Fills columns [family.first, family.first + family.count) of `scores`,
+    // already sized for `windows` windows, from the cache. False on a miss.
+    bool load(uint64_t hash, size_t window_size, size_t f, size_t windows, std::vector<std::vector<double> >& scores) {
+        const DetectorFamily& family = DETECTOR_FAMILIES[f];
+        std::map<std::string, ScoreEntry>::const_iterator it =
+            entries.find(entry_key(hash, family.name, window_size, family_params(f)));
+        if (it == entries.end() || it->second.windows != windows) return false;
+
+        std::string text;
+        std::string error;
+        if (!read_file_bytes(it->second.file, text, error)) return false;
+        size_t line_end = text.find('\n');
+        if (line_end == std::string::npos || text.compare(0, line_end, family_header(f)) != 0) return false;
+        const char* p = text.c_str() + line_end + 1;
+        for (size_t w = 0; w < windows; ++w) {
+            for (size_t k = 0; k < family.count; ++k) {
+                // Empty fields are NaN windows
+                char* end = (char*)p;
+                double value = std::numeric_limits<double>::quiet_NaN();
+                if (*p != ',' && *p != '\n') value = strtod(p, &end);
+                if (*end != (k + 1 < family.count ? ',' : '\n')) return false;
+                scores[family.first + k][w] = value;
+                p = end + 1;
+            }
+        }
+        return true;
+    }
+
+    bool store(uint64_t hash, size_t window_size, size_t f, size_t windows,
+               const std::vector<std::vector<double> >& scores, std::string& error) {
+        const DetectorFamily& family = DETECTOR_FAMILIES[f];
+        ScoreEntry e;
+        e.hash = hash;
+        e.detector = family.name;
+        e.window_size = window_size;
+        e.params = family_params(f);
+        e.windows = windows;
+        e.file = dir + "/scores/" + hash_text(hash) + "_" + family.name + "_" + std::to_string(window_size) + ".csv";
+
+        std::string temp = e.file + ".tmp";
+        std::ofstream out(temp.c_str());
+        if (!out.is_open()) {
+            error = "cannot create " + temp;
+            return false;
+        }
+        out << family_header(f) << '\n';
+        for (size_t w = 0; w < windows; ++w) {
+            for (size_t k = 0; k < family.count; ++k) out << (k ? "," : "") << format_double(scores[family.first + k][w]);
+            out << '\n';
+        }
+        out.close();
+#ifdef _WIN32
+        remove(e.file.c_str());
+#endif
+        if (out.fail() || rename(temp.c_str(), e.file.c_str()) != 0) {
+            remove(temp.c_str());
+            error = "cannot write " + e.file;
+            return false;
+        }
+        entries[entry_key(hash, e.detector, window_size, e.params)] = e;
+        dirty = true;
+        return true;
+    }
+
+    // Writes datasets.csv and scores.csv if anything changed
+    bool save(std::string& error) {
+        if (!dirty) return true;
+        std::ostringstream list;
+        list << "Dataset,SourceSize,SourceMtime,Hash,Samples,Column\n";
+        for (std::map<std::string, CorpusDataset>::const_iterator it = datasets.begin(); it != datasets.end(); ++it) {
+            const CorpusDataset& d = it->second;
+            list << d.path << ',' << d.source_size << ',' << d.source_mtime << ',' << hash_text(d.hash) << ','
+                 << d.samples << ',' << d.column << '\n';
+        }
+        if (!write_text(dir + "/datasets.csv", list.str(), error)) return false;
+
+        list.str("");
+        list << "Hash,Detector,WindowSize,Params,Windows,File\n";
+        for (std::map<std::string, ScoreEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+            const ScoreEntry& e = it->second;
+            list << hash_text(e.hash) << ',' << e.detector << ',' << e.window_size << ',' << e.params << ','
+                 << e.windows << ',' << e.file << '\n';
+        }
+        if (!write_text(dir + "/scores.csv", list.str(), error)) return false;
+        dirty = false;
+        return true;
+    }
+
+    const std::map<std::string, CorpusDataset>& dataset_list() const { return datasets; }
+    const std::map<std::string, ScoreEntry>& entry_list() const { return entries; }
+
+private:
+    static std::string entry_key(uint64_t hash, const std::string& detector, size_t window_size, const std::string& params) {
+        return hash_text(hash) + "," + detector + "," + std::to_string(window_size) + "," + params;
+    }
+
+    // data/past_data/timings_1.csv -> data_past_data_timings_1.iatc
+    static std::string column_name(const std::string& path) {
+        std::string name = path;
+        while (name.compare(0, 2, "./") == 0) name.erase(0, 2);
+        for (size_t i = 0; i < name.size(); ++i) {
+            if (name[i] == '/' || name[i] == '\\' || name[i] == ':' || name[i] == ',') name[i] = '_';
+        }
+        size_t ext = name.rfind(".csv");
+        if (ext != std::string::npos && ext + 4 == name.size()) name.erase(ext);
+        return name + ".iatc";
+    }
+
+    // Data rows of a list file, split on commas
+    static void read_rows(const std::string& path, std::vector<std::vector<std::string> >& rows) {
+        std::ifstream in(path.c_str());
+        std::string line;
+        if (!std::getline(in, line)) return;
+        while (std::getline(in, line)) {
+            std::vector<std::string> fields;
+            size_t start = 0;
+            while (true) {
+                size_t comma = line.find(',', start);
+                fields.push_back(line.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+                if (comma == std::string::npos) break;
+                start = comma + 1;
+            }
+            rows.push_back(fields);
+        }
+    }
+
+    static bool write_text(const std::string& path, const std::string& text, std::string& error) {
+        std::string temp = path + ".tmp";
+        FILE* file = fopen(temp.c_str(), "wb");
+        bool ok = file && fwrite(text.data(), 1, text.size(), file) == text.size();
+        if (file) ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+        if (ok) remove(path.c_str());
+#endif
+        if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+            remove(temp.c_str());
+            error = "cannot write " + path;
+            return false;
+        }
+        return true;
+    }
+
+    std::string dir;
+    std::map<std::string, CorpusDataset> datasets;
+    std::map<std::string, ScoreEntry> entries;
+    bool dirty;
+};
+
+#endif
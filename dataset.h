@@ -0,0 +1,252 @@
+// IAT dataset loading and CSV output helpers for the analysis tools.
+//
+// Accepts every log layout in data/: receiver -log CSVs ("Time" header, in
+// ms), the "IPDs" captures in seconds, UTF-16 exports with a BOM, comment
+// lines, and receiver -logbin files. Only the first column is read and lines
+// that do not parse as a number are skipped, like pandas' to_numeric(...,
+// errors='coerce').dropna() in the Python scripts.
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "binlog.h"
+
+#ifdef _WIN32
+    #ifndef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() : bytes(NULL), length(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#endif
+    }
+
+    ~MappedFile() { unmap(); }
+
+    bool map(const std::string& path, std::string& error) {
+        unmap();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            error = "cannot open " + path;
+            return false;
+        }
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        length = (size_t)size.QuadPart;
+        if (length == 0) return true;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        bytes = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error = "cannot open " + path;
+            return false;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        length = (size_t)st.st_size;
+        if (length == 0) {
+            ::close(fd);
+            return true;
+        }
+        void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        bytes = addr == MAP_FAILED ? NULL : (const char*)addr;
+#endif
+        if (!bytes) {
+            error = "cannot map " + path;
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    void unmap() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        if (bytes) munmap((void*)bytes, length);
+#endif
+        bytes = NULL;
+        length = 0;
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+// Reads a whole file (or stdin for "-") into memory.
+inline bool read_file_bytes(const std::string& path, std::string& bytes, std::string& error)
+{
+    FILE* file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    bytes.clear();
+    char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        bytes.append(chunk, n);
+    }
+    if (file != stdin) fclose(file);
+    return true;
+}
+
+// Parses the first numeric column of CSV text, one value per line. The
+// text need not be NUL-terminated: each line is copied to a small buffer
+// before strtod, so mapped files can be parsed in place.
+inline void parse_iat_text(const char* p, size_t length, std::vector<double>& iats)
+{
+    const char* end = p + length;
+    char line[64];
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        size_t n = std::min((size_t)(eol - p), sizeof(line) - 1);
+        if (n > 0 && *p != '#') {
+            memcpy(line, p, n);
+            line[n] = '\0';
+            char* parsed;
+            double value = strtod(line, &parsed);
+            if (parsed != line && value == value) {
+                iats.push_back(value);
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+inline void parse_iat_text(const std::string& text, std::vector<double>& iats)
+{
+    parse_iat_text(text.data(), text.size(), iats);
+}
+
+// Parses a mapped or in-memory CSV, handling UTF-16LE and UTF-8 BOMs.
+inline void parse_iat_bytes(const char* bytes, size_t length, std::vector<double>& iats)
+{
+    if (length >= 2 && (unsigned char)bytes[0] == 0xFF && (unsigned char)bytes[1] == 0xFE) {
+        // UTF-16LE export: every value is ASCII, so keep the low byte of each unit
+        std::string narrow;
+        narrow.reserve(length / 2);
+        for (size_t i = 2; i + 1 < length; i += 2) {
+            narrow += bytes[i + 1] == 0 ? bytes[i] : '?';
+        }
+        iats.reserve(narrow.size() / 8);
+        parse_iat_text(narrow, iats);
+        return;
+    }
+    if (length >= 3 && memcmp(bytes, "\xEF\xBB\xBF", 3) == 0) {
+        bytes += 3;
+        length -= 3;
+    }
+    iats.reserve(length / 8);
+    parse_iat_text(bytes, length, iats);
+}
+
+// Loads IATs from a CSV or binary log. Binary logs are converted to
+// millisecond IATs exactly as `receiver -bin2csv` would write them.
+inline bool load_iats(const std::string& path, std::vector<double>& iats, std::string& error)
+{
+    iats.clear();
+    if (path != "-" && is_binlog(path)) {
+        BinLogHeader header;
+        std::vector<BinLogRecord> records;
+        if (!read_binlog(path, header, records, error)) return false;
+        iats.reserve(records.size());
+        for (size_t i = 0; i < records.size(); ++i) {
+            iats.push_back(i == 0 ? 0.0 : (records[i].arrival_ns - records[i - 1].arrival_ns) / 1e6);
+        }
+        return true;
+    }
+
+    if (path == "-") {
+        std::string bytes;
+        if (!read_file_bytes(path, bytes, error)) return false;
+        parse_iat_bytes(bytes.data(), bytes.size(), iats);
+        return true;
+    }
+
+    MappedFile file;
+    if (!file.map(path, error)) return false;
+    if (file.size() > 0) parse_iat_bytes(file.data(), file.size(), iats);
+    return true;
+}
+
+// File name without directory, lower-cased, with a trailing ".csv" removed:
+// the naming eppsim.py uses for its scores_original_<name>.csv output.
+inline std::string dataset_stem(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (name[i] >= 'A' && name[i] <= 'Z') name[i] = (char)(name[i] - 'A' + 'a');
+    }
+    size_t ext = name.rfind(".csv");
+    if (ext != std::string::npos && ext + 4 == name.size()) name.erase(ext);
+    return name;
+}
+
+// Shortest round-trip text for a double, as Python's repr() / pandas to_csv
+// writes it. NaN becomes an empty field.
+inline std::string format_double(double value)
+{
+    if (value != value) return "";
+    if (value == 0) return std::signbit(value) ? "-0.0" : "0.0";
+    if (std::isinf(value)) return value > 0 ? "inf" : "-inf";
+    char buf[48];
+    int precision = 1;
+    for (; precision < 17; ++precision) {
+        snprintf(buf, sizeof(buf), "%.*e", precision - 1, value);
+        if (strtod(buf, NULL) == value) break;
+    }
+    snprintf(buf, sizeof(buf), "%.*e", precision - 1, value);
+    int exponent = atoi(strchr(buf, 'e') + 1);
+    if (exponent >= -4 && exponent < 16) {
+        // Positional notation, as repr() uses in this range
+        int decimals = precision - 1 - exponent;
+        snprintf(buf, sizeof(buf), "%.*f", decimals > 0 ? decimals : 0, value);
+        if (!strchr(buf, '.')) strcat(buf, ".0");
+    } else {
+        // repr() drops a bare ".0" mantissa: 1e-05, not 1.e-05
+        snprintf(buf, sizeof(buf), "%.*g", precision, value);
+    }
+    return buf;
+}
+
+#endif
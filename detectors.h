@@ -0,0 +1,535 @@
+// Covert timing channel detectors shared by the analysis tools.
+//
+// Scores follow the Python reference scripts: epsilon-similarity matches
+// eppsim.py's fun_eps/improved_eps, compressibility matches compress.py's
+// iat2str + gzip.compress (Cabuk et al.). Link with -lz.
+#ifndef DETECTORS_H
+#define DETECTORS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+const double DEFAULT_EPSILONS[] = { 0.005, 0.008, 0.01, 0.02, 0.03, 0.1 };
+const size_t DEFAULT_EPSILON_COUNT = sizeof(DEFAULT_EPSILONS) / sizeof(DEFAULT_EPSILONS[0]);
+
+// Counts how many relative adjacent differences of a sorted sample fall under
+// each epsilon. Ratios are |s[i+1] - s[i]| / s[i]; 0/0 pairs are NaN and, as
+// with pandas' count(), are excluded from the denominator, while x/0 pairs are
+// infinite and count as dissimilar. Writes NaN scores when no pair is valid.
+inline void score_sorted_epsilon(const double* sorted, size_t n, const double* eps, size_t eps_count,
+                                 std::vector<double>& ratios, double* out)
+{
+    size_t pairs = n > 1 ? n - 1 : 0;
+    ratios.resize(pairs);
+    for (size_t i = 0; i < pairs; ++i) {
+        ratios[i] = std::fabs(sorted[i + 1] - sorted[i]) / sorted[i];
+    }
+
+    // Branch-free counting loops so the compiler can vectorise them
+    size_t valid = 0;
+    const double* r = pairs ? &ratios[0] : NULL;
+    for (size_t i = 0; i < pairs; ++i) {
+        valid += (r[i] == r[i]);
+    }
+    for (size_t k = 0; k < eps_count; ++k) {
+        const double e = eps[k];
+        size_t under = 0;
+        for (size_t i = 0; i < pairs; ++i) {
+            under += (r[i] < e);
+        }
+        out[k] = valid ? (double)under / (double)valid : std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+// Scores one window of IATs at every epsilon in a single sort. `improved`
+// keeps only the top third of the sorted window (eppsim.py improved_eps).
+// `sorted` and `ratios` are caller-owned scratch reused across windows.
+inline void epsilon_similarity(const double* window, size_t n, const double* eps, size_t eps_count,
+                               bool improved, std::vector<double>& sorted, std::vector<double>& ratios,
+                               double* out)
+{
+    sorted.assign(window, window + n);
+    std::sort(sorted.begin(), sorted.end());
+    size_t start = improved ? (size_t)std::floor(n * (2.0 / 3.0)) : 0;
+    score_sorted_epsilon(n ? &sorted[0] + start : NULL, n - start, eps, eps_count, ratios, out);
+}
+
+// compress.py's iat2str: round to two significant digits, then write the
+// fractional digits with leading zeros replaced by one letter ('A' + n - 1)
+// and trailing zeros dropped. 0.0012 -> "B12", 0.25 -> "25", 0 -> "0".
+// The slow path reproduces Python's formatting exactly; the table-driven fast
+// path covers the IAT range seen in practice (1e-12 s to 1 s) and defers to it
+// whenever the rounding is too close to a tie to decide in floating point.
+inline void iat_symbol_exact(double iat, std::string& out)
+{
+    if (iat == 0) { out += '0'; return; }
+    if (iat != iat || std::isinf(iat)) return; // Python raises; compress.py never sees these
+    int digits = 2 - (int)std::floor(std::log10(std::fabs(iat))) - 1;
+    char buf[400];
+    if (digits >= 0) {
+        snprintf(buf, sizeof(buf), "%.*f", digits, iat);
+    } else {
+        // round(x, -k): correctly rounded to a multiple of 10^k
+        snprintf(buf, sizeof(buf), "%.1e", iat);
+    }
+    double rounded = strtod(buf, NULL);
+    snprintf(buf, sizeof(buf), "%.16f", rounded);
+    const char* frac = strchr(buf, '.') + 1;
+    size_t len = strlen(frac);
+    size_t lead = 0;
+    while (lead < len && frac[lead] == '0') lead++;
+    size_t last = len;
+    while (last > lead && frac[last - 1] == '0') last--;
+    if (lead > 0) out += (char)(64 + lead);
+    out.append(frac + lead, last - lead);
+}
+
+class IatSymbolTable {
+public:
+    IatSymbolTable() {
+        // '{:.16f}' exposes binary noise for some roundings (0.56 -> "5600000000000001"),
+        // so each entry comes from the exact path rather than from the digits
+        char buf[32];
+        for (int lead = 0; lead < LEADS; ++lead) {
+            for (int m = 10; m <= 99; ++m) {
+                snprintf(buf, sizeof(buf), "%de-%d", m, lead + 2);
+                iat_symbol_exact(strtod(buf, NULL), symbols[lead][m]);
+            }
+        }
+        double p = 1.0;
+        for (int k = 0; k < LEADS + 2; ++k) { pow10[k] = p; p *= 10.0; }
+    }
+
+    void append(double iat, std::string& out) const {
+        if (iat > 0 && iat < 1.0) {
+            int e = (int)std::floor(std::log10(iat));
+            if (e >= -LEADS) {
+                double q = iat * pow10[1 - e]; // two significant digits: [10, 100)
+                double fl = std::floor(q);
+                double frac = q - fl;
+                if (std::fabs(frac - 0.5) > 1e-6) {
+                    int m = (int)fl + (frac > 0.5 ? 1 : 0);
+                    if (m == 100) { m = 10; e++; }
+                    if (m >= 10 && m <= 99 && e <= -1) {
+                        out += symbols[-e - 1][m];
+                        return;
+                    }
+                }
+            }
+        }
+        iat_symbol_exact(iat, out);
+    }
+
+private:
+    static const int LEADS = 12; // IATs from 1e-12 up to 1
+    std::string symbols[LEADS][100];
+    double pow10[LEADS + 2];
+};
+
+// Cabuk et al. compressibility: original size / gzip size of a window's
+// symbol string. One deflate context is kept and reset between windows
+// instead of being rebuilt for every gzip.compress call.
+class CompressibilityScorer {
+public:
+    CompressibilityScorer() : ready(false) {
+        memset(&stream, 0, sizeof(stream));
+        // Level 9 and a gzip wrapper (windowBits 31), as gzip.compress uses
+        ready = deflateInit2(&stream, 9, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    ~CompressibilityScorer() {
+        if (ready) deflateEnd(&stream);
+    }
+
+    // Ratio for an already-encoded window; NaN for an empty one.
+    double score_symbols(const std::string& symbols) {
+        if (symbols.empty() || !ready) return std::numeric_limits<double>::quiet_NaN();
+        output.resize(deflateBound(&stream, symbols.size()) + 32);
+        deflateReset(&stream);
+        stream.next_in = (Bytef*)symbols.data();
+        stream.avail_in = (uInt)symbols.size();
+        stream.next_out = (Bytef*)&output[0];
+        stream.avail_out = (uInt)output.size();
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END) return std::numeric_limits<double>::quiet_NaN();
+        size_t compressed = output.size() - stream.avail_out;
+        return compressed ? (double)symbols.size() / (double)compressed : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    double score(const double* window, size_t n) {
+        symbols.clear();
+        for (size_t i = 0; i < n; ++i) table.append(window[i], symbols);
+        return score_symbols(symbols);
+    }
+
+private:
+    z_stream stream;
+    bool ready;
+    IatSymbolTable table;
+    std::string symbols;
+    std::vector<char> output;
+};
+
+// Streaming compressibility over a sliding window. IATs (seconds) are
+// pushed one at a time; IATs above max_iat are dropped as in compress.py.
+// Every `stride` accepted samples, once `window` samples have been seen, a
+// score over the most recent `window` samples is produced.
+class SlidingCompressibility {
+public:
+    SlidingCompressibility(size_t window, size_t stride, double max_iat = 1.0)
+        : window(window), stride(stride), max_iat(max_iat), ring(window), count(0), since_score(0) {}
+
+    // Returns true when a window closed; its score is written to `out`.
+    bool push(double iat, double& out) {
+        if (!(iat <= max_iat)) return false;
+        ring[count % window] = iat;
+        count++;
+        since_score++;
+        if (count < window || since_score < stride) return false;
+        since_score = 0;
+        ordered.resize(window);
+        size_t start = count % window; // oldest sample
+        for (size_t i = 0; i < window; ++i) ordered[i] = ring[(start + i) % window];
+        out = scorer.score(&ordered[0], window);
+        return true;
+    }
+
+    // Scores whatever remains after the last full window, like the partial
+    // last group in compress.py. Returns false when nothing is pending.
+    bool flush_partial(double& out) {
+        if (count == 0 || (count >= window && since_score == 0)) return false;
+        size_t n = count < window ? count : since_score;
+        if (count >= window && stride != window) return false; // overlapping windows have no partial tail
+        ordered.resize(n);
+        size_t start = (count - n) % window;
+        for (size_t i = 0; i < n; ++i) ordered[i] = ring[(start + i) % window];
+        out = scorer.score(&ordered[0], n);
+        return true;
+    }
+
+private:
+    size_t window;
+    size_t stride;
+    double max_iat;
+    std::vector<double> ring;
+    std::vector<double> ordered;
+    size_t count;
+    size_t since_score;
+    CompressibilityScorer scorer;
+};
+
+// Epsilon-similarity of a sliding window, maintained per sample. The window
+// is kept in an ordered multiset; inserting or evicting a value only changes
+// the sorted-adjacent pairs around it, so each update is O(log w + eps) and a
+// score is available at any time without re-sorting.
+class SlidingEpsilonSimilarity {
+public:
+    SlidingEpsilonSimilarity(const double* eps, size_t eps_count)
+        : eps(eps, eps + eps_count), under(eps_count, 0), valid(0) {}
+
+    void insert(double x) {
+        std::multiset<double>::iterator it = values.insert(x);
+        bool has_pred = it != values.begin();
+        std::multiset<double>::iterator succ = it;
+        ++succ;
+        bool has_succ = succ != values.end();
+        double pred_value = has_pred ? *std::prev(it) : 0.0;
+        if (has_pred && has_succ) pair(pred_value, *succ, -1);
+        if (has_pred) pair(pred_value, x, +1);
+        if (has_succ) pair(x, *succ, +1);
+    }
+
+    void erase(double x) {
+        std::multiset<double>::iterator it = values.find(x);
+        if (it == values.end()) return;
+        bool has_pred = it != values.begin();
+        std::multiset<double>::iterator succ = it;
+        ++succ;
+        bool has_succ = succ != values.end();
+        double pred_value = has_pred ? *std::prev(it) : 0.0;
+        if (has_pred) pair(pred_value, x, -1);
+        if (has_succ) pair(x, *succ, -1);
+        if (has_pred && has_succ) pair(pred_value, *succ, +1);
+        values.erase(it);
+    }
+
+    void scores(double* out) const {
+        for (size_t k = 0; k < eps.size(); ++k) {
+            out[k] = valid ? (double)under[k] / (double)valid : std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+
+    const std::multiset<double>& sorted() const { return values; }
+
+private:
+    // Adds or removes the contribution of one sorted-adjacent pair (lo <= hi)
+    void pair(double lo, double hi, long sign) {
+        double r = std::fabs(hi - lo) / lo;
+        if (r != r) return; // 0/0, excluded like pandas' count()
+        valid += sign;
+        for (size_t k = 0; k < eps.size(); ++k) {
+            if (r < eps[k]) under[k] += sign;
+        }
+    }
+
+    std::multiset<double> values;
+    std::vector<double> eps;
+    std::vector<long> under;
+    long valid;
+};
+
+// Kolmogorov-Smirnov distance between a sliding window and a fixed baseline.
+// The baseline is reduced to BINS quantile edges; the window is tracked as a
+// count per bin, so updates are O(log BINS) and the distance is computed over
+// the edges when asked for. The error from binning is at most 1/BINS.
+class SlidingKsDistance {
+public:
+    static const size_t BINS = 256;
+
+    SlidingKsDistance() : total(0) {}
+
+    bool has_baseline() const { return !edges.empty(); }
+
+    void set_baseline(std::vector<double> baseline) {
+        edges.clear();
+        baseline_cdf.clear();
+        if (baseline.empty()) return;
+        std::sort(baseline.begin(), baseline.end());
+        const size_t n = baseline.size();
+        for (size_t i = 1; i <= BINS; ++i) {
+            double edge = baseline[(i * n + BINS - 1) / BINS - 1];
+            if (edges.empty() || edge > edges.back()) {
+                edges.push_back(edge);
+                // Fraction of the baseline at or below this edge
+                size_t at_or_below = std::upper_bound(baseline.begin(), baseline.end(), edge) - baseline.begin();
+                baseline_cdf.push_back((double)at_or_below / n);
+            }
+        }
+        counts.assign(edges.size() + 1, 0);
+    }
+
+    void insert(double x) { if (has_baseline()) { counts[bin(x)]++; total++; } }
+    void erase(double x) { if (has_baseline()) { counts[bin(x)]--; total--; } }
+
+    double distance() const {
+        if (!has_baseline() || total == 0) return std::numeric_limits<double>::quiet_NaN();
+        double worst = 0.0;
+        long below = 0;
+        for (size_t i = 0; i < edges.size(); ++i) {
+            below += counts[i];
+            worst = std::max(worst, std::fabs((double)below / total - baseline_cdf[i]));
+        }
+        return worst;
+    }
+
+private:
+    size_t bin(double x) const { return std::lower_bound(edges.begin(), edges.end(), x) - edges.begin(); }
+
+    std::vector<double> edges;
+    std::vector<double> baseline_cdf;
+    std::vector<long> counts;
+    long total;
+};
+
+// One score of the online detector.
+struct DetectorScores {
+    std::vector<double> epsilon;  // per DEFAULT_EPSILONS
+    double compressibility;
+    double mean;
+    double stddev;
+    double ks;                    // NaN without a baseline
+};
+
+// Running compressibility of a sliding window of IATs (seconds). Each IAT's
+// compress.py symbol goes into one raw deflate stream as it arrives; the
+// stream is flushed every BLOCK samples (fewer for a smaller window), which
+// fixes each block's compressed size. The score is symbol bytes over
+// compressed bytes across the blocks of the latest window, rounded to whole
+// blocks, so it costs O(1) per sample instead of a deflate of the whole
+// window each time. The history is sized to about one window of symbols, so
+// matches reach back roughly as far as gzip.compress of the window would;
+// with one deflate block, and its Huffman tables, per BLOCK, scores stay
+// within about 10% of compress.py's on the data/ traces. IATs above max_iat
+// count towards the window but add no symbols.
+class RunningCompressibility {
+public:
+    static const size_t BLOCK = 256;
+
+    explicit RunningCompressibility(size_t window, double max_iat = 1.0)
+        : block(std::max<size_t>(std::min(window, BLOCK), 1)), max_iat(max_iat), ready(false), samples(0),
+          block_raw(0), block_packed(0), next(0), raw_total(0), packed_total(0) {
+        size_t blocks = std::max<size_t>((window + block / 2) / block, 1);
+        raw.assign(blocks, 0);
+        packed.assign(blocks, 0);
+        memset(&stream, 0, sizeof(stream));
+        // Symbols average under three bytes
+        int bits = 9;
+        while (bits < 15 && ((size_t)1 << bits) < window * 3) bits++;
+        ready = deflateInit2(&stream, 9, Z_DEFLATED, -bits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    ~RunningCompressibility() {
+        if (ready) deflateEnd(&stream);
+    }
+
+    void push(double iat) {
+        if (!ready) return;
+        if (iat <= max_iat) {
+            symbols.clear();
+            table.append(iat, symbols);
+            block_raw += symbols.size();
+            block_packed += deflate_some(symbols.data(), symbols.size(), Z_NO_FLUSH);
+        }
+        if (++samples < block) return;
+        block_packed += deflate_some(NULL, 0, Z_PARTIAL_FLUSH);
+        raw_total += block_raw - raw[next];
+        packed_total += block_packed - packed[next];
+        raw[next] = block_raw;
+        packed[next] = block_packed;
+        next = (next + 1) % raw.size();
+        samples = 0;
+        block_raw = 0;
+        block_packed = 0;
+    }
+
+    // NaN until a block holds symbols
+    double score() const {
+        if (raw_total == 0 || packed_total == 0) return std::numeric_limits<double>::quiet_NaN();
+        return (double)raw_total / (double)packed_total;
+    }
+
+private:
+    // Feeds `length` bytes and returns how many compressed bytes came out
+    size_t deflate_some(const char* data, size_t length, int flush) {
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = (uInt)length;
+        size_t produced = 0;
+        do {
+            stream.next_out = output;
+            stream.avail_out = sizeof(output);
+            deflate(&stream, flush);
+            produced += sizeof(output) - stream.avail_out;
+        } while (stream.avail_out == 0);
+        return produced;
+    }
+
+    size_t block;
+    double max_iat;
+    z_stream stream;
+    bool ready;
+    IatSymbolTable table;
+    std::string symbols;
+    unsigned char output[4096];
+    size_t samples; // in the block being filled
+    size_t block_raw;
+    size_t block_packed;
+    std::vector<size_t> raw;    // symbol bytes per block of the window, a ring
+    std::vector<size_t> packed; // compressed bytes per block
+    size_t next;
+    size_t raw_total;
+    size_t packed_total;
+};
+
+// Mean and variance of a sliding window: Welford's update as a sample
+// enters and the matching downdate as one leaves, so a long capture does not
+// lose precision to the cancellation in a running sum of squares
+class SlidingMoments {
+public:
+    SlidingMoments() : n(0), mu(0.0), m2(0.0) {}
+
+    void add(double x) {
+        n++;
+        double d = x - mu;
+        mu += d / n;
+        m2 += d * (x - mu);
+    }
+
+    void remove(double x) {
+        if (n <= 1) {
+            n = 0;
+            mu = 0.0;
+            m2 = 0.0;
+            return;
+        }
+        double d = x - mu;
+        mu -= d / (n - 1);
+        m2 = std::max(0.0, m2 - d * (x - mu));
+        n--;
+    }
+
+    double mean() const { return mu; }
+    // Over the window itself, not an estimate for a larger population
+    double stddev() const { return n ? std::sqrt(m2 / n) : 0.0; }
+
+private:
+    size_t n;
+    double mu;
+    double m2;
+};
+
+// Rolling detector statistics over the last `window` IATs for live traffic:
+// epsilon-similarity, compressibility, mean/variance and KS distance to a
+// baseline. Every statistic is updated as each sample enters and leaves, in
+// O(log window), and scores are read out every `stride` samples once the
+// window is full, so a stride of 1 scores every packet. Memory is O(window).
+class OnlineDetector {
+public:
+    OnlineDetector(size_t window, size_t stride, double to_seconds)
+        : window(window), stride(std::max<size_t>(stride, 1)), to_seconds(to_seconds), ring(window), count(0),
+          since_score(0), epsilon(DEFAULT_EPSILONS, DEFAULT_EPSILON_COUNT), compress(window) {}
+
+    void set_baseline(const std::vector<double>& baseline) { ks.set_baseline(baseline); }
+
+    // Returns true when a score is due and `out` holds it.
+    bool push(double iat, DetectorScores& out) {
+        if (count >= window) {
+            double old = ring[count % window];
+            epsilon.erase(old);
+            ks.erase(old);
+            moments.remove(old);
+        }
+        ring[count % window] = iat;
+        epsilon.insert(iat);
+        ks.insert(iat);
+        moments.add(iat);
+        // compress.py's 1 s cut-off
+        compress.push(iat * to_seconds);
+        count++;
+        since_score++;
+
+        if (count < window || since_score < stride) return false;
+        since_score = 0;
+
+        out.epsilon.resize(DEFAULT_EPSILON_COUNT);
+        epsilon.scores(&out.epsilon[0]);
+        out.compressibility = compress.score();
+        out.mean = moments.mean();
+        out.stddev = moments.stddev();
+        out.ks = ks.distance();
+        return true;
+    }
+
+private:
+    size_t window;
+    size_t stride;
+    double to_seconds;
+    std::vector<double> ring;
+    size_t count;
+    size_t since_score;
+    SlidingEpsilonSimilarity epsilon;
+    SlidingKsDistance ks;
+    SlidingMoments moments;
+    RunningCompressibility compress;
+};
+
+#endif
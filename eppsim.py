@@ -33,7 +33,7 @@ def improved_eps(x):
     return res
 
 csv_filename = "data/past_data/timings_7_fuzzed.csv"
-input = pd.read_csv(csv_filename)
+input = pd.read_csv(csv_filename, comment='#')
 iat = pd.to_numeric(input["Time"], errors='coerce').dropna() 
 
 print(f"Time range: {iat.min():.6f} to {iat.max():.6f} s")
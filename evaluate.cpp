@@ -0,0 +1,340 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "corpus.h"
+
+// ROC/AUC evaluation over the data/ corpus. Every dataset is mapped and
+// parsed once; windows of every requested size are scored by every detector
+// on a thread pool, then each (legit, covert, window size, detector) pair gets
+// an ROC curve and AUC, with covert windows as the positive class. With
+// -cache, datasets come from corpus columns and the score tables from the
+// score cache; only the tables missing from it are scored, then stored.
+
+struct Dataset
+{
+    std::string path;
+    std::vector<double> parsed; // without -cache
+    Column column;              // with -cache, mapped once a table needs scoring
+    const double* iats;         // seconds
+    size_t count;
+    uint64_t hash;
+};
+
+// Scores of one dataset at one window size, indexed [detector][window]
+struct ScoreTable
+{
+    size_t dataset;
+    size_t window_size;
+    std::vector<std::vector<double> > scores;
+    bool cached;
+};
+
+// A contiguous run of windows from one table, the unit of work for the pool
+struct Shard
+{
+    size_t table;
+    size_t first_window;
+    size_t window_count;
+};
+
+// Scores every window in a shard; shards run independently.
+void score_shard(const Shard& shard, const std::vector<Dataset>& datasets, std::vector<ScoreTable>& tables)
+{
+    ScoreTable& table = tables[shard.table];
+    score_windows(datasets[table.dataset].iats, table.window_size, shard.first_window, shard.window_count, table.scores);
+}
+
+struct RocPoint
+{
+    double threshold;
+    double fpr;
+    double tpr;
+};
+
+// ROC curve (one point per distinct threshold, highest first, starting at
+// (0,0)) and AUC with ties counted as half, as sklearn's roc_auc_score does.
+// NaN scores are ignored. Returns NaN when either class is empty.
+double roc_auc(const std::vector<double>& negatives, const std::vector<double>& positives, std::vector<RocPoint>& curve)
+{
+    std::vector<std::pair<double, int> > labelled;
+    for (size_t i = 0; i < negatives.size(); ++i)
+        if (negatives[i] == negatives[i])
+            labelled.push_back(std::make_pair(negatives[i], 0));
+    for (size_t i = 0; i < positives.size(); ++i)
+        if (positives[i] == positives[i])
+            labelled.push_back(std::make_pair(positives[i], 1));
+
+    size_t n_pos = 0;
+    for (size_t i = 0; i < labelled.size(); ++i)
+        n_pos += labelled[i].second;
+    size_t n_neg = labelled.size() - n_pos;
+
+    curve.clear();
+    if (n_pos == 0 || n_neg == 0)
+        return std::numeric_limits<double>::quiet_NaN();
+
+    std::sort(labelled.begin(), labelled.end(),
+              [](const std::pair<double, int>& a, const std::pair<double, int>& b) { return a.first > b.first; });
+
+    RocPoint origin = { std::numeric_limits<double>::infinity(), 0.0, 0.0 };
+    curve.push_back(origin);
+    double area = 0.0;
+    size_t tp = 0, fp = 0;
+    size_t i = 0;
+    while (i < labelled.size())
+    {
+        size_t tie_tp = 0, tie_fp = 0;
+        double threshold = labelled[i].first;
+        while (i < labelled.size() && labelled[i].first == threshold)
+        {
+            if (labelled[i].second)
+                tie_tp++;
+            else
+                tie_fp++;
+            i++;
+        }
+        // Trapezoid across the tied block
+        area += tie_fp * (tp + tie_tp / 2.0);
+        tp += tie_tp;
+        fp += tie_fp;
+        RocPoint point = { threshold, (double)fp / n_neg, (double)tp / n_pos };
+        curve.push_back(point);
+    }
+    return area / ((double)n_pos * n_neg);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* program = argv[0];
+    std::string cache_dir;
+    while (argc >= 3 && std::string(argv[1]) == "-cache")
+    {
+        cache_dir = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (argc < 4 || argc > 6)
+    {
+        std::cout << "Evaluation Usage:" << std::endl;
+        std::cout << "  " << program << " [-cache DIR] <LEGIT_FILES> <COVERT_FILES> <WINDOW_SIZES> [THREADS] [OUTPUT_PREFIX]" << std::endl;
+        std::cout << "Lists are comma-separated; IATs are expected in seconds." << std::endl;
+        std::cout << "-cache reuses corpus columns and cached scores from DIR (see corpus)." << std::endl;
+        std::cout << "Example:" << std::endl;
+        std::cout << "  " << program << " data/legit_traffic_seconds.csv,data/http.csv "
+                  << "data/vpn_fuzzy_sing.csv,data/no_vpn_fuzzy.csv 510,1000,2000" << std::endl;
+        std::cout << "  " << program << " -cache corpus_cache data/legit_traffic_seconds.csv data/vpn.csv 2000" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> legit_files = split_list(argv[1]);
+    std::vector<std::string> covert_files = split_list(argv[2]);
+    size_t threads = parse_thread_count(argc >= 5 ? argv[4] : NULL);
+    std::string prefix = argc >= 6 ? argv[5] : "roc";
+
+    std::vector<size_t> window_sizes;
+    if (!parse_window_sizes(argv[3], window_sizes))
+    {
+        std::cout << "Error: Window sizes must be at least 2" << std::endl;
+        return 1;
+    }
+    if (legit_files.empty() || covert_files.empty() || window_sizes.empty())
+    {
+        std::cout << "Error: Need at least one legit file, covert file and window size" << std::endl;
+        return 1;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+
+    ScoreCache cache(cache_dir);
+    std::string error;
+    if (!cache_dir.empty() && !cache.open(error))
+    {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+
+    // Load each distinct file once, even if it appears in both lists. The
+    // vector never grows past its reservation, so mapped columns stay put.
+    std::vector<Dataset> datasets;
+    std::map<std::string, size_t> dataset_index;
+    std::vector<std::string> all_files(legit_files);
+    all_files.insert(all_files.end(), covert_files.begin(), covert_files.end());
+    datasets.reserve(all_files.size());
+    for (size_t i = 0; i < all_files.size(); ++i)
+    {
+        if (dataset_index.count(all_files[i]))
+            continue;
+        dataset_index[all_files[i]] = datasets.size();
+        datasets.push_back(Dataset());
+        Dataset& dataset = datasets.back();
+        dataset.path = all_files[i];
+        dataset.iats = NULL;
+        dataset.hash = 0;
+        if (cache_dir.empty())
+        {
+            if (!load_iats(dataset.path, dataset.parsed, error))
+            {
+                std::cout << "Error: " << error << std::endl;
+                return 1;
+            }
+            dataset.iats = dataset.parsed.empty() ? NULL : &dataset.parsed[0];
+            dataset.count = dataset.parsed.size();
+            std::cout << "Loaded " << dataset.path << ": " << dataset.count << " IATs" << std::endl;
+            continue;
+        }
+        CorpusDataset info;
+        bool rebuilt;
+        if (!cache.dataset(dataset.path, info, rebuilt, error))
+        {
+            std::cout << "Error: " << error << std::endl;
+            return 1;
+        }
+        dataset.count = (size_t)info.samples;
+        dataset.hash = info.hash;
+        std::cout << "Loaded " << dataset.path << ": " << dataset.count << " IATs ("
+                  << (rebuilt ? "indexed" : "column") << ")" << std::endl;
+    }
+
+    // One score table per (dataset, window size); only full windows are scored
+    std::vector<ScoreTable> tables;
+    std::map<std::pair<size_t, size_t>, size_t> table_index;
+    std::vector<Shard> shards;
+    size_t cached_tables = 0;
+    for (size_t d = 0; d < datasets.size(); ++d)
+    {
+        for (size_t s = 0; s < window_sizes.size(); ++s)
+        {
+            ScoreTable table;
+            table.dataset = d;
+            table.window_size = window_sizes[s];
+            size_t windows = datasets[d].count / window_sizes[s];
+            table.scores.assign(DETECTOR_COUNT, std::vector<double>(windows));
+            table.cached = !cache_dir.empty();
+            for (size_t f = 0; f < DETECTOR_FAMILY_COUNT && table.cached; ++f)
+                table.cached = cache.load(datasets[d].hash, window_sizes[s], f, windows, table.scores);
+            table_index[std::make_pair(d, window_sizes[s])] = tables.size();
+            if (table.cached)
+            {
+                cached_tables++;
+                tables.push_back(table);
+                continue;
+            }
+            if (!datasets[d].iats && !cache_dir.empty())
+            {
+                if (!datasets[d].column.map(cache.dataset_list().at(datasets[d].path).column, error))
+                {
+                    std::cout << "Error: " << error << std::endl;
+                    return 1;
+                }
+                datasets[d].iats = datasets[d].column.values();
+            }
+            for (size_t first = 0; first < windows; first += SHARD_WINDOWS)
+            {
+                Shard shard = { tables.size(), first, std::min(SHARD_WINDOWS, windows - first) };
+                shards.push_back(shard);
+            }
+            tables.push_back(table);
+        }
+    }
+
+    run_pool(shards.size(), threads, [&](size_t i) { score_shard(shards[i], datasets, tables); });
+
+    if (!cache_dir.empty())
+    {
+        for (size_t t = 0; t < tables.size(); ++t)
+        {
+            if (tables[t].cached)
+                continue;
+            size_t windows = tables[t].scores[0].size();
+            for (size_t f = 0; f < DETECTOR_FAMILY_COUNT; ++f)
+            {
+                if (!cache.store(datasets[tables[t].dataset].hash, tables[t].window_size, f, windows, tables[t].scores, error))
+                {
+                    std::cout << "Warning: " << error << std::endl;
+                    break;
+                }
+            }
+        }
+        if (!cache.save(error))
+            std::cout << "Warning: " << error << std::endl;
+    }
+
+    auto scored_time = std::chrono::steady_clock::now();
+
+    std::string auc_name = prefix + "_auc.csv";
+    std::string points_name = prefix + "_points.csv";
+    std::ofstream auc_out(auc_name.c_str());
+    std::ofstream points_out(points_name.c_str());
+    if (!auc_out.is_open() || !points_out.is_open())
+    {
+        std::cout << "Error: Cannot open output files " << auc_name << ", " << points_name << std::endl;
+        return 1;
+    }
+    auc_out << "Legit,Covert,WindowSize,Detector,LegitWindows,CovertWindows,AUC\n";
+    points_out << "Legit,Covert,WindowSize,Detector,Threshold,FPR,TPR\n";
+
+    std::cout << "\n" << std::left << std::setw(32) << "Legit" << std::setw(32) << "Covert" << std::setw(8) << "Window"
+              << std::setw(22) << "Best detector" << "AUC" << std::endl;
+
+    std::vector<RocPoint> curve;
+    for (size_t l = 0; l < legit_files.size(); ++l)
+    {
+        for (size_t c = 0; c < covert_files.size(); ++c)
+        {
+            for (size_t s = 0; s < window_sizes.size(); ++s)
+            {
+                const ScoreTable& legit = tables[table_index[std::make_pair(dataset_index[legit_files[l]], window_sizes[s])]];
+                const ScoreTable& covert = tables[table_index[std::make_pair(dataset_index[covert_files[c]], window_sizes[s])]];
+                double best_separation = -1.0;
+                double best_auc = 0.0;
+                size_t best_detector = 0;
+                for (size_t d = 0; d < DETECTOR_COUNT; ++d)
+                {
+                    double auc = roc_auc(legit.scores[d], covert.scores[d], curve);
+                    auc_out << legit_files[l] << ',' << covert_files[c] << ',' << window_sizes[s] << ','
+                            << detector_name(d) << ',' << legit.scores[d].size() << ',' << covert.scores[d].size() << ','
+                            << format_double(auc) << '\n';
+                    for (size_t p = 0; p < curve.size(); ++p)
+                    {
+                        points_out << legit_files[l] << ',' << covert_files[c] << ',' << window_sizes[s] << ','
+                                   << detector_name(d) << ',' << format_double(curve[p].threshold) << ','
+                                   << format_double(curve[p].fpr) << ',' << format_double(curve[p].tpr) << '\n';
+                    }
+                    // A detector that ranks the classes backwards separates them as
+                    // well; it is picked on that, and its raw AUC shown as inverted
+                    double separation = std::max(auc, 1.0 - auc);
+                    if (auc == auc && separation > best_separation)
+                    {
+                        best_separation = separation;
+                        best_auc = auc;
+                        best_detector = d;
+                    }
+                }
+                std::cout << std::left << std::setw(32) << dataset_stem(legit_files[l]) << std::setw(32)
+                          << dataset_stem(covert_files[c]) << std::setw(8) << window_sizes[s] << std::setw(22)
+                          << (best_separation < 0 ? "-" : detector_name(best_detector)) << std::fixed << std::setprecision(4)
+                          << best_auc << (best_separation >= 0 && best_auc < 0.5 ? " (inverted)" : "") << std::endl;
+                std::cout.unsetf(std::ios::fixed);
+            }
+        }
+    }
+
+    auto end_time = std::chrono::steady_clock::now();
+    if (!cache_dir.empty())
+        std::cout << "\n" << cached_tables << " of " << tables.size() << " score tables from " << cache_dir;
+    std::cout << "\nScored " << shards.size() << " shards on " << threads << " threads in " << std::fixed
+              << std::setprecision(2) << std::chrono::duration<double>(scored_time - start_time).count() << "s (total "
+              << std::chrono::duration<double>(end_time - start_time).count() << "s)" << std::endl;
+    std::cout << "Results written to " << auc_name << " and " << points_name << std::endl;
+    return 0;
+}
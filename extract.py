@@ -1,6 +1,6 @@
 import pandas as pd
 
-df = pd.read_csv("legit.csv")
+df = pd.read_csv("legit.csv", comment='#')
 
 if "Time" in df.columns:
     ts = df["Time"].astype(float)
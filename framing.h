@@ -0,0 +1,579 @@
+// Optional framing and forward error correction for the covert bit stream.
+//
+// The message is cut into frames of SYNC(16) INDEX(16) LEN(8) PAYLOAD CRC(16).
+// LEN's top bit marks the last frame and the CRC-16/CCITT covers INDEX, LEN
+// and the payload, so a damaged frame is dropped instead of corrupting the
+// text. The framed bit stream is then coded with one of:
+//
+//   none     framing and CRC only
+//   hamming  Hamming(7,4): corrects one error, or two erasures, per 7 bits
+//   conv     rate 1/2, K = 7 convolutional code (0171, 0133) with a
+//            six-bit zero tail, decoded by hard-decision Viterbi over a
+//            sliding window
+//
+// Received bits are 0, 1 or BIT_ERASED. The receiver marks as erased every
+// bit of symbols that a sequence number gap shows were lost, and the decoders
+// ignore erased positions, so a lost packet costs distance rather than
+// shifting every later bit. Decoding is incremental: frames come out as
+// they pass their CRC, and only a window of coded bits is held.
+//
+// sender -stripe deals the frames of one message out over several flows, each
+// coded separately; the frame index says where each one goes back.
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+enum FecScheme { FEC_NONE = 0, FEC_HAMMING74 = 1, FEC_CONV = 2 };
+
+const int8_t BIT_ERASED = -1;
+
+const uint16_t FRAME_SYNC = 0xB5E3;
+const size_t FRAME_PAYLOAD_BYTES = 32;
+const size_t FRAME_HEADER_BITS = 16 + 16 + 8;
+const uint8_t FRAME_LAST_FLAG = 0x80;
+
+inline const char* fec_name(FecScheme scheme)
+{
+    switch (scheme) {
+    case FEC_HAMMING74: return "hamming";
+    case FEC_CONV: return "conv";
+    default: return "none";
+    }
+}
+
+inline bool parse_fec(const std::string& name, FecScheme& scheme)
+{
+    if (name == "none") scheme = FEC_NONE;
+    else if (name == "hamming") scheme = FEC_HAMMING74;
+    else if (name == "conv") scheme = FEC_CONV;
+    else return false;
+    return true;
+}
+
+// Code rate (information bits per coded bit), ignoring the convolutional tail
+inline double fec_rate(FecScheme scheme)
+{
+    return scheme == FEC_HAMMING74 ? 4.0 / 7.0 : scheme == FEC_CONV ? 0.5 : 1.0;
+}
+
+inline uint16_t crc16_ccitt(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF)
+{
+    for (size_t i = 0; i < length; ++i) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int b = 0; b < 8; ++b) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+inline void append_bits(std::vector<uint8_t>& bits, unsigned value, int count)
+{
+    for (int i = count - 1; i >= 0; --i) bits.push_back((value >> i) & 1);
+}
+
+inline unsigned read_bits(const std::vector<uint8_t>& bits, size_t pos, int count)
+{
+    unsigned value = 0;
+    for (int i = 0; i < count; ++i) value = (value << 1) | bits[pos + i];
+    return value;
+}
+
+// Appends frame `index` carrying `length` (at most FRAME_PAYLOAD_BYTES) bytes
+inline void append_frame(std::vector<uint8_t>& bits, unsigned index, const uint8_t* payload, size_t length, bool last)
+{
+    uint8_t body[3 + FRAME_PAYLOAD_BYTES];
+    body[0] = (uint8_t)(index >> 8);
+    body[1] = (uint8_t)index;
+    body[2] = (uint8_t)(length | (last ? FRAME_LAST_FLAG : 0));
+    std::copy(payload, payload + length, body + 3);
+    uint16_t crc = crc16_ccitt(body, 3 + length);
+
+    append_bits(bits, FRAME_SYNC, 16);
+    for (size_t i = 0; i < 3 + length; ++i) append_bits(bits, body[i], 8);
+    append_bits(bits, crc, 16);
+}
+
+// Frames `message` into a bit stream, MSB first
+inline void build_frames(const std::string& message, std::vector<uint8_t>& bits)
+{
+    bits.clear();
+    size_t frames = message.empty() ? 1 : (message.size() + FRAME_PAYLOAD_BYTES - 1) / FRAME_PAYLOAD_BYTES;
+    for (size_t f = 0; f < frames; ++f) {
+        size_t begin = f * FRAME_PAYLOAD_BYTES;
+        size_t length = std::min(FRAME_PAYLOAD_BYTES, message.size() - begin);
+        append_frame(bits, (unsigned)f, (const uint8_t*)message.data() + begin, length, f + 1 == frames);
+    }
+}
+
+// Number of bits on the wire for a `payload_bytes` message after framing and `scheme`
+inline uint64_t coded_frame_bits(uint64_t payload_bytes, FecScheme scheme)
+{
+    uint64_t frames = payload_bytes == 0 ? 1 : (payload_bytes + FRAME_PAYLOAD_BYTES - 1) / FRAME_PAYLOAD_BYTES;
+    uint64_t bits = frames * (FRAME_HEADER_BITS + 16) + payload_bytes * 8;
+    return scheme == FEC_HAMMING74 ? (bits + 3) / 4 * 7 : scheme == FEC_CONV ? 2 * (bits + 6) : bits;
+}
+
+// --- Hamming(7,4), systematic: d0 d1 d2 d3 p0 p1 p2 ---
+
+inline unsigned hamming74_codeword(unsigned nibble)
+{
+    unsigned d0 = (nibble >> 3) & 1, d1 = (nibble >> 2) & 1, d2 = (nibble >> 1) & 1, d3 = nibble & 1;
+    unsigned p0 = d0 ^ d1 ^ d3, p1 = d0 ^ d2 ^ d3, p2 = d1 ^ d2 ^ d3;
+    return (nibble << 3) | (p0 << 2) | (p1 << 1) | p2;
+}
+
+// --- Convolutional code, K = 7 ---
+
+const int CONV_K = 7;
+const unsigned CONV_G0 = 0171;
+const unsigned CONV_G1 = 0133;
+const int CONV_STATES = 1 << (CONV_K - 1);
+
+inline unsigned parity(unsigned x)
+{
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return x & 1;
+}
+
+// Incremental encoder, so a long message can be coded as it is read.
+// Hamming input must come in whole nibbles until the last call; the
+// convolutional register carries over between calls.
+class FecEncoder {
+public:
+    explicit FecEncoder(FecScheme scheme) : scheme(scheme), reg(0) {}
+
+    void encode(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+        if (scheme == FEC_NONE) {
+            out.insert(out.end(), in.begin(), in.end());
+        } else if (scheme == FEC_HAMMING74) {
+            for (size_t i = 0; i < in.size(); i += 4) {
+                unsigned nibble = 0;
+                for (size_t j = i; j < i + 4; ++j) nibble = (nibble << 1) | (j < in.size() ? in[j] : 0);
+                append_bits(out, hamming74_codeword(nibble), 7);
+            }
+        } else {
+            for (size_t i = 0; i < in.size(); ++i) push_conv(in[i], out);
+        }
+    }
+
+    // Ends the message; the convolutional zero tail returns the encoder to state 0
+    void finish(std::vector<uint8_t>& out) {
+        if (scheme == FEC_CONV) {
+            for (int i = 0; i < CONV_K - 1; ++i) push_conv(0, out);
+        }
+        reg = 0;
+    }
+
+private:
+    void push_conv(unsigned bit, std::vector<uint8_t>& out) {
+        reg = ((reg << 1) | bit) & ((1u << CONV_K) - 1);
+        out.push_back((uint8_t)parity(reg & CONV_G0));
+        out.push_back((uint8_t)parity(reg & CONV_G1));
+    }
+
+    FecScheme scheme;
+    unsigned reg;
+};
+
+inline void fec_encode(FecScheme scheme, const std::vector<uint8_t>& in, std::vector<uint8_t>& out)
+{
+    out.clear();
+    FecEncoder encoder(scheme);
+    encoder.encode(in, out);
+    encoder.finish(out);
+}
+
+// Nearest codeword over the non-erased positions of one received block
+inline unsigned hamming74_nearest(const int8_t* r)
+{
+    unsigned best_nibble = 0, best_distance = 8;
+    for (unsigned nibble = 0; nibble < 16; ++nibble) {
+        unsigned codeword = hamming74_codeword(nibble), distance = 0;
+        for (int j = 0; j < 7; ++j) distance += r[j] != BIT_ERASED && (unsigned)r[j] != ((codeword >> (6 - j)) & 1);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_nibble = nibble;
+        }
+    }
+    return best_nibble;
+}
+
+// Viterbi window: a survivor is settled this many steps (about nine
+// constraint lengths) back, and bits are released this many at a time
+const size_t CONV_TRACEBACK = 64;
+const size_t CONV_RELEASE = 64;
+
+// Incremental decoder, the counterpart of FecEncoder: received bits (0, 1 or
+// BIT_ERASED) go in one at a time and decoded bits come out once settled, so
+// memory stays constant however long the message is. Hamming decodes each
+// 7-bit block as it completes. The convolutional code runs hard-decision
+// Viterbi over a sliding window: branch metrics count disagreeing non-erased
+// bits, and once CONV_TRACEBACK + CONV_RELEASE steps are held the best
+// survivor is traced back and its oldest CONV_RELEASE bits are released.
+// Erased bits left by the uncoded scheme decode as 0 and are caught by the
+// frame CRC.
+class FecDecoder {
+public:
+    explicit FecDecoder(FecScheme scheme = FEC_NONE) { reset(scheme); }
+
+    void reset(FecScheme new_scheme) {
+        scheme = new_scheme;
+        held = 0;
+        metric.assign(CONV_STATES, INF);
+        metric[0] = 0;
+        next.resize(CONV_STATES);
+        decisions.clear();
+        for (unsigned reg = 0; reg < (1u << CONV_K); ++reg) {
+            outputs[reg][0] = (uint8_t)parity(reg & CONV_G0);
+            outputs[reg][1] = (uint8_t)parity(reg & CONV_G1);
+        }
+    }
+
+    void push(int8_t bit, std::vector<uint8_t>& out) {
+        if (scheme == FEC_NONE) {
+            out.push_back(bit == 1 ? 1 : 0);
+            return;
+        }
+        block[held++] = bit;
+        if (scheme == FEC_HAMMING74 && held == 7) {
+            append_bits(out, hamming74_nearest(block), 4);
+            held = 0;
+        } else if (scheme == FEC_CONV && held == 2) {
+            conv_step(block[0], block[1]);
+            held = 0;
+            if (decisions.size() == CONV_TRACEBACK + CONV_RELEASE) traceback(best_state(), CONV_RELEASE, out);
+        }
+    }
+
+    // Ends the message. The survivor ending in state 0, where the zero tail
+    // leaves the encoder, is traced back and the tail dropped; a partial
+    // Hamming block or an odd convolutional bit is ignored.
+    void finish(std::vector<uint8_t>& out) {
+        if (scheme == FEC_CONV) {
+            size_t tail = CONV_K - 1;
+            traceback(0, decisions.size() > tail ? decisions.size() - tail : 0, out);
+        }
+        reset(scheme);
+    }
+
+private:
+    static const unsigned INF = 0x3FFFFFFF;
+
+    void conv_step(int8_t r0, int8_t r1) {
+        uint64_t decision = 0;
+        unsigned lowest = INF;
+        for (unsigned ns = 0; ns < (unsigned)CONV_STATES; ++ns) {
+            // ns came from (ns >> 1) with the old MSB 0 or 1 shifted out
+            unsigned best = INF;
+            for (unsigned msb = 0; msb < 2; ++msb) {
+                unsigned prev = (ns >> 1) | (msb << (CONV_K - 2));
+                if (metric[prev] == INF) continue;
+                unsigned reg = ns | (msb << (CONV_K - 1));
+                unsigned m = metric[prev] + (r0 != BIT_ERASED && r0 != outputs[reg][0])
+                                          + (r1 != BIT_ERASED && r1 != outputs[reg][1]);
+                if (m < best) {
+                    best = m;
+                    if (msb) decision |= (uint64_t)1 << ns;
+                    else decision &= ~((uint64_t)1 << ns);
+                }
+            }
+            next[ns] = best;
+            lowest = std::min(lowest, best);
+        }
+        // Only differences between metrics matter; keep them from growing
+        for (unsigned ns = 0; ns < (unsigned)CONV_STATES; ++ns) {
+            if (next[ns] != INF) next[ns] -= lowest;
+        }
+        decisions.push_back(decision);
+        metric.swap(next);
+    }
+
+    unsigned best_state() const {
+        return (unsigned)(std::min_element(metric.begin(), metric.end()) - metric.begin());
+    }
+
+    // Traces the held steps back from `state` and releases the oldest `count`
+    // decoded bits
+    void traceback(unsigned state, size_t count, std::vector<uint8_t>& out) {
+        trace.resize(decisions.size());
+        for (size_t t = decisions.size(); t-- > 0;) {
+            trace[t] = (uint8_t)(state & 1);
+            unsigned msb = (unsigned)((decisions[t] >> state) & 1);
+            state = (state >> 1) | (msb << (CONV_K - 2));
+        }
+        out.insert(out.end(), trace.begin(), trace.begin() + count);
+        decisions.erase(decisions.begin(), decisions.begin() + count);
+    }
+
+    FecScheme scheme;
+    int8_t block[7];
+    size_t held;
+    std::vector<unsigned> metric, next;
+    std::vector<uint64_t> decisions; // per held step, which predecessor each state kept
+    std::vector<uint8_t> trace;
+    uint8_t outputs[1 << CONV_K][2];
+};
+
+// Decodes a whole received message (0, 1 or BIT_ERASED)
+inline void fec_decode(FecScheme scheme, const std::vector<int8_t>& in, std::vector<uint8_t>& out)
+{
+    out.clear();
+    FecDecoder decoder(scheme);
+    for (size_t i = 0; i < in.size(); ++i) decoder.push(in[i], out);
+    decoder.finish(out);
+}
+
+struct FrameStats {
+    size_t frames_ok;
+    size_t frames_expected;  // from the last-frame flag or the highest index seen
+    size_t payload_bytes;
+    std::vector<unsigned> missing;
+};
+
+struct DecodedFrame {
+    unsigned index;
+    std::string payload;
+    bool last;
+};
+
+// Finds frames in a decoded bit stream by their sync word as the stream
+// grows, and returns those whose CRC checks. Bits behind the scan position
+// are dropped, so about one frame's worth is held.
+class FrameScanner {
+public:
+    FrameScanner() : pos(0) {}
+
+    void reset() {
+        bits.clear();
+        pos = 0;
+    }
+
+    void push(const std::vector<uint8_t>& more, std::vector<DecodedFrame>& frames) {
+        bits.insert(bits.end(), more.begin(), more.end());
+        scan(false, frames);
+    }
+
+    // No more bits follow, so a sync word whose frame would run past the end
+    // is a false one
+    void finish(std::vector<DecodedFrame>& frames) {
+        scan(true, frames);
+        reset();
+    }
+
+private:
+    static const size_t COMPACT_BITS = 1024;
+
+    void scan(bool final, std::vector<DecodedFrame>& frames) {
+        while (pos + FRAME_HEADER_BITS + 16 <= bits.size()) {
+            if (read_bits(bits, pos, 16) != FRAME_SYNC) {
+                pos++;
+                continue;
+            }
+            uint8_t body[3 + FRAME_PAYLOAD_BYTES];
+            for (size_t i = 0; i < 3; ++i) body[i] = (uint8_t)read_bits(bits, pos + 16 + i * 8, 8);
+            size_t length = body[2] & ~FRAME_LAST_FLAG;
+            size_t end = pos + FRAME_HEADER_BITS + length * 8 + 16;
+            if (end > bits.size() && length <= FRAME_PAYLOAD_BYTES && !final) break; // wait for the rest
+            if (length > FRAME_PAYLOAD_BYTES || end > bits.size()) {
+                pos++;
+                continue;
+            }
+            for (size_t i = 0; i < length; ++i) body[3 + i] = (uint8_t)read_bits(bits, pos + FRAME_HEADER_BITS + i * 8, 8);
+            if (crc16_ccitt(body, 3 + length) != read_bits(bits, end - 16, 16)) {
+                pos++;
+                continue;
+            }
+            DecodedFrame frame;
+            frame.index = (body[0] << 8) | body[1];
+            frame.payload.assign((const char*)body + 3, length);
+            frame.last = (body[2] & FRAME_LAST_FLAG) != 0;
+            frames.push_back(frame);
+            pos = end;
+        }
+        if (pos >= COMPACT_BITS) {
+            bits.erase(bits.begin(), bits.begin() + pos);
+            pos = 0;
+        }
+    }
+
+    std::vector<uint8_t> bits;
+    size_t pos;
+};
+
+// Received coded bits in, frames that pass their CRC out, as they complete
+class FrameDecoder {
+public:
+    explicit FrameDecoder(FecScheme scheme = FEC_NONE) : fec(scheme), coded(0) {}
+
+    void reset(FecScheme scheme) {
+        fec.reset(scheme);
+        scanner.reset();
+        coded = 0;
+    }
+
+    // The `bits` low bits of `symbol`, MSB first
+    void push_symbol(unsigned symbol, int bits, std::vector<DecodedFrame>& frames) {
+        for (int i = bits - 1; i >= 0; --i) fec.push((int8_t)((symbol >> i) & 1), decoded);
+        coded += bits;
+        scan(frames);
+    }
+
+    void push_erased(size_t bits, std::vector<DecodedFrame>& frames) {
+        for (size_t i = 0; i < bits; ++i) fec.push(BIT_ERASED, decoded);
+        coded += bits;
+        scan(frames);
+    }
+
+    void finish(std::vector<DecodedFrame>& frames) {
+        fec.finish(decoded);
+        scan(frames);
+        scanner.finish(frames);
+    }
+
+    uint64_t coded_bits() const { return coded; }
+
+private:
+    void scan(std::vector<DecodedFrame>& frames) {
+        if (decoded.empty()) return;
+        scanner.push(decoded, frames);
+        decoded.clear();
+    }
+
+    FecDecoder fec;
+    FrameScanner scanner;
+    std::vector<uint8_t> decoded;
+    uint64_t coded;
+};
+
+// Puts frames back in index order for output that streams: each is released
+// once every frame before it has been released or given up. A frame that
+// comes early, as from another stripe, is held until the gap before it fills
+// or more than `hold` frames wait; the gap then counts as lost. With hold 0,
+// for one coded stream whose frames cannot come out of order, a gap is lost
+// as soon as a later frame passes.
+class FrameSequencer {
+public:
+    explicit FrameSequencer(size_t hold = 0) { reset(hold); }
+
+    void reset(size_t new_hold) {
+        hold = new_hold;
+        next = 0;
+        last_index = -1;
+        waiting.clear();
+        totals = FrameStats();
+    }
+
+    void add(const DecodedFrame& frame, std::vector<DecodedFrame>& ready) {
+        if (frame.index < next || waiting.count(frame.index)) return; // given up on, or a repeat
+        if (frame.last) last_index = frame.index;
+        waiting[frame.index] = frame;
+        release(false, ready);
+    }
+
+    // Releases everything still held
+    void finish(std::vector<DecodedFrame>& ready) { release(true, ready); }
+
+    // Without the last frame, the highest index released stands in for it
+    const FrameStats& stats() const { return totals; }
+
+    // Index of the next frame due
+    unsigned next_index() const { return next; }
+
+private:
+    void release(bool all, std::vector<DecodedFrame>& ready) {
+        while (!waiting.empty()) {
+            std::map<unsigned, DecodedFrame>::iterator it = waiting.begin();
+            if (it->first != next) {
+                if (!all && waiting.size() <= hold) break;
+                for (; next < it->first; ++next) totals.missing.push_back(next);
+            }
+            totals.frames_ok++;
+            totals.payload_bytes += it->second.payload.size();
+            ready.push_back(it->second);
+            next = it->first + 1;
+            waiting.erase(it);
+        }
+        totals.frames_expected = last_index >= 0 ? std::max((size_t)last_index + 1, (size_t)next) : next;
+    }
+
+    size_t hold;
+    unsigned next;
+    long last_index;
+    std::map<unsigned, DecodedFrame> waiting;
+    FrameStats totals;
+};
+
+// Collects the frames of a whole decoded bit stream by index. `last_index`
+// is set when the frame flagged last is among them.
+inline void collect_frames(const std::vector<uint8_t>& bits, std::map<unsigned, std::string>& frames, long& last_index)
+{
+    std::vector<DecodedFrame> found;
+    FrameScanner scanner;
+    scanner.push(bits, found);
+    scanner.finish(found);
+    for (size_t i = 0; i < found.size(); ++i) {
+        frames[found[i].index] = found[i].payload;
+        if (found[i].last) last_index = found[i].index;
+    }
+}
+
+// Joins collected frames in index order into `message`; lost frames are
+// listed in stats.missing. Without the last frame, the highest index seen
+// stands in for it.
+inline void assemble_frames(const std::map<unsigned, std::string>& frames, long last_index, std::string& message,
+                            FrameStats& stats)
+{
+    size_t expected = last_index >= 0 ? (size_t)last_index + 1 : frames.empty() ? 0 : frames.rbegin()->first + 1;
+    message.clear();
+    stats.frames_ok = 0;
+    stats.frames_expected = expected;
+    stats.payload_bytes = 0;
+    stats.missing.clear();
+    for (unsigned i = 0; i < expected; ++i) {
+        std::map<unsigned, std::string>::const_iterator it = frames.find(i);
+        if (it == frames.end()) {
+            stats.missing.push_back(i);
+            continue;
+        }
+        message += it->second;
+        stats.frames_ok++;
+        stats.payload_bytes += it->second.size();
+    }
+}
+
+// The frames of one bit stream, as one message
+inline void parse_frames(const std::vector<uint8_t>& bits, std::string& message, FrameStats& stats)
+{
+    std::map<unsigned, std::string> frames;
+    long last_index = -1;
+    collect_frames(bits, frames, last_index);
+    assemble_frames(frames, last_index, message, stats);
+}
+
+// Striping: frame i of `message` goes to stripe i % stripes, and each
+// stripe's frames are coded with `scheme` as a stream of their own. Only the
+// message's final frame carries the last flag, so any stripe holding it tells
+// the receiver how many frames to wait for.
+inline void build_striped_frames(const std::string& message, size_t stripes, FecScheme scheme,
+                                 std::vector<std::vector<uint8_t> >& coded)
+{
+    size_t frames = message.empty() ? 1 : (message.size() + FRAME_PAYLOAD_BYTES - 1) / FRAME_PAYLOAD_BYTES;
+    std::vector<std::vector<uint8_t> > plain(stripes);
+    for (size_t f = 0; f < frames; ++f) {
+        size_t begin = f * FRAME_PAYLOAD_BYTES;
+        size_t length = std::min(FRAME_PAYLOAD_BYTES, message.size() - begin);
+        append_frame(plain[f % stripes], (unsigned)f, (const uint8_t*)message.data() + begin, length, f + 1 == frames);
+    }
+    coded.assign(stripes, std::vector<uint8_t>());
+    for (size_t s = 0; s < stripes; ++s) {
+        if (!plain[s].empty()) fec_encode(scheme, plain[s], coded[s]);
+    }
+}
+
+#endif
@@ -0,0 +1,93 @@
+// Log-linear latency histogram in the style of HdrHistogram.
+//
+// Values are non-negative nanosecond counts. Below 2^SUB_BITS every value has
+// its own bucket; above it each power-of-two range is split into 2^SUB_BITS
+// equal buckets, so a percentile is exact to within 1/128 of its value over
+// the whole 64-bit range at a fixed 60 KB. Recording allocates nothing and
+// is cheap enough for a timing loop.
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 7;
+    static const int64_t SUB_COUNT = (int64_t)1 << SUB_BITS;
+
+    LatencyHistogram() : counts((64 - SUB_BITS + 1) * SUB_COUNT, 0), total(0), max_value(0) {}
+
+    void record(int64_t value) {
+        if (value < 0) value = 0;
+        counts[bucket_of(value)]++;
+        total++;
+        if (value > max_value) max_value = value;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) counts[i] += other.counts[i];
+        total += other.total;
+        if (other.max_value > max_value) max_value = other.max_value;
+    }
+
+    void reset() {
+        counts.assign(counts.size(), 0);
+        total = 0;
+        max_value = 0;
+    }
+
+    uint64_t count() const { return total; }
+    int64_t max() const { return max_value; }
+
+    // Samples recorded at or below `value`, to bucket precision
+    uint64_t count_at_or_below(int64_t value) const {
+        if (value < 0) return 0;
+        size_t last = bucket_of(value);
+        uint64_t seen = 0;
+        for (size_t i = 0; i <= last; ++i) seen += counts[i];
+        return seen;
+    }
+
+    // Highest value equivalent to the sample at `percent` (0-100), capped at
+    // the recorded maximum; 0 when empty
+    int64_t percentile(double percent) const {
+        if (total == 0) return 0;
+        uint64_t rank = (uint64_t)(percent / 100.0 * total + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > total) rank = total;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) {
+                int64_t high = highest_in_bucket(i);
+                return high < max_value ? high : max_value;
+            }
+        }
+        return max_value;
+    }
+
+private:
+    static size_t bucket_of(int64_t value) {
+        if (value < SUB_COUNT) return (size_t)value;
+        int magnitude = 63;
+        while (!((uint64_t)value >> magnitude)) --magnitude;
+        int shift = magnitude - SUB_BITS;
+        return (size_t)((shift + 1) * SUB_COUNT + ((value >> shift) - SUB_COUNT));
+    }
+
+    static int64_t highest_in_bucket(size_t index) {
+        if ((int64_t)index < 2 * SUB_COUNT) return (int64_t)index;
+        int shift = (int)(index / SUB_COUNT) - 1;
+        uint64_t top = (uint64_t)(index % SUB_COUNT + SUB_COUNT);
+        uint64_t high = ((top + 1) << shift) - 1;
+        return high > (uint64_t)INT64_MAX ? INT64_MAX : (int64_t)high;
+    }
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    int64_t max_value;
+};
+
+#endif
@@ -40,7 +40,7 @@ if __name__ == "__main__":
         print(f"[+] Processing {input_file} with tau = {exp['tau_ms']}ms...")
 
         try:
-            df = pd.read_csv(input_file)
+            df = pd.read_csv(input_file, comment='#')
             
             # Apply fuzzing to the Time/IAT column
             df["Time"] = df["Time"].apply(lambda x: inject_fuzzy(x, tau_seconds))
@@ -27,7 +27,7 @@ def inject_fuzzy(x, tau):
 # Set tau corresponding to covert channel configuration
 tau = 100 / 1000
 # Read CSV
-input = pd.read_csv("data/timings_7_cleaned.csv")
+input = pd.read_csv("data/timings_7_cleaned.csv", comment='#')
 
 # Get IATs (first column is Time)
 iat_cov = input["Time"]
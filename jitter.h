@@ -0,0 +1,220 @@
+// Constant-memory jitter profile of a probe run, behind `receiver -profile`.
+//
+// Arrivals of `sender -probe` packets are taken one at a time, in arrival
+// order, and only summaries are kept: Welford mean and variance of the
+// intervals, their lag-1 autocorrelation, loss, duplicate and reordering
+// counts from the sequence numbers, and percentiles from log-linear
+// histograms. Only intervals between consecutively numbered packets count,
+// so a lost probe does not show up as one doubled interval.
+//
+// Percentiles are kept as deviations from a reference interval, the median
+// of the first REFERENCE_INTERVALS, which puts the histogram's relative
+// precision on the jitter rather than on the whole delay. That resolves a
+// 20 ms probe to about a microsecond where a histogram of raw intervals
+// would give 150 us.
+#ifndef JITTER_H
+#define JITTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "histogram.h"
+
+class JitterProfile {
+public:
+    static const size_t REFERENCE_INTERVALS = 64;
+    static const uint32_t DUPLICATE_WINDOW = 4096; // sequence numbers remembered behind the highest
+
+    JitterProfile() : seen(DUPLICATE_WINDOW / 64, 0), started(false), first_seq(0), highest(0), last_seq(0),
+                      last_arrival_ns(0), unique(0), duplicates(0), reordered(0), reference_ns(0),
+                      settled(false), previous_iat(0), chained(false), n(0), mean(0), m2(0), pairs(0),
+                      mean_a(0), mean_b(0), m2_a(0), m2_b(0), comoment(0), min_ns(0), max_ns(0) {}
+
+    void push(uint32_t seq, int64_t arrival_ns) {
+        if (!track(seq)) return;
+        bool next = started && seq == last_seq + 1;
+        if (started && next) add_interval(arrival_ns - last_arrival_ns);
+        else chained = false;
+        started = true;
+        last_seq = seq;
+        last_arrival_ns = arrival_ns;
+    }
+
+    uint64_t received() const { return unique + duplicates; }
+    uint64_t duplicate_count() const { return duplicates; }
+    uint64_t reordered_count() const { return reordered; }
+    // Sequence numbers between the lowest and highest seen that never arrived
+    uint64_t lost_count() const {
+        uint64_t expected = unique ? (uint64_t)(uint32_t)(highest - first_seq) + 1 : 0;
+        return expected > unique ? expected - unique : 0;
+    }
+    uint64_t interval_count() const { return n; }
+
+    double mean_ms() const { return mean / 1e6; }
+    double stddev_ms() const { return n > 1 ? std::sqrt(m2 / (n - 1)) / 1e6 : 0.0; }
+    double min_ms() const { return min_ns / 1e6; }
+    double max_ms() const { return max_ns / 1e6; }
+
+    // Correlation of each interval with the one before it: near 0 for
+    // independent jitter, positive when delays drift, negative when one late
+    // packet makes a long interval followed by a short one
+    double autocorrelation() const {
+        if (pairs < 2 || m2_a <= 0 || m2_b <= 0) return 0.0;
+        return comoment / std::sqrt(m2_a * m2_b);
+    }
+
+    // Interval at `percent` (0-100)
+    double percentile_ms(double percent) {
+        settle();
+        return (reference_ns + quantile_offset(percent)) / 1e6;
+    }
+
+    // `percent` (0-100) percentile of the distance from the median interval
+    double deviation_ms(double percent) {
+        settle();
+        uint64_t total = above.count() + below.count();
+        if (total == 0) return 0.0;
+        int64_t median = quantile_offset(50.0);
+        uint64_t wanted = (uint64_t)std::ceil(percent / 100.0 * total);
+        int64_t lo = 0;
+        int64_t hi = std::max(above.max(), below.max()) + (median < 0 ? -median : median);
+        while (lo < hi) {
+            int64_t mid = lo + (hi - lo) / 2;
+            if (count_at_or_below(median + mid) - count_at_or_below(median - mid - 1) >= wanted) hi = mid;
+            else lo = mid + 1;
+        }
+        return lo / 1e6;
+    }
+
+private:
+    // Updates the sequence counters; false for a duplicate
+    bool track(uint32_t seq) {
+        if (unique == 0) {
+            first_seq = highest = seq;
+            mark(seq);
+            unique++;
+            return true;
+        }
+        int32_t ahead = (int32_t)(seq - highest);
+        if (ahead > 0) {
+            uint32_t clear = (uint32_t)ahead < DUPLICATE_WINDOW ? (uint32_t)ahead : DUPLICATE_WINDOW;
+            for (uint32_t i = 1; i <= clear; ++i) unmark(highest + i);
+            highest = seq;
+        } else if ((uint32_t)-ahead < DUPLICATE_WINDOW && marked(seq)) {
+            duplicates++;
+            return false;
+        } else {
+            reordered++;
+            if ((int32_t)(seq - first_seq) < 0) first_seq = seq;
+        }
+        mark(seq);
+        unique++;
+        return true;
+    }
+
+    size_t bit_index(uint32_t seq) const { return seq % DUPLICATE_WINDOW; }
+    bool marked(uint32_t seq) const { return (seen[bit_index(seq) / 64] >> (bit_index(seq) % 64)) & 1; }
+    void mark(uint32_t seq) { seen[bit_index(seq) / 64] |= (uint64_t)1 << (bit_index(seq) % 64); }
+    void unmark(uint32_t seq) { seen[bit_index(seq) / 64] &= ~((uint64_t)1 << (bit_index(seq) % 64)); }
+
+    void add_interval(int64_t iat_ns) {
+        double x = (double)iat_ns;
+        n++;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+        if (n == 1 || iat_ns < min_ns) min_ns = iat_ns;
+        if (n == 1 || iat_ns > max_ns) max_ns = iat_ns;
+
+        if (chained) {
+            pairs++;
+            double da = previous_iat - mean_a;
+            double db = x - mean_b;
+            mean_a += da / pairs;
+            mean_b += db / pairs;
+            m2_a += da * (previous_iat - mean_a);
+            m2_b += db * (x - mean_b);
+            comoment += da * (x - mean_b);
+        }
+        previous_iat = x;
+        chained = true;
+
+        if (settled) {
+            record(iat_ns);
+        } else {
+            early.push_back(iat_ns);
+            if (early.size() == REFERENCE_INTERVALS) settle();
+        }
+    }
+
+    // Fixes the reference interval and replays the intervals held until then
+    void settle() {
+        if (settled) return;
+        settled = true;
+        if (early.empty()) return;
+        std::vector<int64_t> sorted(early);
+        std::sort(sorted.begin(), sorted.end());
+        reference_ns = sorted[sorted.size() / 2];
+        for (size_t i = 0; i < early.size(); ++i) record(early[i]);
+        early.clear();
+    }
+
+    void record(int64_t iat_ns) {
+        int64_t offset = iat_ns - reference_ns;
+        if (offset >= 0) above.record(offset);
+        else below.record(-offset);
+    }
+
+    // Intervals at most reference + offset
+    uint64_t count_at_or_below(int64_t offset) const {
+        if (offset >= 0) return below.count() + above.count_at_or_below(offset);
+        return below.count() - below.count_at_or_below(-offset - 1);
+    }
+
+    int64_t quantile_offset(double percent) const {
+        uint64_t total = above.count() + below.count();
+        if (total == 0) return 0;
+        double rank = percent / 100.0 * total;
+        if (rank <= below.count() && below.count() > 0) {
+            // Counted down from the most negative offset
+            double from_top = below.count() - rank + 1;
+            return -below.percentile(100.0 * from_top / below.count());
+        }
+        if (above.count() == 0) return 0;
+        return above.percentile(100.0 * (rank - below.count()) / above.count());
+    }
+
+    std::vector<uint64_t> seen; // bitmap of the last DUPLICATE_WINDOW sequence numbers
+    bool started;
+    uint32_t first_seq;
+    uint32_t highest;
+    uint32_t last_seq;
+    int64_t last_arrival_ns;
+    uint64_t unique;
+    uint64_t duplicates;
+    uint64_t reordered;
+
+    int64_t reference_ns;
+    bool settled;
+    std::vector<int64_t> early; // at most REFERENCE_INTERVALS
+    LatencyHistogram above;     // offsets from the reference, ns
+    LatencyHistogram below;
+
+    double previous_iat;
+    bool chained; // previous_iat is the interval just before the next one
+    uint64_t n;
+    double mean;
+    double m2;
+    uint64_t pairs;
+    double mean_a; // lag-1 pairs (previous, current)
+    double mean_b;
+    double m2_a;
+    double m2_b;
+    double comoment;
+    int64_t min_ns;
+    int64_t max_ns;
+};
+
+#endif
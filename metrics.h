@@ -0,0 +1,422 @@
+// Hot-path counters for the sender and receiver, exported with -metrics.
+//
+// Each counting thread gets its own MetricsShard on first use and is its only
+// writer, so an update is a relaxed load and store: no locked instruction and
+// no cache line shared with another hot thread. The exporter thread sums the
+// shards with relaxed loads, off the hot path; a reading may trail the
+// latest updates by a few packets. Shards are never freed, so what a finished
+// worker thread counted stays in the totals.
+//
+// -metrics <PORT> serves the totals as Prometheus text at
+// http://<host>:<PORT>/metrics; -metrics <FILE> appends one JSON object per
+// METRICS_INTERVAL_MS, and "-" writes them to stdout. Times are kept in
+// nanoseconds and exported in seconds.
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clock.h"
+
+#ifdef _WIN32
+    #ifndef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+#else
+    #include <sys/socket.h>
+    #include <sys/select.h>
+    #include <netinet/in.h>
+    #include <unistd.h>
+#endif
+
+#ifdef _WIN32
+typedef SOCKET metrics_socket;
+const metrics_socket NO_METRICS_SOCKET = INVALID_SOCKET;
+#else
+typedef int metrics_socket;
+const metrics_socket NO_METRICS_SOCKET = -1;
+#endif
+
+enum MetricId {
+    METRIC_PACKETS_SENT,
+    METRIC_SEND_FAILURES,
+    METRIC_SEND_CALLS,
+    METRIC_SEND_NS,
+    METRIC_WAIT_NS,
+    METRIC_PACKETS_RECEIVED,
+    METRIC_RECEIVE_CALLS,
+    METRIC_RECEIVE_NS,
+    METRIC_RX_QUEUE_DROPS,
+    METRIC_SEQ_GAPS,
+    METRIC_PACKETS_LOST,
+    METRIC_OUT_OF_ORDER,
+    METRIC_SYMBOLS_DECODED,
+    METRIC_SYMBOLS_ERASED,
+    METRIC_TRAINING_BITS,
+    METRIC_TRAINING_BIT_ERRORS,
+    METRIC_COUNT
+};
+
+struct MetricInfo {
+    const char* name; // exported as covert_<name>
+    const char* help;
+    bool nanoseconds; // exported in seconds
+};
+
+const MetricInfo METRIC_INFO[METRIC_COUNT] = {
+    { "packets_sent_total", "Packets handed to the kernel", false },
+    { "send_failures_total", "Packets whose send call failed", false },
+    { "send_calls_total", "sendto/sendmmsg calls", false },
+    { "send_seconds_total", "Time inside send calls", true },
+    { "wait_seconds_total", "Time sleeping or spinning until send deadlines", true },
+    { "packets_received_total", "Datagrams received", false },
+    { "receive_calls_total", "Receive calls, including ones that timed out", false },
+    { "receive_seconds_total", "Time inside receive calls, blocking for packets included", true },
+    { "rx_queue_drops_total", "Datagrams dropped by a full socket receive queue (SO_RXQ_OVFL)", false },
+    { "seq_gaps_total", "Runs of missing sequence numbers", false },
+    { "packets_lost_total", "Sequence numbers never received", false },
+    { "seq_out_of_order_total", "Arrivals at or behind the sequence number before them", false },
+    { "symbols_decoded_total", "Data symbols decoded", false },
+    { "symbols_erased_total", "Data symbols erased for loss or reordering", false },
+    { "training_bits_total", "Bits of training preamble checked against its known pattern", false },
+    { "training_bit_errors_total", "Training bits the calibrated thresholds misread", false },
+};
+
+// Upper bounds (ns) of the send lateness buckets; the last bucket is unbounded
+const int64_t LATENESS_BOUNDS_NS[] = { 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+                                       1000000, 2000000, 5000000, 10000000 };
+const size_t LATENESS_BUCKETS = sizeof(LATENESS_BOUNDS_NS) / sizeof(LATENESS_BOUNDS_NS[0]) + 1;
+
+const int METRICS_INTERVAL_MS = 1000;
+
+class MetricsShard {
+public:
+    MetricsShard() {
+        for (size_t i = 0; i < METRIC_COUNT; ++i) counters[i].store(0);
+        for (size_t i = 0; i < LATENESS_BUCKETS; ++i) lateness[i].store(0);
+        lateness_sum_ns.store(0);
+    }
+
+    // Owning thread only
+    void add(MetricId id, uint64_t n) { bump(counters[id], n); }
+
+    // How long after its deadline a packet was handed to send
+    void observe_lateness(int64_t ns) {
+        if (ns < 0) ns = 0;
+        size_t bucket = 0;
+        while (bucket + 1 < LATENESS_BUCKETS && ns > LATENESS_BOUNDS_NS[bucket]) bucket++;
+        bump(lateness[bucket], 1);
+        bump(lateness_sum_ns, (uint64_t)ns);
+    }
+
+    uint64_t counter(size_t id) const { return counters[id].load(std::memory_order_relaxed); }
+    uint64_t lateness_count(size_t bucket) const { return lateness[bucket].load(std::memory_order_relaxed); }
+    uint64_t lateness_sum() const { return lateness_sum_ns.load(std::memory_order_relaxed); }
+
+private:
+    static void bump(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    char leading_pad[64]; // keeps neighbouring allocations off these lines
+    std::atomic<uint64_t> counters[METRIC_COUNT];
+    std::atomic<uint64_t> lateness[LATENESS_BUCKETS];
+    std::atomic<uint64_t> lateness_sum_ns;
+    char trailing_pad[64];
+};
+
+// Totals over every shard at one instant
+struct MetricsSnapshot {
+    uint64_t counters[METRIC_COUNT];
+    uint64_t lateness[LATENESS_BUCKETS]; // per bucket, not cumulative
+    uint64_t lateness_sum_ns;
+};
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    MetricsShard* add_shard() {
+        MetricsShard* shard = new MetricsShard();
+        std::lock_guard<std::mutex> lock(mutex);
+        shards.push_back(shard);
+        return shard;
+    }
+
+    void snapshot(MetricsSnapshot& totals) {
+        memset(&totals, 0, sizeof(totals));
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t s = 0; s < shards.size(); ++s) {
+            for (size_t i = 0; i < METRIC_COUNT; ++i) totals.counters[i] += shards[s]->counter(i);
+            for (size_t i = 0; i < LATENESS_BUCKETS; ++i) totals.lateness[i] += shards[s]->lateness_count(i);
+            totals.lateness_sum_ns += shards[s]->lateness_sum();
+        }
+    }
+
+private:
+    MetricsRegistry() {}
+
+    std::mutex mutex;
+    std::vector<MetricsShard*> shards;
+};
+
+// The calling thread's shard
+inline MetricsShard& metrics_shard()
+{
+    static thread_local MetricsShard* shard = NULL;
+    if (!shard) shard = MetricsRegistry::instance().add_shard();
+    return *shard;
+}
+
+// Counts the step from one flow's previous sequence number to the next, in
+// arrival order
+inline void meter_sequence(MetricsShard& metrics, uint32_t previous, uint32_t seq)
+{
+    int32_t step = (int32_t)(seq - previous);
+    if (step > 1) {
+        metrics.add(METRIC_SEQ_GAPS, 1);
+        metrics.add(METRIC_PACKETS_LOST, (uint64_t)(step - 1));
+    } else if (step <= 0) {
+        metrics.add(METRIC_OUT_OF_ORDER, 1);
+    }
+}
+
+inline std::string metric_value(const MetricsSnapshot& totals, size_t id)
+{
+    char text[32];
+    if (METRIC_INFO[id].nanoseconds)
+        snprintf(text, sizeof(text), "%.9f", totals.counters[id] / 1e9);
+    else
+        snprintf(text, sizeof(text), "%llu", (unsigned long long)totals.counters[id]);
+    return text;
+}
+
+inline std::string lateness_bound(size_t bucket)
+{
+    if (bucket + 1 == LATENESS_BUCKETS) return "+Inf";
+    char text[32];
+    snprintf(text, sizeof(text), "%g", LATENESS_BOUNDS_NS[bucket] / 1e9);
+    return text;
+}
+
+// Prometheus text exposition format 0.0.4
+inline std::string format_prometheus(const MetricsSnapshot& totals, const std::string& program, double uptime_s)
+{
+    std::string out;
+    char line[160];
+    snprintf(line, sizeof(line), "# HELP covert_uptime_seconds Time since the %s started\n"
+             "# TYPE covert_uptime_seconds gauge\ncovert_uptime_seconds{program=\"%s\"} %.3f\n",
+             program.c_str(), program.c_str(), uptime_s);
+    out += line;
+    for (size_t i = 0; i < METRIC_COUNT; ++i) {
+        std::string name = std::string("covert_") + METRIC_INFO[i].name;
+        out += "# HELP " + name + " " + METRIC_INFO[i].help + "\n";
+        out += "# TYPE " + name + " counter\n";
+        out += name + " " + metric_value(totals, i) + "\n";
+    }
+    out += "# HELP covert_send_lateness_seconds Delay from a packet's deadline to its send call\n";
+    out += "# TYPE covert_send_lateness_seconds histogram\n";
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < LATENESS_BUCKETS; ++b) {
+        cumulative += totals.lateness[b];
+        snprintf(line, sizeof(line), "covert_send_lateness_seconds_bucket{le=\"%s\"} %llu\n", lateness_bound(b).c_str(),
+                 (unsigned long long)cumulative);
+        out += line;
+    }
+    snprintf(line, sizeof(line), "covert_send_lateness_seconds_sum %.9f\ncovert_send_lateness_seconds_count %llu\n",
+             totals.lateness_sum_ns / 1e9, (unsigned long long)cumulative);
+    out += line;
+    return out;
+}
+
+// One JSON object on one line, with the same names as the Prometheus output
+inline std::string format_json(const MetricsSnapshot& totals, const std::string& program, double uptime_s)
+{
+    char field[96];
+    snprintf(field, sizeof(field), "{\"time\":%.3f,\"program\":\"%s\",\"uptime_seconds\":%.3f",
+             std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count(),
+             program.c_str(), uptime_s);
+    std::string out = field;
+    for (size_t i = 0; i < METRIC_COUNT; ++i) out += std::string(",\"") + METRIC_INFO[i].name + "\":" + metric_value(totals, i);
+    out += ",\"send_lateness_seconds\":{\"buckets\":[";
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < LATENESS_BUCKETS; ++b) {
+        cumulative += totals.lateness[b];
+        std::string bound = lateness_bound(b);
+        snprintf(field, sizeof(field), "%s[%s,%llu]", b ? "," : "", bound == "+Inf" ? "null" : bound.c_str(),
+                 (unsigned long long)cumulative);
+        out += field;
+    }
+    snprintf(field, sizeof(field), "],\"sum\":%.9f,\"count\":%llu}}\n", totals.lateness_sum_ns / 1e9,
+             (unsigned long long)cumulative);
+    out += field;
+    return out;
+}
+
+// Serves or writes the totals from a thread of its own
+class MetricsExporter {
+public:
+    MetricsExporter() : port(0), file(NULL), listener(NO_METRICS_SOCKET), stopping(false), start_ns(0) {}
+
+    ~MetricsExporter() { stop(); }
+
+    // `target` is a TCP port for the Prometheus endpoint, or a JSON lines file
+    bool start(const std::string& target, const std::string& program_name, std::string& error) {
+        destination = target;
+        program = program_name;
+        start_ns = now_ns();
+        char* end;
+        long number = strtol(target.c_str(), &end, 10);
+        if (!target.empty() && *end == '\0') {
+            if (number < 1 || number > 65535) {
+                error = "metrics port must be 1-65535";
+                return false;
+            }
+            port = (int)number;
+            if (!listen_on(error)) return false;
+        } else {
+            file = target == "-" ? stdout : fopen(target.c_str(), "a");
+            if (!file) {
+                error = "cannot open metrics file " + target;
+                return false;
+            }
+        }
+        worker = std::thread(&MetricsExporter::run, this);
+        return true;
+    }
+
+    // The endpoint or file, for the startup banner
+    std::string describe() const {
+        if (port) return "http://0.0.0.0:" + std::to_string(port) + "/metrics";
+        return std::string(file == stdout ? "stdout" : destination) + ", a JSON line every " +
+               std::to_string(METRICS_INTERVAL_MS) + "ms";
+    }
+
+    // Writes a last JSON line, so the file ends with the final totals
+    void stop() {
+        if (!worker.joinable()) return;
+        stopping.store(true);
+        worker.join();
+        if (file) {
+            write_line();
+            if (file != stdout) fclose(file);
+            file = NULL;
+        }
+        if (listener != NO_METRICS_SOCKET) close_socket(listener);
+        listener = NO_METRICS_SOCKET;
+    }
+
+private:
+    double uptime() const { return (now_ns() - start_ns) / 1e9; }
+
+    void write_line() {
+        MetricsSnapshot totals;
+        MetricsRegistry::instance().snapshot(totals);
+        std::string line = format_json(totals, program, uptime());
+        fwrite(line.data(), 1, line.size(), file);
+        fflush(file);
+    }
+
+    bool listen_on(std::string& error) {
+        listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener == NO_METRICS_SOCKET) {
+            error = "cannot create metrics socket";
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)port);
+        addr.sin_addr.s_addr = INADDR_ANY;
+        if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 8) != 0) {
+            error = "cannot listen for metrics on TCP port " + std::to_string(port);
+            close_socket(listener);
+            listener = NO_METRICS_SOCKET;
+            return false;
+        }
+        return true;
+    }
+
+    // Answers one scrape. Any path gets the metrics; the request is read
+    // only so the client sees a clean close.
+    void serve(metrics_socket client) {
+        char request[1024];
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(client, &readable);
+        timeval wait = { 1, 0 };
+        if (select((int)client + 1, &readable, NULL, NULL, &wait) > 0) recv(client, request, sizeof(request), 0);
+
+        MetricsSnapshot totals;
+        MetricsRegistry::instance().snapshot(totals);
+        std::string body = format_prometheus(totals, program, uptime());
+        std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size()) {
+            int n = (int)send(client, response.data() + sent, (int)(response.size() - sent), 0);
+            if (n <= 0) break;
+            sent += n;
+        }
+        close_socket(client);
+    }
+
+    void run() {
+        auto next_line = std::chrono::steady_clock::now() + std::chrono::milliseconds(METRICS_INTERVAL_MS);
+        while (!stopping.load()) {
+            if (file) {
+                // Short sleeps, so stop() never waits a whole interval
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                if (std::chrono::steady_clock::now() < next_line) continue;
+                write_line();
+                next_line += std::chrono::milliseconds(METRICS_INTERVAL_MS);
+                continue;
+            }
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(listener, &readable);
+            timeval wait = { 0, 200000 };
+            if (select((int)listener + 1, &readable, NULL, NULL, &wait) <= 0) continue;
+            metrics_socket client = accept(listener, NULL, NULL);
+            if (client != NO_METRICS_SOCKET) serve(client);
+        }
+    }
+
+    static void close_socket(metrics_socket sock) {
+#ifdef _WIN32
+        closesocket(sock);
+#else
+        ::close(sock);
+#endif
+    }
+
+    std::string destination;
+    std::string program;
+    int port;
+    FILE* file;
+    metrics_socket listener;
+    std::atomic<bool> stopping;
+    int64_t start_ns;
+    std::thread worker;
+};
+
+#endif
@@ -4,7 +4,7 @@ import sys
 import textwrap
 
 def decode_timings(csv_file, threshold=150.0):
-    df = pd.read_csv(csv_file)
+    df = pd.read_csv(csv_file, comment='#')
     timings = df['Time'].values 
 
     bits = ['0' if t < threshold else '1' for t in timings]
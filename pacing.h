@@ -0,0 +1,103 @@
+// Absolute-deadline scheduler used by the sender and measured by bench.
+//
+// Each wait sleeps coarsely until shortly before the deadline and busy-spins
+// the remainder, so scheduler overshoot never reaches the wire. Callers
+// advance the deadline from the previous target, not from the actual
+// wake-up, so errors do not accumulate.
+#ifndef PACING_H
+#define PACING_H
+
+#include <chrono>
+#include <thread>
+
+#include "clock.h"
+
+#ifdef _WIN32
+    #ifndef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+    #ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+        #define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+    #endif
+#else
+    #include <errno.h>
+    #include <time.h>
+#endif
+
+typedef timestamp_clock deadline_clock;
+
+// Tail of each wait that is spun instead of slept; set by calibrate_spin_margin().
+inline std::chrono::nanoseconds& spin_margin()
+{
+    static std::chrono::nanoseconds margin = std::chrono::microseconds(500);
+    return margin;
+}
+
+inline deadline_clock::duration ms_to_duration(double ms)
+{
+    return std::chrono::duration_cast<deadline_clock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+// Sleeps until `target` without spinning: a high-resolution waitable timer
+// on Windows, absolute clock_nanosleep on Linux.
+inline void coarse_sleep_until(deadline_clock::time_point target)
+{
+#ifdef _WIN32
+    static HANDLE timer = NULL;
+    if (timer == NULL) {
+        timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (timer == NULL) timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(target - deadline_clock::now());
+    if (remaining.count() <= 0) return;
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)(remaining.count() / 100); // relative, 100ns units
+    if (timer == NULL || !SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE)) {
+        Sleep((DWORD)(remaining.count() / 1000000));
+        return;
+    }
+    WaitForSingleObject(timer, INFINITE);
+#elif defined(__linux__)
+    // Absolute on CLOCK_MONOTONIC, whose epoch differs from the deadline clock's
+    int64_t since_epoch = target.time_since_epoch().count() + kernel_clock_offset_ns(CLOCK_MONOTONIC);
+    timespec ts;
+    ts.tv_sec = (time_t)(since_epoch / 1000000000LL);
+    ts.tv_nsec = (long)(since_epoch % 1000000000LL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+#else
+    std::this_thread::sleep_until(target);
+#endif
+}
+
+inline void sleep_until_deadline(deadline_clock::time_point deadline)
+{
+    auto coarse_target = deadline - spin_margin();
+    if (deadline_clock::now() < coarse_target) coarse_sleep_until(coarse_target);
+    while (deadline_clock::now() < deadline) {
+    }
+}
+
+// Measures how far the coarse sleep overshoots on this host and sizes the
+// spin margin to cover the worst observed case.
+inline void calibrate_spin_margin()
+{
+    const int rounds = 20;
+    std::chrono::nanoseconds worst(0);
+    for (int i = 0; i < rounds; ++i) {
+        auto target = deadline_clock::now() + std::chrono::milliseconds(1);
+        coarse_sleep_until(target);
+        auto overshoot = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline_clock::now() - target);
+        if (overshoot > worst) worst = overshoot;
+    }
+    auto margin = worst + worst / 2 + std::chrono::microseconds(50);
+    if (margin < std::chrono::microseconds(100)) margin = std::chrono::microseconds(100);
+    if (margin > std::chrono::milliseconds(3)) margin = std::chrono::milliseconds(3);
+    spin_margin() = margin;
+}
+
+#endif
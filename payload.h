@@ -0,0 +1,348 @@
+// Streaming payload input for the sender.
+//
+// PayloadReader reads a file, or stdin for "-", in fixed-size chunks with no
+// text translation, so any binary payload is sent byte for byte and memory
+// stays constant however large the input is. Stdin is read for whatever has
+// arrived, so a pipe's first bytes go out without waiting for a full chunk.
+// PayloadBits turns it into the bit sequence the encode loop consumes: the
+// raw bytes MSB-first, or their framing.h frames after FEC, built one frame
+// at a time.
+//
+// The payload can be deflated on the way in (zlib format, so the receiver's
+// adler32 check catches a corrupted stream). The codec id travels in the
+// flags byte of every packet; PayloadInflater undoes it incrementally as
+// bytes are decoded. Link with -lz.
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "framing.h"
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#else
+    #include <cerrno>
+    #include <unistd.h>
+#endif
+#include <sys/stat.h>
+#include <zlib.h>
+
+enum PayloadCodec { CODEC_NONE = 0, CODEC_DEFLATE = 1 };
+
+// Low bits of CovertPacket::flags
+const uint8_t PACKET_CODEC_MASK = 0x0F;
+
+inline const char* codec_name(PayloadCodec codec)
+{
+    return codec == CODEC_DEFLATE ? "deflate" : "none";
+}
+
+inline bool parse_codec(const std::string& name, PayloadCodec& codec)
+{
+    if (name == "none") codec = CODEC_NONE;
+    else if (name == "deflate") codec = CODEC_DEFLATE;
+    else return false;
+    return true;
+}
+
+// Frame indices are 16 bits, which bounds a framed message
+const uint64_t MAX_FRAMED_BYTES = (uint64_t)65536 * FRAME_PAYLOAD_BYTES;
+
+class PayloadReader {
+public:
+    static const size_t CHUNK_BYTES = 1 << 16;
+
+    PayloadReader()
+        : file(NULL), text_pos(0), known_size(-1), codec(CODEC_NONE), deflating(false), input_done(false),
+          short_read(false), pos(0), fill(0), consumed(0), source_read(0), buffer(CHUNK_BYTES) {}
+    ~PayloadReader() { close(); }
+
+    // Applies to inputs opened afterwards
+    void set_codec(PayloadCodec payload_codec) { codec = payload_codec; }
+
+    bool open(const std::string& path, std::string& error) {
+        close();
+        if (path == "-") {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            file = stdin;
+            return start_codec(error);
+        }
+        file = fopen(path.c_str(), "rb");
+        if (!file) {
+            error = "cannot open " + path;
+            return false;
+        }
+#ifdef _WIN32
+        struct _stat64 st;
+        if (_fstat64(_fileno(file), &st) == 0 && (st.st_mode & _S_IFREG)) known_size = (int64_t)st.st_size;
+#else
+        struct stat st;
+        if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode)) known_size = (int64_t)st.st_size;
+#endif
+        return start_codec(error);
+    }
+
+    // Serves an in-memory message, such as one given on the command line
+    bool open_string(const std::string& message, std::string& error) {
+        close();
+        text = message;
+        known_size = (int64_t)text.size();
+        return start_codec(error);
+    }
+
+    void close() {
+        if (file && file != stdin) fclose(file);
+        if (deflating) deflateEnd(&zs);
+        file = NULL;
+        text.clear();
+        text_pos = 0;
+        known_size = -1;
+        deflating = false;
+        input_done = false;
+        short_read = false;
+        pos = fill = 0;
+        consumed = 0;
+        source_read = 0;
+    }
+
+    // Reads up to `n` bytes; fewer only at the end of the input
+    size_t read(uint8_t* out, size_t n) {
+        size_t got = 0;
+        while (got < n && refill()) {
+            size_t take = std::min(n - got, fill - pos);
+            std::copy(buffer.begin() + pos, buffer.begin() + pos + take, out + got);
+            pos += take;
+            got += take;
+        }
+        consumed += got;
+        return got;
+    }
+
+    bool at_end() { return !refill(); }
+
+    // Bytes that will be delivered, when known: the input size of a regular
+    // file or string, unless it is being compressed. Otherwise -1.
+    int64_t size() const { return codec == CODEC_NONE ? known_size : -1; }
+    int64_t input_size() const { return known_size; }
+    uint64_t bytes_read() const { return consumed; }
+    uint64_t input_bytes_read() const { return source_read; }
+    PayloadCodec payload_codec() const { return codec; }
+
+private:
+    bool start_codec(std::string& error) {
+        if (codec != CODEC_DEFLATE) return true;
+        zs = z_stream();
+        if (deflateInit(&zs, Z_BEST_COMPRESSION) != Z_OK) {
+            error = "cannot start deflate";
+            return false;
+        }
+        input.resize(CHUNK_BYTES);
+        deflating = true;
+        return true;
+    }
+
+    // Blocks only until some input is there, unlike fread
+    static size_t read_stdin(uint8_t* out, size_t n) {
+        for (;;) {
+#ifdef _WIN32
+            int got = _read(_fileno(stdin), out, (unsigned)n);
+#else
+            ssize_t got = ::read(fileno(stdin), out, n);
+            if (got < 0 && errno == EINTR) continue;
+#endif
+            return got > 0 ? (size_t)got : 0;
+        }
+    }
+
+    size_t read_source(uint8_t* out, size_t n) {
+        size_t got;
+        if (file == stdin) {
+            got = read_stdin(out, n);
+            short_read = got > 0 && got < n;
+        } else if (file) {
+            got = fread(out, 1, n, file);
+        } else {
+            got = std::min(n, text.size() - text_pos);
+            std::copy(text.begin() + text_pos, text.begin() + text_pos + got, out);
+            text_pos += got;
+        }
+        source_read += got;
+        return got;
+    }
+
+    bool refill() {
+        if (pos < fill) return true;
+        pos = fill = 0;
+        if (!deflating) {
+            fill = read_source(&buffer[0], CHUNK_BYTES);
+            return fill > 0;
+        }
+        while (fill == 0 && !input_done) {
+            if (zs.avail_in == 0) {
+                zs.avail_in = (uInt)read_source(&input[0], CHUNK_BYTES);
+                zs.next_in = &input[0];
+            }
+            zs.next_out = &buffer[0];
+            zs.avail_out = (uInt)CHUNK_BYTES;
+            // A pipe that has run dry for now gets what it sent so far
+            // flushed out, rather than held until deflate's buffer fills
+            int rc = deflate(&zs, zs.avail_in == 0 ? Z_FINISH : short_read ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+            fill = CHUNK_BYTES - zs.avail_out;
+            input_done = rc == Z_STREAM_END || rc == Z_STREAM_ERROR;
+        }
+        return fill > 0;
+    }
+
+    FILE* file;
+    std::string text;
+    size_t text_pos;
+    int64_t known_size;
+    PayloadCodec codec;
+    z_stream zs;
+    bool deflating;
+    bool input_done; // deflate has written its final block
+    bool short_read; // the last stdin read returned less than asked for
+    std::vector<uint8_t> input;
+    size_t pos;
+    size_t fill;
+    uint64_t consumed;
+    uint64_t source_read;
+    std::vector<uint8_t> buffer;
+};
+
+// Bit iterator over a payload, raw or framed and coded
+class PayloadBits {
+public:
+    PayloadBits(PayloadReader& reader, bool framed, FecScheme scheme)
+        : reader(reader), framed(framed), encoder(scheme), scheme(scheme), next(0), frame_index(0),
+          finished(false), truncated_input(false), last_byte(0) {}
+
+    // Next bit on the wire; false once the payload is exhausted
+    bool next_bit(uint8_t& bit) {
+        if (next == pending.size() && !refill()) return false;
+        bit = pending[next++];
+        return true;
+    }
+
+    // Total coded bits, or -1 when the input size is unknown
+    int64_t total_bits() const {
+        int64_t bytes = reader.size();
+        if (bytes < 0) return -1;
+        if (!framed) return bytes * 8;
+        return (int64_t)coded_frame_bits(std::min((uint64_t)bytes, MAX_FRAMED_BYTES), scheme);
+    }
+
+    uint64_t bytes_read() const { return reader.bytes_read(); }
+    uint8_t current_byte() const { return last_byte; }
+    // Framed input beyond MAX_FRAMED_BYTES was not sent
+    bool truncated() const { return truncated_input; }
+
+private:
+    bool refill() {
+        pending.clear();
+        next = 0;
+        if (finished) return false;
+        if (!framed) {
+            uint8_t byte;
+            if (reader.read(&byte, 1) == 0) {
+                finished = true;
+                return false;
+            }
+            last_byte = byte;
+            append_bits(pending, byte, 8);
+            return true;
+        }
+
+        // One frame per refill; the last-frame flag needs a look ahead
+        uint8_t payload[FRAME_PAYLOAD_BYTES];
+        size_t length = reader.read(payload, FRAME_PAYLOAD_BYTES);
+        bool last = reader.at_end() || frame_index + 1 == MAX_FRAMED_BYTES / FRAME_PAYLOAD_BYTES;
+        if (last && !reader.at_end()) truncated_input = true;
+        if (length > 0) last_byte = payload[length - 1];
+        std::vector<uint8_t> frame;
+        append_frame(frame, frame_index++, payload, length, last);
+        encoder.encode(frame, pending);
+        if (last) {
+            encoder.finish(pending);
+            finished = true;
+        }
+        return !pending.empty();
+    }
+
+    PayloadReader& reader;
+    bool framed;
+    FecEncoder encoder;
+    FecScheme scheme;
+    std::vector<uint8_t> pending;
+    size_t next;
+    unsigned frame_index;
+    bool finished;
+    bool truncated_input;
+    uint8_t last_byte;
+};
+
+// Receiver side: inflates a payload as its bytes are decoded. A lost or
+// misread byte makes the stream fail; what was inflated before stays valid.
+class PayloadInflater {
+public:
+    PayloadInflater() : active(false), failed_flag(false), done(false) {}
+    ~PayloadInflater() { reset(); }
+
+    void reset() {
+        if (active) inflateEnd(&zs);
+        active = false;
+        failed_flag = false;
+        done = false;
+    }
+
+    // Appends whatever `length` more compressed bytes make available to `out`;
+    // returns false once the stream is corrupt
+    bool push(const uint8_t* data, size_t length, std::string& out) {
+        if (failed_flag) return false;
+        if (!active) {
+            zs = z_stream();
+            if (inflateInit(&zs) != Z_OK) {
+                failed_flag = true;
+                return false;
+            }
+            active = true;
+        }
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = (uInt)length;
+        uint8_t chunk[4096];
+        do {
+            if (done) break; // bytes after the end of the stream are padding
+            zs.next_out = chunk;
+            zs.avail_out = sizeof(chunk);
+            int rc = inflate(&zs, Z_NO_FLUSH);
+            out.append((const char*)chunk, sizeof(chunk) - zs.avail_out);
+            if (rc == Z_STREAM_END) {
+                done = true;
+            } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+                failed_flag = true;
+                return false;
+            }
+        } while (zs.avail_out == 0);
+        return true;
+    }
+
+    bool failed() const { return failed_flag; }
+    // The stream ended with a valid checksum
+    bool finished() const { return done; }
+
+private:
+    z_stream zs;
+    bool active;
+    bool failed_flag;
+    bool done;
+};
+
+#endif
@@ -3,312 +3,1983 @@
 #include <string>
 #include <iomanip>
 #include <fstream>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
-#ifdef _WIN32
-    #ifndef _WIN32_WINNT
-        #define _WIN32_WINNT 0x0600
-    #endif
-    #define WIN32_LEAN_AND_MEAN
-    #include <winsock2.h>
-    #include <ws2tcpip.h>
-    #include <cstdint> 
-    #define close closesocket
-    typedef int socklen_t;
-#else
-    #include <sys/socket.h>
-    #include <arpa/inet.h>
-    #include <unistd.h>
-    #define SOCKET int
-    #define INVALID_SOCKET -1
-    #define closesocket close
+#include "arrivallog.h"
+#include "binlog.h"
+#include "clock.h"
+#include "dataset.h"
+#include "detectors.h"
+#include "symbols.h"
+#include "framing.h"
+#include "jitter.h"
+#include "payload.h"
+#include "reorder.h"
+#include "rt.h"
+#include "transport.h"
+
+#ifdef __linux__
+    #include <sys/epoll.h>
 #endif
 
-#pragma pack(push, 1)
-struct CovertPacket {
-    uint32_t sequence_number;
-    uint8_t packet_type; // 0 = data, 1 = probe
+// Older 5- and 7-byte packets carry no flags: an uncompressed payload
+PayloadCodec packet_codec(const CovertPacket& packet, int length)
+{
+    return length >= (int)sizeof(CovertPacket) ? (PayloadCodec)(packet.flags & PACKET_CODEC_MASK) : CODEC_NONE;
+}
+
+const bool DEBUG = false;     // per-packet decode lines
+const int SUMMARY_INTERVAL = 500;
+
+// Socket receive buffer requested for logging, large enough to absorb bursts
+// while the log is written.
+const int LOG_RCVBUF_BYTES = 8 * 1024 * 1024;
+// How often an idle logging loop checks for Ctrl+C
+const int STOP_POLL_MS = 200;
+// How often multi-flow mode flushes logs and looks for ended messages
+const int SWEEP_INTERVAL_MS = 1000;
+// IATs between -detect scores unless WINDOW_SIZE:STRIDE says otherwise
+const size_t DETECT_STRIDE = 64;
+
+// One line per detector score, over the window ending at `seq_num`
+void print_detector_scores(size_t window_index, uint32_t seq_num, const DetectorScores& scores)
+{
+    std::cout << "Window " << window_index << " (Seq " << seq_num << "):" << std::fixed << std::setprecision(3);
+    for (size_t k = 0; k < DEFAULT_EPSILON_COUNT; ++k)
+    {
+        std::cout << " eps" << format_double(DEFAULT_EPSILONS[k]) << "=" << scores.epsilon[k];
+    }
+    std::cout << " compress=" << scores.compressibility
+              << " mean=" << scores.mean << "ms std=" << scores.stddev << "ms";
+    if (scores.ks == scores.ks)
+    {
+        std::cout << " ks=" << scores.ks;
+    }
+    std::cout << std::endl;
+}
+
+void run_logging_mode(int port, const std::string& logfile, TimestampSource requested_source, bool binary,
+                      const LogRotation& rotation, TransportKind transport, OnlineDetector* detector = NULL)
+{
+    std::cout << "=== LOGGING MODE ===" << std::endl;
+    std::cout << "Port: " << port << std::endl;
+    std::cout << "Log file: " << logfile << (binary ? " (binary)" : "") << std::endl;
+    if (rotation.max_bytes > 0)
+        std::cout << "Rotation: every " << rotation.max_bytes / (1024 * 1024.0) << " MiB" << std::endl;
+    else if (rotation.max_ns > 0)
+        std::cout << "Rotation: every " << rotation.max_ns / 1e9 << " s of arrivals" << std::endl;
+    std::cout << "====================" << std::endl;
+
+    NetSession net;
+    if (!net.ok())
+    {
+        std::cout << "WSAStartup failed" << std::endl;
+        return;
+    }
+
+    std::string error;
+    SOCKET recvSocket = open_receive_socket(port, error);
+    if (recvSocket == INVALID_SOCKET)
+    {
+        std::cout << error << std::endl;
+        return;
+    }
+
+    RxTimestamps ts;
+    ts.source = enable_timestamps(recvSocket, requested_source);
+    ts.resolved = ts.source != TS_HARDWARE;
+    std::cout << "Timestamp source: " << timestamp_source_name(ts.source) << std::endl;
+
+    // Formatting and disk writes happen on the log's writer thread
+    ArrivalLog log;
+    if (!log.start(logfile, binary, rotation, (uint16_t)port, (uint8_t)ts.source, timestamp_source_name(ts.source),
+                   clock_resolution_ns(ts.source), wall_clock_ns(), source_clock_ns(ts.source)))
+    {
+        std::cout << "Error: Cannot open log file " << logfile << std::endl;
+        closesocket(recvSocket);
+        return;
+    }
+
+    int rcvbuf = LOG_RCVBUF_BYTES;
+    setsockopt(recvSocket, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(rcvbuf));
+
+    enter_rt_profile();
+    apply_rt_socket(recvSocket);
+
+    std::cout << "Logging receiver waiting for packets..." << std::endl;
+    std::cout << "Press Ctrl+C to stop logging." << std::endl;
+
+    int64_t last_arrival_ns = 0;
+    uint32_t last_seq_num = 0;
+    bool first_packet = true;
+    int packets_logged = 0;
+
+    size_t windows_scored = 0; // each slides `stride` IATs past the one before
+
+    auto log_arrival = [&](const CovertPacket& packet, int64_t arrival_ns)
+    {
+        uint32_t seq_num = ntohl(packet.sequence_number);
+        uint8_t pkt_type = packet.packet_type;
+
+        DetectorScores scores;
+        if (detector && !first_packet && detector->push((arrival_ns - last_arrival_ns) / 1e6, scores))
+        {
+            print_detector_scores(windows_scored++, seq_num, scores);
+        }
+
+        if (!first_packet)
+            meter_sequence(metrics_shard(), last_seq_num, seq_num);
+        if (first_packet)
+        {
+            std::cout << "First packet received (Seq: " << seq_num << ", Type: " << (int)pkt_type << ")" << std::endl;
+            // The first packet has settled the source, so hardware downgrades are recorded
+            log.set_timestamp_source((uint8_t)ts.source, timestamp_source_name(ts.source));
+        }
+        log.push(seq_num, pkt_type, arrival_ns);
+
+        packets_logged++;
+        if (packets_logged % 1000 == 0)
+        {
+            std::cout << "Logged packet " << seq_num << " (Total: " << packets_logged
+                     << ", IAT: " << std::fixed << std::setprecision(1) << (arrival_ns - last_arrival_ns) / 1e6 << "ms)" << std::endl;
+        }
+        last_arrival_ns = arrival_ns;
+        last_seq_num = seq_num;
+        first_packet = false;
+    };
+
+    std::string note;
+    PacketReceiver* receiver = open_receiver(transport, recvSocket, ts, note);
+    std::cout << "Receive path: " << receiver->describe() << (note.empty() ? "" : ", " + note) << std::endl;
+
+    // Wakes up now and then so Ctrl+C is noticed even on an idle port
+    install_stop_handler();
+    receiver->set_timeout(STOP_POLL_MS);
+    while (!stop_requested())
+    {
+        int count = receiver->receive();
+        for (int i = 0; i < count; ++i)
+        {
+            log_arrival(receiver->packet(i), receiver->arrival_ns(i));
+        }
+    }
+
+    std::cout << std::endl << "Stopping, writing out the log..." << std::endl;
+    delete receiver;
+    closesocket(recvSocket);
+    log.stop();
+    std::cout << "Packets logged: " << log.written_count();
+    if (log.part_count() > 1)
+        std::cout << " in " << log.part_count() << " files";
+    std::cout << std::endl;
+    if (log.dropped_count() > 0)
+        std::cout << "Warning: " << log.dropped_count() << " arrivals dropped, the log writer fell behind" << std::endl;
+}
+
+// Profiles a sender -probe run without logging it: streaming interval
+// statistics, then the delays and thresholds they support for `bits` bits
+// per packet. Ends on Ctrl+C or once probes stop for MESSAGE_TIMEOUT.
+void run_profile_mode(int port, int bits, TimestampSource requested_source, TransportKind transport)
+{
+    std::cout << "=== PROFILE MODE ===" << std::endl;
+    std::cout << "Port: " << port << std::endl;
+    std::cout << "Bits per packet: " << bits << std::endl;
+    std::cout << "====================" << std::endl;
+
+    NetSession net;
+    if (!net.ok())
+    {
+        std::cout << "WSAStartup failed" << std::endl;
+        return;
+    }
+
+    std::string error;
+    SOCKET recvSocket = open_receive_socket(port, error);
+    if (recvSocket == INVALID_SOCKET)
+    {
+        std::cout << error << std::endl;
+        return;
+    }
+
+    RxTimestamps ts;
+    ts.source = enable_timestamps(recvSocket, requested_source);
+    ts.resolved = ts.source != TS_HARDWARE;
+    std::cout << "Timestamp source: " << timestamp_source_name(ts.source) << std::endl;
+
+    int rcvbuf = LOG_RCVBUF_BYTES;
+    setsockopt(recvSocket, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(rcvbuf));
+
+    enter_rt_profile();
+    apply_rt_socket(recvSocket);
+
+    std::string note;
+    PacketReceiver* receiver = open_receiver(transport, recvSocket, ts, note);
+    std::cout << "Receive path: " << receiver->describe() << (note.empty() ? "" : ", " + note) << std::endl;
+    std::cout << "Waiting for probe packets (Ctrl+C to finish early)..." << std::endl;
+
+    const int64_t message_timeout_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(MESSAGE_TIMEOUT).count();
+    JitterProfile profile;
+    size_t ignored = 0;
+    int64_t last_probe_ns = 0;
+    uint32_t last_probe_seq = 0;
+
+    install_stop_handler();
+    receiver->set_timeout(STOP_POLL_MS);
+    while (!stop_requested())
+    {
+        int count = receiver->receive();
+        for (int i = 0; i < count; ++i)
+        {
+            const CovertPacket& packet = receiver->packet(i);
+            if (packet.packet_type != 1)
+            {
+                ignored++;
+                continue;
+            }
+            uint32_t seq_num = ntohl(packet.sequence_number);
+            if (profile.received() == 0)
+                std::cout << "First probe received (Seq: " << seq_num << ")" << std::endl;
+            else
+                meter_sequence(metrics_shard(), last_probe_seq, seq_num);
+            profile.push(seq_num, receiver->arrival_ns(i));
+            last_probe_seq = seq_num;
+            last_probe_ns = receiver->arrival_ns(i);
+            if (profile.received() % 1000 == 0)
+            {
+                std::cout << "Probes: " << profile.received() << std::fixed << std::setprecision(3)
+                          << " mean=" << profile.mean_ms() << "ms std=" << profile.stddev_ms() << "ms" << std::endl;
+            }
+        }
+        if (profile.received() > 0 && source_clock_ns(ts.source) - last_probe_ns > message_timeout_ns)
+            break;
+    }
+    delete receiver;
+    closesocket(recvSocket);
+
+    std::cout << std::endl << "=== JITTER PROFILE ===" << std::endl;
+    std::cout << "Probes received: " << profile.received() << " (lost " << profile.lost_count()
+              << ", reordered " << profile.reordered_count() << ", duplicated " << profile.duplicate_count() << ")" << std::endl;
+    if (ignored > 0)
+        std::cout << "Non-probe packets ignored: " << ignored << std::endl;
+    if (profile.interval_count() < 10)
+    {
+        std::cout << "Error: Only " << profile.interval_count() << " usable intervals, need at least 10" << std::endl;
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Intervals: " << profile.interval_count() << std::endl;
+    std::cout << "Mean: " << profile.mean_ms() << "ms, StdDev: " << profile.stddev_ms() << "ms" << std::endl;
+    std::cout << "Min: " << profile.min_ms() << "ms, Max: " << profile.max_ms() << "ms" << std::endl;
+    std::cout << "Percentiles: p1=" << profile.percentile_ms(1) << "ms p50=" << profile.percentile_ms(50)
+              << "ms p90=" << profile.percentile_ms(90) << "ms p99=" << profile.percentile_ms(99)
+              << "ms p99.9=" << profile.percentile_ms(99.9) << "ms" << std::endl;
+    double p99_deviation = profile.deviation_ms(99);
+    std::cout << "Deviation from median: p90=" << profile.deviation_ms(90) << "ms p99=" << p99_deviation << "ms" << std::endl;
+    std::cout << "Lag-1 autocorrelation: " << profile.autocorrelation() << std::endl;
+
+    // Same spacing rule as sender -levels-from, from the probe delay up
+    double base_ms = std::round(profile.percentile_ms(50) * 10.0) / 10.0;
+    std::vector<double> levels = levels_from_deviation(p99_deviation, base_ms, bits);
+    std::vector<double> thresholds = level_thresholds(levels);
+    std::cout << std::defaultfloat << std::setprecision(6);
+    std::cout << "Recommended delays: " << format_ms_list(levels) << "ms" << std::endl;
+    std::cout << "Recommended threshold" << (thresholds.size() > 1 ? "s: " : ": ") << format_ms_list(thresholds) << "ms" << std::endl;
+    if (bits == 1)
+        std::cout << "  sender <IP> " << port << " \"<MESSAGE>\" " << levels[0] << " " << levels[1] << std::endl;
+    else
+        std::cout << "  sender -levels " << format_ms_list(levels) << " <IP> " << port << " \"<MESSAGE>\"" << std::endl;
+    std::cout << "  receiver " << port << " " << format_ms_list(thresholds) << " " << timestamp_source_name(ts.source) << std::endl;
+}
+
+// Converts a -logbin file to the CSV written by -log. Records are taken in
+// arrival order, or sorted by sequence number when `by_seq` is set.
+int run_bin2csv_mode(const std::string& binfile, const std::string& csvfile, bool by_seq)
+{
+    BinLogHeader header;
+    std::vector<BinLogRecord> records;
+    std::string error;
+    if (!read_binlog(binfile, header, records, error))
+    {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
+    }
+
+    if (by_seq)
+    {
+        std::stable_sort(records.begin(), records.end(),
+                         [](const BinLogRecord& a, const BinLogRecord& b) { return a.sequence_number < b.sequence_number; });
+    }
+
+    FILE* out = fopen(csvfile.c_str(), "w");
+    if (!out)
+    {
+        std::cout << "Error: Cannot open output file " << csvfile << std::endl;
+        return 1;
+    }
+
+    fprintf(out, "# timestamp_source=%s\n", timestamp_source_name((TimestampSource)header.timestamp_source));
+    fprintf(out, "Time\n");
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        if (i == 0)
+            fprintf(out, "0.0\n");
+        else
+            fprintf(out, "%.3f\n", (records[i].arrival_ns - records[i - 1].arrival_ns) / 1e6);
+    }
+    fclose(out);
+
+    std::cout << "Converted " << records.size() << " records from " << binfile << " (port " << header.port
+              << ", " << timestamp_source_name((TimestampSource)header.timestamp_source) << " timestamps) to "
+              << csvfile << std::endl;
+    return 0;
+}
+
+void print_thresholds(const ThresholdTracker& tracker)
+{
+    const std::vector<double>& thresholds = tracker.thresholds();
+    std::cout << (thresholds.size() == 1 ? "Threshold: " : "Thresholds: ");
+    if (tracker.is_automatic())
+        std::cout << "auto from training preamble, until then ";
+    std::cout << format_ms_list(thresholds) << "ms";
+    if (tracker.symbol_bits() > 1)
+        std::cout << " (" << tracker.symbol_bits() << " bits per packet)";
+    std::cout << std::endl;
+}
+
+// Collects a training interval, whose level follows from its distance to the
+// message's initial packet.
+void add_training_interval(ThresholdTracker& tracker, uint32_t seq_num, uint32_t message_start_seq, double iat_ms)
+{
+    if (tracker.is_automatic())
+    {
+        unsigned levels = 1u << tracker.symbol_bits();
+        tracker.add_training((seq_num - message_start_seq - 1) % levels, iat_ms);
+    }
+}
+
+// Fits the collected preamble, if any, before the first data packet is decoded
+void calibrate_from_training(ThresholdTracker& tracker, const std::string& label)
+{
+    if (tracker.pending_training() == 0) return;
+    size_t intervals = tracker.pending_training();
+    double misread = 0.0;
+    size_t bit_errors = 0;
+    if (tracker.calibrate(misread, &bit_errors))
+    {
+        MetricsShard& metrics = metrics_shard();
+        metrics.add(METRIC_TRAINING_BITS, intervals * tracker.symbol_bits());
+        metrics.add(METRIC_TRAINING_BIT_ERRORS, bit_errors);
+        std::cout << label << "Calibrated from " << intervals << " training intervals: centres "
+                  << format_ms_list(tracker.level_centres()) << "ms, thresholds " << format_ms_list(tracker.thresholds())
+                  << "ms, training misread " << std::fixed << std::setprecision(1) << misread * 100.0 << "%" << std::endl;
+    }
+    else
+    {
+        std::cout << label << "Calibration failed (" << intervals << " training intervals), keeping thresholds "
+                  << format_ms_list(tracker.thresholds()) << "ms" << std::endl;
+    }
+}
+
+// Where a MessageDecoder's symbols go
+class SymbolSink {
+public:
+    virtual ~SymbolSink() {}
+    // The message's first packet, in sequence order
+    virtual void begin(const Arrival& first) = 0;
+    virtual void symbol(unsigned symbol, int bits) = 0;
+    // `bits` bits of symbols lost to a sequence gap or an unusable interval
+    virtual void erased(size_t bits) = 0;
+    // Payload bytes decoded so far, for progress lines
+    virtual size_t decoded_bytes() const = 0;
+};
+
+// Decodes one sender's message: decode mode runs one, -multi one per flow,
+// so both make the same decisions. Arrivals are put back in sequence order
+// by a ReorderBuffer, the training preamble calibrates the tracker, and
+// decode_interval() decides what each data interval yields. Console lines
+// start with `label`; with `progress` set a summary line is printed every
+// SUMMARY_INTERVAL packets.
+class MessageDecoder {
+public:
+    MessageDecoder(const ThresholdTracker& tracker, const std::string& label, bool progress, SymbolSink& sink)
+        : tracker(tracker), label(label), progress(progress), sink(sink), active(false), last_rx(0)
+    {
+        clear();
+    }
+
+    // A long pause, or a sequence number far behind the reorder window,
+    // means the sender has started over
+    bool restarts(uint32_t seq_num, int64_t arrival_ns, int64_t message_timeout_ns) const
+    {
+        return active && (arrival_ns - last_rx > message_timeout_ns ||
+                          (int32_t)(reorder.highest_seq() - seq_num) > (int32_t)ReorderBuffer::REORDER_WINDOW);
+    }
+
+    // Takes one arrival in receive order and decodes whatever it releases
+    void push(const Arrival& arrival)
+    {
+        if (!active) {
+            reorder.reset();
+            clear();
+            active = true;
+        }
+        last_rx = arrival.arrival_ns;
+
+        MetricsShard& metrics = metrics_shard();
+        size_t reordered_before = reorder.reordered();
+        PushResult pushed = reorder.push(arrival);
+        if (pushed != PUSH_HELD) {
+            if (pushed == PUSH_LATE) metrics.add(METRIC_OUT_OF_ORDER, 1);
+            std::cout << label << "Seq: " << arrival.seq_num
+                      << (pushed == PUSH_LATE ? ", late, dropped" : ", duplicate dropped") << std::endl;
+            return;
+        }
+        metrics.add(METRIC_OUT_OF_ORDER, reorder.reordered() - reordered_before);
+        release(false);
+    }
+
+    // Decodes everything still held, e.g. once nothing can still be in flight
+    void drain() { release(true); }
+
+    // Ends the message; the next push starts a new one
+    void finish()
+    {
+        drain();
+        active = false;
+    }
+
+    bool in_message() const { return active; }
+    int64_t last_rx_ns() const { return last_rx; } // latest arrival in receive order
+    int64_t start_ns() const { return message_start_ns; }
+    int64_t last_arrival_ns() const { return last_arrival; } // last released in sequence order
+    size_t packets() const { return total_packets; }
+    size_t lost_packets() const { return lost; }
+    size_t erased_symbols() const { return erased; }
+    size_t split_intervals() const { return splits; }
+    const ReorderBuffer& sequence() const { return reorder; }
+    const ThresholdTracker& thresholds() const { return tracker; }
+
+private:
+    void clear()
+    {
+        previous = Arrival();
+        message_start_ns = 0;
+        message_start_seq = 0;
+        last_arrival = 0;
+        total_packets = 0;
+        lost = 0;
+        erased = 0;
+        splits = 0;
+    }
+
+    void release(bool flush)
+    {
+        Arrival arrival;
+        while (reorder.pop(arrival, flush))
+            process(arrival);
+    }
+
+    void emit_symbol(unsigned symbol)
+    {
+        metrics_shard().add(METRIC_SYMBOLS_DECODED, 1);
+        sink.symbol(symbol, tracker.symbol_bits());
+    }
+
+    void emit_erased(size_t symbols)
+    {
+        erased += symbols;
+        metrics_shard().add(METRIC_SYMBOLS_ERASED, symbols);
+        sink.erased(symbols * tracker.symbol_bits());
+    }
+
+    // Handles packets in sequence order
+    void process(const Arrival& arrival)
+    {
+        const int symbol_bits = tracker.symbol_bits();
+        if (total_packets == 0) {
+            tracker.clear_training();
+            message_start_ns = arrival.arrival_ns;
+            message_start_seq = arrival.seq_num;
+            std::cout << label << "Received initial packet with Seq Num: " << arrival.seq_num << std::endl;
+            sink.begin(arrival);
+        } else {
+            MetricsShard& metrics = metrics_shard();
+            double time_diff_ms = (arrival.arrival_ns - previous.arrival_ns) / 1e6;
+            uint32_t gap = arrival.seq_num - previous.seq_num - 1;
+            bool reliable = !arrival.late && !previous.late && time_diff_ms >= 0;
+            lost += gap;
+            if (gap > 0) {
+                metrics.add(METRIC_SEQ_GAPS, 1);
+                metrics.add(METRIC_PACKETS_LOST, gap);
+                std::cout << label << "Seq: " << arrival.seq_num << ", " << gap << " packet(s) lost" << std::endl;
+            }
+
+            if (arrival.packet_type == PACKET_TYPE_TRAINING) {
+                if (reliable && gap == 0)
+                    add_training_interval(tracker, arrival.seq_num, message_start_seq, time_diff_ms);
+            } else if (arrival.packet_type == 0) { // Only decode data packets
+                calibrate_from_training(tracker, label);
+                size_t symbols;
+                unsigned symbol;
+                IntervalDecision decision = decode_interval(tracker, previous, arrival, symbol, symbols);
+                if (decision == INTERVAL_SYMBOL) {
+                    if (DEBUG)
+                        std::cout << label << "Seq: " << arrival.seq_num << ", Time: " << std::fixed << std::setprecision(1)
+                                  << time_diff_ms << "ms, " << (symbol_bits == 1 ? "Bit: " : "Symbol: ") << symbol << std::endl;
+                    emit_symbol(symbol);
+                } else if (decision == INTERVAL_SPLIT) {
+                    std::cout << label << "Seq: " << arrival.seq_num << ", Time: " << std::fixed << std::setprecision(1)
+                              << time_diff_ms << "ms split into two " << (symbol_bits == 1 ? "bits: " : "symbols: ")
+                              << symbol << std::endl;
+                    emit_symbol(symbol);
+                    emit_symbol(symbol);
+                    splits++;
+                } else {
+                    std::cout << label << "Seq: " << arrival.seq_num << ", " << symbols << " symbol(s) erased"
+                              << (reliable ? "" : " (out of order)") << std::endl;
+                    emit_erased(symbols);
+                }
+            }
+        }
+
+        previous = arrival;
+        last_arrival = arrival.arrival_ns;
+        total_packets++;
+        if (progress && total_packets % SUMMARY_INTERVAL == 0) {
+            std::cout << label << "Received " << total_packets << " packets (" << lost << " lost, " << erased
+                      << " symbols erased), " << sink.decoded_bytes() << " bytes decoded" << std::endl;
+        }
+    }
+
+    ThresholdTracker tracker;
+    std::string label;
+    bool progress;
+    SymbolSink& sink;
+    ReorderBuffer reorder;
+    bool active;
+    int64_t last_rx;
+    Arrival previous;
+    int64_t message_start_ns;
+    uint32_t message_start_seq;
+    int64_t last_arrival;
+    size_t total_packets;
+    size_t lost;
+    size_t erased;
+    size_t splits;
+};
+
+// Decoded payload output. The decode loop only copies bytes into a
+// preallocated single-producer/single-consumer ring; a writer thread streams
+// them to a file or stdout, so console and disk I/O never hold up the next
+// arrival. When the writer falls behind, bytes are counted and dropped.
+class OutputSink {
+public:
+    static const size_t CAPACITY = 1 << 20;
+
+    OutputSink() : ring(CAPACITY), head(0), tail(0), dropped(0), stopping(false), out(NULL) {}
+
+    ~OutputSink() { stop(); }
+
+    // "-" streams to stdout; a file is appended to, one message after another
+    bool start(const std::string& path)
+    {
+        out = path == "-" ? stdout : fopen(path.c_str(), "ab");
+        if (!out)
+            return false;
+        writer = std::thread(&OutputSink::drain_loop, this);
+        return true;
+    }
+
+    void write(const char* data, size_t length)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t room = ring.size() - (h - tail.load(std::memory_order_acquire));
+        if (length > room) {
+            dropped += length - room;
+            length = room;
+        }
+        for (size_t i = 0; i < length; ++i)
+            ring[(h + i) % ring.size()] = data[i];
+        head.store(h + length, std::memory_order_release);
+    }
+
+    void write(const std::string& text) { write(text.data(), text.size()); }
+
+    // Waits until everything written so far is out, e.g. before a summary
+    void flush()
+    {
+        while (writer.joinable() && tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    void stop()
+    {
+        if (!writer.joinable())
+            return;
+        stopping.store(true);
+        writer.join();
+        if (out != stdout)
+            fclose(out);
+        out = NULL;
+    }
+
+    size_t dropped_count() const { return dropped; }
+
+private:
+    void drain()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        while (t != h) {
+            size_t begin = t % ring.size();
+            size_t length = std::min(h - t, ring.size() - begin);
+            fwrite(&ring[begin], 1, length, out);
+            t += length;
+        }
+        fflush(out);
+        tail.store(t, std::memory_order_release);
+    }
+
+    void drain_loop()
+    {
+        while (!stopping.load()) {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        drain();
+    }
+
+    std::vector<char> ring;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    size_t dropped;
+    std::atomic<bool> stopping;
+    FILE* out;
+    std::thread writer;
+};
+
+// Writes decoded frames to an OutputSink in index order as they pass CRC,
+// inflating them first when the payload is compressed. As in
+// assemble_frames, the frames after a lost one are still written; a
+// compressed stream cannot be inflated past the gap and stops there.
+class FrameOutput {
+public:
+    FrameOutput() : codec(CODEC_NONE), inflated_through(0), written(0), stopped(false) {}
+
+    // `hold` as for FrameSequencer
+    void reset(PayloadCodec new_codec, size_t hold)
+    {
+        codec = new_codec;
+        sequencer.reset(hold);
+        inflater.reset();
+        inflated_through = 0;
+        written = 0;
+        stopped = false;
+    }
+
+    void add(const std::vector<DecodedFrame>& frames, OutputSink& output)
+    {
+        for (size_t i = 0; i < frames.size(); ++i)
+            sequencer.add(frames[i], ready);
+        write(output);
+    }
+
+    void finish(OutputSink& output)
+    {
+        sequencer.finish(ready);
+        write(output);
+    }
+
+    const FrameStats& stats() const { return sequencer.stats(); }
+    size_t output_bytes() const { return written; }
+    bool inflate_stopped() const { return stopped; }
+    bool inflate_finished() const { return inflater.finished(); }
+
+private:
+    void write(OutputSink& output)
+    {
+        for (size_t i = 0; i < ready.size(); ++i) {
+            const DecodedFrame& frame = ready[i];
+            if (codec == CODEC_NONE) {
+                output.write(frame.payload);
+                written += frame.payload.size();
+                continue;
+            }
+            if (stopped)
+                continue;
+            if (frame.index != inflated_through) {
+                stopped = true;
+                std::cout << "Frame " << inflated_through << " lost, decompression stops here" << std::endl;
+                continue;
+            }
+            inflated_through = frame.index + 1;
+            if (!inflater.push((const uint8_t*)frame.payload.data(), frame.payload.size(), plain)) {
+                stopped = true;
+                std::cout << "Compressed stream corrupt in frame " << frame.index << ", decompression stops here"
+                          << std::endl;
+            }
+            output.write(plain);
+            written += plain.size();
+            plain.clear();
+        }
+        ready.clear();
+    }
+
+    PayloadCodec codec;
+    FrameSequencer sequencer;
+    PayloadInflater inflater;
+    std::vector<DecodedFrame> ready;
+    std::string plain;
+    unsigned inflated_through; // frames inflated so far
+    size_t written;
+    bool stopped;
+};
+
+// Decode mode's symbols. Raw bytes are streamed to the output as they
+// complete, inflated first when the payload is compressed; with `framed` set
+// the bits are FEC-decoded and each frame is written once its CRC checks.
+class DecodeSink : public SymbolSink {
+public:
+    DecodeSink(bool framed, FecScheme fec, OutputSink& output)
+        : framed(framed), fec(fec), output(output), frame_decoder(fec), codec(CODEC_NONE), bytes_in(0), bytes_out(0),
+          stopped(false)
+    {
+    }
+
+    void begin(const Arrival& first)
+    {
+        codec = first.codec;
+        bits.clear();
+        bits.set_keep_nul(codec != CODEC_NONE);
+        decoded.clear();
+        bytes_in = 0;
+        bytes_out = 0;
+        inflater.reset();
+        inflated.clear();
+        stopped = false;
+        frame_decoder.reset(fec);
+        frame_output.reset(codec, 0);
+        if (codec != CODEC_NONE)
+            std::cout << "Payload codec: " << codec_name(codec) << std::endl;
+    }
+
+    void symbol(unsigned symbol, int symbol_bits)
+    {
+        if (framed) {
+            frame_decoder.push_symbol(symbol, symbol_bits, frames);
+            take_frames();
+            return;
+        }
+        size_t erased_before = bits.erased_bytes();
+        if (bits.push(symbol, symbol_bits, decoded))
+            take_bytes(erased_before);
+    }
+
+    void erased(size_t count)
+    {
+        if (framed) {
+            frame_decoder.push_erased(count, frames);
+            take_frames();
+            return;
+        }
+        size_t erased_before = bits.erased_bytes();
+        if (bits.push_erased((int)count, decoded))
+            take_bytes(erased_before);
+    }
+
+    size_t decoded_bytes() const { return framed ? frame_output.stats().payload_bytes : bytes_in; }
+
+    // Ends the message: a framed one has its last frames decoded and written
+    void finish()
+    {
+        if (!framed)
+            return;
+        frame_decoder.finish(frames);
+        take_frames();
+        frame_output.finish(output);
+    }
+
+    bool empty() const { return framed ? frame_decoder.coded_bits() == 0 : bytes_in == 0; }
+    size_t output_bytes() const { return framed ? frame_output.output_bytes() : bytes_out; }
+    PayloadCodec payload_codec() const { return codec; }
+    const FrameStats& frame_stats() const { return frame_output.stats(); }
+    uint64_t coded_bits() const { return frame_decoder.coded_bits(); }
+
+    void print_decompression() const
+    {
+        bool finished = framed ? frame_output.inflate_finished() : inflater.finished();
+        bool damaged = framed ? frame_output.inflate_stopped() : stopped;
+        std::cout << "Compressed (" << codec_name(codec) << "): " << decoded_bytes() << " bytes, inflated to "
+                  << output_bytes() << " bytes, "
+                  << (finished ? "checksum ok" : damaged ? "stream damaged" : "stream incomplete") << std::endl;
+    }
+
+private:
+    void take_frames()
+    {
+        frame_output.add(frames, output);
+        frames.clear();
+    }
+
+    // Passes newly decoded bytes to the output, inflating them first when
+    // the payload is compressed
+    void take_bytes(size_t erased_before)
+    {
+        size_t from = bytes_in;
+        bytes_in += decoded.size();
+        if (codec == CODEC_NONE) {
+            output.write(decoded);
+            bytes_out += decoded.size();
+        } else if (!stopped) {
+            if (bits.erased_bytes() != erased_before) {
+                stopped = true;
+                std::cout << "Compressed byte " << from << " lost, decompression stops here" << std::endl;
+            } else if (!inflater.push((const uint8_t*)decoded.data(), decoded.size(), inflated)) {
+                stopped = true;
+                std::cout << "Compressed stream corrupt at byte " << from << ", decompression stops here" << std::endl;
+            }
+        }
+        if (!inflated.empty()) {
+            output.write(inflated);
+            bytes_out += inflated.size();
+            inflated.clear();
+        }
+        decoded.clear();
+    }
+
+    bool framed;
+    FecScheme fec;
+    OutputSink& output;
+
+    // Raw mode decodes into a scratch buffer that is handed to the output
+    // byte by byte; only counters outlive it
+    BitAccumulator bits;
+    std::string decoded;
+
+    // Framed mode decodes the coded bits as they arrive, lost symbols
+    // erased, and writes each frame out once its CRC checks
+    FrameDecoder frame_decoder;
+    FrameOutput frame_output;
+    std::vector<DecodedFrame> frames;
+
+    // A compressed payload is inflated as its bytes are decoded
+    PayloadCodec codec;
+    PayloadInflater inflater;
+    std::string inflated;
+    size_t bytes_in; // as received, before inflating
+    size_t bytes_out;
+    bool stopped;
+};
+
+// With `framed` set, the bit stream carries framing.h frames coded with `fec`.
+// Decoded payloads are streamed to `output_path` ("-" for stdout).
+void run_decode_mode(int port, ThresholdTracker tracker, TimestampSource requested_source, bool framed, FecScheme fec,
+                     const std::string& output_path, TransportKind transport)
+{
+    const int symbol_bits = tracker.symbol_bits();
+    std::cout << "=== DECODE MODE ===" << std::endl;
+    std::cout << "Port: " << port << std::endl;
+    print_thresholds(tracker);
+    if (framed)
+        std::cout << "Framing: on, FEC: " << fec_name(fec) << std::endl;
+    std::cout << "Output: " << (output_path == "-" ? "stdout" : output_path) << std::endl;
+    std::cout << "==================" << std::endl;
+
+    OutputSink output;
+    if (!output.start(output_path)) {
+        std::cout << "Error: Cannot open output file " << output_path << std::endl;
+        return;
+    }
+
+    NetSession net;
+    if (!net.ok()) {
+        std::cout << "WSAStartup failed" << std::endl;
+        return;
+    }
+
+    std::string error;
+    SOCKET recvSocket = open_receive_socket(port, error);
+    if (recvSocket == INVALID_SOCKET) {
+        std::cout << error << std::endl;
+        return;
+    }
+    
+    RxTimestamps ts;
+    ts.source = enable_timestamps(recvSocket, requested_source);
+    ts.resolved = ts.source != TS_HARDWARE;
+    std::cout << "Timestamp source: " << timestamp_source_name(ts.source) << std::endl;
+
+    enter_rt_profile();
+    apply_rt_socket(recvSocket);
+
+    std::string note;
+    PacketReceiver* receiver = open_receiver(transport, recvSocket, ts, note);
+    std::cout << "Receive path: " << receiver->describe() << (note.empty() ? "" : ", " + note) << std::endl;
+
+    std::cout << "Receiver waiting for packets..." << std::endl;
+
+    const int64_t message_timeout_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(MESSAGE_TIMEOUT).count();
+    DecodeSink sink(framed, fec, output);
+    MessageDecoder decoder(tracker, "", true, sink);
+
+    auto finish_message = [&]()
+    {
+        decoder.finish();
+        sink.finish();
+        if (sink.empty())
+            return;
+        output.flush();
+
+        double total_time_ms = (decoder.last_arrival_ns() - decoder.start_ns()) / 1e6;
+        std::cout << "\n=== MESSAGE COMPLETE ===" << std::endl;
+        std::cout << "Message length: " << sink.output_bytes() << " bytes" << std::endl;
+        if (sink.payload_codec() != CODEC_NONE)
+            sink.print_decompression();
+        if (framed)
+        {
+            const FrameStats& stats = sink.frame_stats();
+            std::cout << "Frames: " << stats.frames_ok << "/" << stats.frames_expected << " passed CRC";
+            for (size_t i = 0; i < stats.missing.size() && i < 20; ++i)
+                std::cout << (i ? "," : " (lost: ") << stats.missing[i];
+            std::cout << (stats.missing.empty() ? "" : stats.missing.size() > 20 ? ",...)" : ")") << std::endl;
+            std::cout << "Erased symbols: " << decoder.erased_symbols() << " of " << sink.coded_bits() / symbol_bits
+                      << std::endl;
+        }
+        else if (decoder.erased_symbols() > 0)
+        {
+            std::cout << "Erased symbols: " << decoder.erased_symbols() << std::endl;
+        }
+        std::cout << "Total time: " << std::fixed << std::setprecision(1) << total_time_ms << "ms" << std::endl;
+        if (framed && total_time_ms > 0)
+        {
+            std::cout << "Channel rate: " << sink.coded_bits() * 1000.0 / total_time_ms << " bit/s, goodput: "
+                      << sink.frame_stats().payload_bytes * 8 * 1000.0 / total_time_ms << " bit/s (FEC " << fec_name(fec)
+                      << ")" << std::endl;
+        }
+        const ReorderBuffer& sequence = decoder.sequence();
+        std::cout << "Packets: " << decoder.packets() << " received, " << decoder.lost_packets() << " lost, "
+                  << sequence.duplicates() << " duplicate, " << sequence.reordered() << " reordered, " << sequence.late()
+                  << " late, " << decoder.split_intervals() << " merged interval(s) split" << std::endl;
+        if (output.dropped_count() > 0)
+            std::cout << "Output: " << output.dropped_count() << " bytes dropped, writer too slow" << std::endl;
+        if (decoder.thresholds().is_calibrated())
+            std::cout << "Tracked thresholds: " << format_ms_list(decoder.thresholds().thresholds()) << "ms" << std::endl;
+        std::cout << "=======================" << std::endl;
+    };
+
+    // Wake up regularly so a message is reported once the sender goes quiet
+    receiver->set_timeout(1000);
+
+    while (true) {
+        int count = receiver->receive();
+        if (count <= 0) {
+            if (decoder.in_message() && source_clock_ns(ts.source) - decoder.last_rx_ns() > message_timeout_ns)
+                finish_message();
+            else if (decoder.in_message())
+                decoder.drain(); // Nothing is still in flight after a quiet second
+            continue;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const CovertPacket& packet = receiver->packet(i);
+            Arrival arrival = Arrival();
+            arrival.seq_num = ntohl(packet.sequence_number);
+            arrival.packet_type = packet.packet_type;
+            arrival.codec = packet_codec(packet, receiver->length(i));
+            arrival.arrival_ns = receiver->arrival_ns(i);
+            if (decoder.restarts(arrival.seq_num, arrival.arrival_ns, message_timeout_ns))
+                finish_message();
+            decoder.push(arrival);
+        }
+    }
+
+    delete receiver;
+    closesocket(recvSocket);
+}
+
+// Multi-flow receiver: one event loop over a range of ports, demultiplexing
+// packets by receiving port, sender address and flow id. Each flow keeps its
+// own arrival history, MessageDecoder and log file, so many concurrent
+// experiments can share one process and one core.
+struct FlowKey {
+    uint16_t local_port;
+    uint32_t sender_ip; // network byte order
+    uint16_t flow_id;
+
+    bool operator<(const FlowKey& other) const
+    {
+        if (local_port != other.local_port) return local_port < other.local_port;
+        if (sender_ip != other.sender_ip) return sender_ip < other.sender_ip;
+        return flow_id < other.flow_id;
+    }
+};
+
+class StripeAssembler;
+
+// Arrival-order state for the flow's log, and a MessageDecoder whose symbols
+// come back to the flow: as text for print_flow_message, or as coded bits
+// for `stripes`.
+struct FlowState : public SymbolSink {
+    FlowState(const FlowKey& key, const std::string& name, const ThresholdTracker& tracker, StripeAssembler* stripes)
+        : key(key), name(name), source(TS_USER), first_packet(true), last_arrival_ns(0), last_seq_num(0),
+          packets_logged(0), decoder(tracker, "[" + name + "] ", false, *this), stripes(stripes), in_stripe(false),
+          stripe_frames(0)
+    {
+    }
+
+    void begin(const Arrival& first);
+    void symbol(unsigned symbol, int symbol_bits);
+    void erased(size_t count);
+    size_t decoded_bytes() const { return decoded_message.size(); }
+
+    FlowKey key;
+    std::string name;    // "<port>/<sender ip>#<flow id>" for console output
+    std::ofstream log;
+    TimestampSource source; // clock behind last_arrival_ns
+    bool first_packet;
+    int64_t last_arrival_ns;
+    uint32_t last_seq_num;
+    int packets_logged;
+
+    MessageDecoder decoder;
+    StripeAssembler* stripes;
+    std::string decoded_message;
+    BitAccumulator bits;
+
+    FrameDecoder frames; // -fec: decodes this flow's coded bits, lost symbols erased
+    bool in_stripe;      // its message is part of an open StripeAssembler group
+    size_t stripe_frames; // frames decoded from it in that stripe
+};
+
+struct BoundPort {
+    SOCKET sock;
+    int port;
+    RxTimestamps ts;
+    PacketReceiver* receiver; // reads `sock`, stamping with `ts`
+};
+
+// Opens one flow's log, named <prefix>_<port>_<sender ip>_<flow id>.csv
+FlowState* open_flow(const FlowKey& key, const std::string& log_prefix, const ThresholdTracker* decoder,
+                     StripeAssembler* stripes)
+{
+    char ip[INET_ADDRSTRLEN] = "0.0.0.0";
+    in_addr addr;
+    addr.s_addr = key.sender_ip;
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+
+    std::string name = std::to_string(key.local_port) + "/" + ip + "#" + std::to_string(key.flow_id);
+    FlowState* flow = new FlowState(key, name, decoder ? *decoder : ThresholdTracker(), stripes);
+
+    std::string filename = log_prefix + "_" + std::to_string(key.local_port) + "_" + ip + "_"
+                         + std::to_string(key.flow_id) + ".csv";
+    flow->log.open(filename.c_str());
+    std::cout << "New flow " << flow->name << " -> " << filename << std::endl;
+    if (!flow->log.is_open())
+    {
+        std::cout << "Warning: Cannot open log file " << filename << ", flow " << flow->name << " is not logged" << std::endl;
+    }
+    return flow;
+}
+
+void print_flow_message(const FlowState& flow)
+{
+    if (flow.decoded_message.empty()) return;
+    std::cout << "[" << flow.name << "] Message complete: \"" << flow.decoded_message << "\" ("
+              << flow.decoded_message.length() << " characters, " << std::fixed << std::setprecision(1)
+              << (flow.decoder.last_arrival_ns() - flow.decoder.start_ns()) / 1e6 << "ms)" << std::endl;
+}
+
+// Puts striped transfers (sender -stripe) back together. Each flow carries
+// framed, FEC-coded bits, decoded as they arrive; every frame that passes
+// CRC joins the group of its sender and receiving port, which writes frames
+// out in index order. A frame ahead of a gap waits until the gap fills from
+// another flow, or until STRIPE_HOLD_FRAMES wait and the gap is given up as
+// lost. Once no flow of the group is still in progress the group is
+// reported, with any missing frames listed. Groups share one output, so
+// concurrent senders to the same port range interleave their frames.
+class StripeAssembler {
+public:
+    static const size_t STRIPE_HOLD_FRAMES = 256;
+
+    StripeAssembler(FecScheme fec, const std::string& output_path) : fec(fec), output_path(output_path) {}
+
+    bool start() { return output.start(output_path); }
+
+    void begin(FlowState& flow, PayloadCodec codec, int64_t start_ns)
+    {
+        Group& group = groups[group_key(flow.key)];
+        if (group.active == 0 && group.flows == 0) {
+            group.start_ns = start_ns;
+            group.end_ns = start_ns;
+            group.codec = codec;
+            group.coded_bits = 0;
+            group.frames.reset(codec, STRIPE_HOLD_FRAMES);
+        }
+        group.active++;
+        flow.in_stripe = true;
+        flow.stripe_frames = 0;
+        flow.frames.reset(fec);
+    }
+
+    // The flow's next symbol, or `bits` erased bits for lost ones
+    void add_symbol(FlowState& flow, unsigned symbol, int bits)
+    {
+        flow.frames.push_symbol(symbol, bits, decoded);
+        take(flow);
+    }
+
+    void add_erased(FlowState& flow, size_t bits)
+    {
+        flow.frames.push_erased(bits, decoded);
+        take(flow);
+    }
+
+    void end(FlowState& flow)
+    {
+        if (!flow.in_stripe) return;
+        flow.in_stripe = false;
+        std::map<GroupKey, Group>::iterator it = groups.find(group_key(flow.key));
+        if (it == groups.end()) return;
+        Group& group = it->second;
+        flow.frames.finish(decoded);
+        take(flow);
+        std::cout << "[" << flow.name << "] Stripe ended: " << flow.stripe_frames << " frames" << std::endl;
+        group.flows++;
+        group.coded_bits += flow.frames.coded_bits();
+        group.end_ns = std::max(group.end_ns, flow.last_arrival_ns);
+        if (--group.active == 0) {
+            group.frames.finish(output);
+            report(it->first, group);
+            groups.erase(it);
+        }
+    }
+
+private:
+    typedef std::pair<uint16_t, uint32_t> GroupKey; // receiving port, sender IP
+
+    struct Group {
+        Group() : active(0), flows(0), start_ns(0), end_ns(0), codec(CODEC_NONE), coded_bits(0) {}
+        int active;   // flows whose message is still in progress
+        size_t flows; // flows that have ended so far
+        FrameOutput frames;
+        int64_t start_ns;
+        int64_t end_ns;
+        PayloadCodec codec;
+        uint64_t coded_bits;
+    };
+
+    static GroupKey group_key(const FlowKey& key) { return GroupKey(key.local_port, key.sender_ip); }
+
+    // Hands the frames `flow` has just decoded to its group
+    void take(FlowState& flow)
+    {
+        if (decoded.empty()) return;
+        flow.stripe_frames += decoded.size();
+        std::map<GroupKey, Group>::iterator it = groups.find(group_key(flow.key));
+        if (it != groups.end())
+            it->second.frames.add(decoded, output);
+        decoded.clear();
+    }
+
+    void report(const GroupKey& key, const Group& group)
+    {
+        char ip[INET_ADDRSTRLEN] = "0.0.0.0";
+        in_addr addr;
+        addr.s_addr = key.second;
+        inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+        double total_time_ms = (group.end_ns - group.start_ns) / 1e6;
+        const FrameStats& stats = group.frames.stats();
+        output.flush();
+
+        std::cout << "\n=== STRIPED MESSAGE " << key.first << "/" << ip << " ===" << std::endl;
+        std::cout << "Flows: " << group.flows << std::endl;
+        std::cout << "Frames: " << stats.frames_ok << "/" << stats.frames_expected << " passed CRC";
+        for (size_t i = 0; i < stats.missing.size() && i < 20; ++i)
+            std::cout << (i ? "," : " (lost: ") << stats.missing[i];
+        std::cout << (stats.missing.empty() ? "" : stats.missing.size() > 20 ? ",...)" : ")") << std::endl;
+        if (group.codec != CODEC_NONE)
+            std::cout << "Compressed (" << codec_name(group.codec) << "): " << stats.payload_bytes << " bytes, "
+                      << (group.frames.inflate_finished() ? "checksum ok"
+                          : group.frames.inflate_stopped() ? "stream damaged" : "stream incomplete") << std::endl;
+        std::cout << "Total time: " << std::fixed << std::setprecision(1) << total_time_ms << "ms" << std::endl;
+        if (total_time_ms > 0)
+            std::cout << "Channel rate: " << group.coded_bits * 1000.0 / total_time_ms << " bit/s over all flows, goodput: "
+                      << stats.payload_bytes * 8 * 1000.0 / total_time_ms << " bit/s (FEC " << fec_name(fec) << ")" << std::endl;
+        std::cout << "Message: " << group.frames.output_bytes() << " bytes written to "
+                  << (output_path == "-" ? "stdout" : output_path) << std::endl;
+        if (output.dropped_count() > 0)
+            std::cout << "Output: " << output.dropped_count() << " bytes dropped, writer too slow" << std::endl;
+    }
+
+    FecScheme fec;
+    std::string output_path;
+    OutputSink output;
+    std::map<GroupKey, Group> groups;
+    std::vector<DecodedFrame> decoded;
 };
-#pragma pack(pop)
 
-const auto MESSAGE_TIMEOUT = std::chrono::milliseconds(5000);
+void FlowState::begin(const Arrival& first)
+{
+    decoded_message.clear();
+    bits.clear();
+    if (stripes)
+        stripes->begin(*this, first.codec, first.arrival_ns);
+}
+
+void FlowState::symbol(unsigned symbol, int symbol_bits)
+{
+    if (stripes)
+        stripes->add_symbol(*this, symbol, symbol_bits);
+    else
+        bits.push(symbol, symbol_bits, decoded_message);
+}
 
-void run_logging_mode(int port, const std::string& logfile)
+void FlowState::erased(size_t count)
 {
-    std::cout << "=== LOGGING MODE ===" << std::endl;
-    std::cout << "Port: " << port << std::endl;
-    std::cout << "Log file: " << logfile << std::endl;
-    std::cout << "====================" << std::endl;
+    if (stripes)
+        stripes->add_erased(*this, count);
+    else
+        bits.push_erased((int)count, decoded_message);
+}
+
+// Decodes what the flow still holds and reports its message
+void finish_flow_message(FlowState& flow)
+{
+    flow.decoder.finish();
+    print_flow_message(flow);
+    flow.decoded_message.clear();
+    flow.bits.clear();
+    if (flow.stripes)
+        flow.stripes->end(flow);
+}
+
+// Logs one arrival and, with `decode` set, decodes it through the flow's
+// MessageDecoder, exactly as decode mode does. `length` is the datagram's
+// size, which tells older packets apart.
+void handle_flow_packet(FlowState& flow, const CovertPacket& packet, int length, int64_t arrival_ns,
+                        TimestampSource source, bool decode, int64_t message_timeout_ns)
+{
+    uint32_t seq_num = ntohl(packet.sequence_number);
 
-    std::ofstream log(logfile);
-    if (!log.is_open())
+    flow.source = source;
+    if (flow.first_packet)
     {
-        std::cout << "Error: Cannot open log file " << logfile << std::endl;
-        return;
+        flow.log << "# timestamp_source=" << timestamp_source_name(source) << '\n';
+        flow.log << "Time" << '\n';
+        flow.log << "0.0" << '\n';
+    }
+    else
+    {
+        // A decoding flow's MessageDecoder counts these in sequence order
+        if (!decode)
+            meter_sequence(metrics_shard(), flow.last_seq_num, seq_num);
+        double iat_ms = (arrival_ns - flow.last_arrival_ns) / 1e6;
+        flow.log << std::fixed << std::setprecision(3) << iat_ms << '\n';
+    }
+    flow.packets_logged++;
+    if (flow.packets_logged % 100 == 0)
+    {
+        flow.log.flush();
+    }
+
+    if (decode)
+    {
+        Arrival arrival = Arrival();
+        arrival.seq_num = seq_num;
+        arrival.packet_type = packet.packet_type;
+        arrival.codec = packet_codec(packet, length);
+        arrival.arrival_ns = arrival_ns;
+        if (flow.decoder.restarts(seq_num, arrival_ns, message_timeout_ns))
+            finish_flow_message(flow);
+        flow.decoder.push(arrival);
     }
 
-    log << "Time" << std::endl;
+    flow.first_packet = false;
+    flow.last_arrival_ns = arrival_ns;
+    flow.last_seq_num = seq_num;
+}
 
-#ifdef _WIN32
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+// Run about once a second so quiet flows still reach disk and a message is
+// reported once its flow has been silent for MESSAGE_TIMEOUT, without
+// waiting for the flow's next packet. Arrivals held for reordering are
+// decoded once their flow has been quiet for a sweep.
+void sweep_idle_flows(std::map<FlowKey, FlowState*>& flows, int64_t message_timeout_ns)
+{
+    for (std::map<FlowKey, FlowState*>::iterator it = flows.begin(); it != flows.end(); ++it)
     {
-        std::cout << "WSAStartup failed" << std::endl;
+        FlowState& flow = *it->second;
+        flow.log.flush();
+        if (!flow.decoder.in_message())
+            continue;
+        int64_t quiet_ns = source_clock_ns(flow.source) - flow.decoder.last_rx_ns();
+        if (quiet_ns > message_timeout_ns)
+            finish_flow_message(flow);
+        else if (quiet_ns > SWEEP_INTERVAL_MS * 1000000LL)
+            flow.decoder.drain();
+    }
+}
+
+// Parses one threshold, the 3, 7 or 15 increasing thresholds of an M-ary
+// sender (it prints them as "Receiver thresholds: ..."), or "auto[:K]" to fit
+// K-bit thresholds to the sender's -calibrate preamble. Until a preamble
+// arrives, auto decodes as if the levels spanned the sender's default
+// 50-150ms. Reports errors itself.
+bool parse_thresholds(const std::string& text, ThresholdTracker& tracker)
+{
+    if (text == "auto" || text.compare(0, 5, "auto:") == 0)
+    {
+        int bits = text == "auto" ? 1 : atoi(text.c_str() + 5);
+        if (bits < 1 || bits > MAX_SYMBOL_BITS)
+        {
+            std::cout << "Error: auto:K needs K between 1 and " << MAX_SYMBOL_BITS << std::endl;
+            return false;
+        }
+        tracker.set_automatic(bits, even_levels(50.0, 150.0, bits));
+        return true;
+    }
+    std::vector<double> thresholds;
+    if (!parse_ms_list(text, thresholds) || symbol_bits_for_levels(thresholds.size() + 1) == 0)
+    {
+        std::cout << "Error: Thresholds must be 1, 3, 7 or 15 increasing values in ms (e.g. 100 or 30,50,70) or auto[:K]" << std::endl;
+        return false;
+    }
+    tracker.set_fixed(thresholds);
+    return true;
+}
+
+// Parses "PORT" or "FIRST-LAST"
+bool parse_port_range(const std::string& text, int& first_port, int& last_port)
+{
+    size_t dash = text.find('-');
+    first_port = atoi(text.substr(0, dash).c_str());
+    last_port = dash == std::string::npos ? first_port : atoi(text.substr(dash + 1).c_str());
+    return first_port > 0 && last_port >= first_port && last_port <= 65535;
+}
+
+// `decoder` is the threshold setup each new flow starts from, or NULL to only log.
+// With `framed` set, flows carry sender -stripe frames coded with `fec`, and
+// each sender's payload is reassembled from all its flows and written to
+// `output_path` ("-" for stdout).
+void run_multi_flow_mode(int first_port, int last_port, const std::string& log_prefix,
+                         const ThresholdTracker* decoder, TimestampSource requested_source, TransportKind transport,
+                         bool framed, FecScheme fec, const std::string& output_path)
+{
+    std::cout << "=== MULTI-FLOW MODE ===" << std::endl;
+    std::cout << "Ports: " << first_port << "-" << last_port << std::endl;
+    std::cout << "Log prefix: " << log_prefix << std::endl;
+    if (decoder)
+        print_thresholds(*decoder);
+    StripeAssembler assembler(fec, output_path);
+    StripeAssembler* stripes = decoder && framed ? &assembler : NULL;
+    if (stripes)
+        std::cout << "Striped frames: on, FEC: " << fec_name(fec) << std::endl;
+    std::cout << "=======================" << std::endl;
+    if (stripes && !stripes->start())
+    {
+        std::cout << "Error: Cannot open output file " << output_path << std::endl;
         return;
     }
-#endif
 
-    SOCKET recvSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (recvSocket == INVALID_SOCKET)
+    NetSession net;
+    if (!net.ok())
     {
-        std::cout << "Unable to create socket" << std::endl;
-#ifdef _WIN32
-        WSACleanup();
-#endif
+        std::cout << "WSAStartup failed" << std::endl;
         return;
     }
 
-    sockaddr_in recvAddr;
-    recvAddr.sin_family = AF_INET;
-    recvAddr.sin_port = htons(port);
-    recvAddr.sin_addr.s_addr = INADDR_ANY;
+    std::vector<BoundPort> ports;
+    for (int port = first_port; port <= last_port; ++port)
+    {
+        BoundPort bound;
+        bound.port = port;
+        bound.receiver = NULL;
+        std::string error;
+        bound.sock = open_receive_socket(port, error);
+        if (bound.sock == INVALID_SOCKET)
+        {
+            std::cout << error << std::endl;
+            break;
+        }
 
-    if (bind(recvSocket, (sockaddr*)&recvAddr, sizeof(recvAddr)) == -1)
+        bound.ts.source = enable_timestamps(bound.sock, requested_source);
+        bound.ts.resolved = bound.ts.source != TS_HARDWARE;
+        int rcvbuf = LOG_RCVBUF_BYTES;
+        setsockopt(bound.sock, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(rcvbuf));
+        ports.push_back(bound);
+    }
+    if (ports.size() != (size_t)(last_port - first_port + 1))
     {
-        std::cout << "Bind failed." << std::endl;
-        closesocket(recvSocket);
-#ifdef _WIN32
-        WSACleanup();
-#endif
+        for (size_t i = 0; i < ports.size(); ++i)
+            closesocket(ports[i].sock);
         return;
     }
+    std::cout << "Timestamp source: " << timestamp_source_name(ports[0].ts.source) << std::endl;
 
-    std::cout << "Logging receiver waiting for packets..." << std::endl;
-    std::cout << "Press Ctrl+C to stop logging." << std::endl;
-
-    CovertPacket packet;
-    sockaddr_in senderAddr;
-    socklen_t senderAddrSize = sizeof(senderAddr);
+    enter_rt_profile();
+    for (size_t i = 0; i < ports.size(); ++i)
+        apply_rt_socket(ports[i].sock);
 
-    auto last_arrival_time = std::chrono::high_resolution_clock::now();
-    bool first_packet = true;
-    int packets_logged = 0;
+    const int64_t message_timeout_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(MESSAGE_TIMEOUT).count();
+    std::map<FlowKey, FlowState*> flows;
+    long long total_packets = 0;
+    int64_t last_sweep = now_ns();
+    auto maybe_sweep = [&]()
+    {
+        int64_t now = now_ns();
+        if (now - last_sweep >= SWEEP_INTERVAL_MS * 1000000LL)
+        {
+            sweep_idle_flows(flows, message_timeout_ns);
+            last_sweep = now;
+        }
+    };
 
-    while (true)
+    auto dispatch = [&](BoundPort& bound, const CovertPacket& packet, int length, const sockaddr_in& sender,
+                        int64_t arrival_ns)
     {
-        int bytesReceived = recvfrom(recvSocket, (char*)&packet, sizeof(packet), 0, (sockaddr*)&senderAddr, &senderAddrSize);
-        if (bytesReceived > 0)
+        FlowKey key;
+        key.local_port = (uint16_t)bound.port;
+        key.sender_ip = sender.sin_addr.s_addr;
+        key.flow_id = packet_flow_id(packet, length);
+
+        std::map<FlowKey, FlowState*>::iterator it = flows.find(key);
+        if (it == flows.end())
         {
-            auto arrival_time = std::chrono::high_resolution_clock::now();
-            uint32_t seq_num = ntohl(packet.sequence_number);
-            uint8_t pkt_type = packet.packet_type;
+            it = flows.insert(std::make_pair(key, open_flow(key, log_prefix, decoder, stripes))).first;
+        }
+        handle_flow_packet(*it->second, packet, length, arrival_ns, bound.ts.source, decoder != NULL, message_timeout_ns);
+
+        if (++total_packets % 10000 == 0)
+        {
+            std::cout << "Received " << total_packets << " packets across " << flows.size() << " flows" << std::endl;
+        }
+    };
+
+    // Each port's receiver is polled after the loop below sees it ready
+    std::string note;
+    for (size_t i = 0; i < ports.size(); ++i)
+    {
+        ports[i].receiver = open_receiver(transport, ports[i].sock, ports[i].ts, note);
+        ports[i].receiver->set_timeout(0);
+    }
+    std::cout << "Receive path: " << ports[0].receiver->describe() << (note.empty() ? "" : ", " + note) << std::endl;
 
-            if (first_packet)
+    // Drains what one ready port has queued
+    auto receive_ready = [&](BoundPort& bound)
+    {
+        int count = bound.receiver->receive();
+        for (int i = 0; i < count; ++i)
+        {
+            if (bound.receiver->length(i) >= (int)offsetof(CovertPacket, flow_id))
             {
-                std::cout << "First packet received (Seq: " << seq_num << ", Type: " << (int)pkt_type << ")" << std::endl;
-                log << "0.0" << std::endl;
-                first_packet = false;
+                dispatch(bound, bound.receiver->packet(i), bound.receiver->length(i), bound.receiver->sender(i),
+                         bound.receiver->arrival_ns(i));
             }
-            else
-            {
-                auto inter_arrival_time = std::chrono::duration<double, std::milli>(arrival_time - last_arrival_time);
-                double iat_ms = inter_arrival_time.count();
+        }
+    };
 
-                log << std::fixed << std::setprecision(3) << iat_ms << std::endl;
+    std::cout << "Multi-flow receiver waiting for packets on " << ports.size() << " port(s)..." << std::endl;
+    std::cout << "Press Ctrl+C to stop." << std::endl;
+    install_stop_handler();
 
+#ifdef __linux__
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+    {
+        std::cout << "epoll_create1 failed" << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < ports.size(); ++i)
+    {
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ports[i].receiver->wait_handle(), &ev);
+    }
 
-                if (packets_logged % 1000 == 0)
-                {
-                    std::cout << "Logged packet " << seq_num << " (Total: " << packets_logged + 1 
-                             << ", IAT: " << std::fixed << std::setprecision(1) << iat_ms << "ms)" << std::endl;
-                }
+    epoll_event events[64];
+    while (!stop_requested())
+    {
+        int ready = epoll_wait(epoll_fd, events, 64, SWEEP_INTERVAL_MS);
+        for (int i = 0; i < ready; ++i)
+        {
+            receive_ready(ports[events[i].data.u32]);
+        }
+        maybe_sweep();
+    }
+    close(epoll_fd);
+#else
+    // select() elsewhere; Windows limits a set to FD_SETSIZE (64) sockets
+    while (!stop_requested())
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        SOCKET max_sock = 0;
+        for (size_t i = 0; i < ports.size(); ++i)
+        {
+            FD_SET(ports[i].sock, &readable);
+            if (ports[i].sock > max_sock) max_sock = ports[i].sock;
+        }
+        timeval timeout;
+        timeout.tv_sec = SWEEP_INTERVAL_MS / 1000;
+        timeout.tv_usec = 0;
+        if (select((int)max_sock + 1, &readable, NULL, NULL, &timeout) > 0)
+        {
+            for (size_t i = 0; i < ports.size(); ++i)
+            {
+                if (FD_ISSET(ports[i].sock, &readable))
+                    receive_ready(ports[i]);
             }
+        }
+        maybe_sweep();
+    }
+#endif
+
+    for (std::map<FlowKey, FlowState*>::iterator it = flows.begin(); it != flows.end(); ++it)
+    {
+        if (decoder)
+            finish_flow_message(*it->second);
+        delete it->second;
+    }
+    for (size_t i = 0; i < ports.size(); ++i)
+    {
+        delete ports[i].receiver;
+        closesocket(ports[i].sock);
+    }
+}
 
-            last_arrival_time = arrival_time;
-            packets_logged++;
+// Word wrap as Python's textwrap.wrap(text, width) does it for printable
+// ASCII, so decoded_message.txt matches what offline_decode.py wrote. The
+// text is split into chunks by textwrap's word separator rules (space runs,
+// em-dashes, words that may break after a hyphen), lines are filled
+// greedily, spaces at line breaks are dropped and over-long words are
+// broken, after their last hyphen if possible.
+inline bool is_letter(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; } // \w minus digits
+inline bool is_word_char(char c) { return is_letter(c) || (c >= '0' && c <= '9'); }
+inline bool is_word_punct(char c) { return is_word_char(c) || (c && strchr("!\"'&.,?", c) != NULL); }
 
-            if (packets_logged % 100 == 0)
-            {
-                log.flush();
+std::vector<std::string> wrap_text(const std::string& text, size_t width)
+{
+    const char* s = text.c_str(); // NUL-terminated, so look-aheads stop at the end
+    auto dashes_then_word = [&](size_t at) {
+        size_t end = at;
+        while (s[end] == '-') ++end;
+        return end - at >= 2 && is_word_char(s[end]);
+    };
+
+    std::vector<std::string> chunks;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = pos + 1;
+        if (s[pos] == ' ') {
+            while (s[end] == ' ') ++end;
+        } else if (pos > 0 && is_word_punct(s[pos - 1]) && dashes_then_word(pos)) {
+            while (s[end] == '-') ++end; // em-dash between words
+        } else {
+            // Shortest word that ends at a hyphen between letters, a space or
+            // the end, or just before an em-dash
+            for (;; ++end) {
+                if (s[end] == '-' && ((is_letter(s[end - 1]) && end >= 2 && is_letter(s[end - 2])) ||
+                                      (is_letter(s[end - 1]) && end >= 3 && s[end - 2] == '-' && is_letter(s[end - 3]))) &&
+                    is_letter(s[end + 1]) && (is_letter(s[end + 2]) || (s[end + 2] == '-' && is_letter(s[end + 3])))) {
+                    ++end;
+                    break;
+                }
+                if (end == text.size() || s[end] == ' ') break;
+                if (is_word_punct(s[end - 1]) && dashes_then_word(end)) break;
             }
         }
+        chunks.push_back(text.substr(pos, end - pos));
+        pos = end;
     }
 
-    // Clean up
-    closesocket(recvSocket);
-#ifdef _WIN32
-    WSACleanup();
-#endif
-    
-    // Temporarily undefine the macro to allow log.close()
-#ifdef _WIN32
-    #undef close
-#endif
-    log.close();
-#ifdef _WIN32
-    #define close closesocket  // Restore the macro
-#endif
+    std::vector<std::string> lines;
+    size_t next = 0;
+    while (next < chunks.size()) {
+        if (chunks[next][0] == ' ' && !lines.empty()) ++next;
+        std::string line;
+        while (next < chunks.size() && line.size() + chunks[next].size() <= width) line += chunks[next++];
+        bool empty_piece = false;
+        if (next < chunks.size() && chunks[next].size() > width) {
+            std::string& chunk = chunks[next];
+            size_t end = width - line.size();
+            size_t hyphen = end > 0 ? chunk.rfind('-', end - 1) : std::string::npos;
+            if (hyphen != std::string::npos && hyphen > 0 && chunk.find_first_not_of('-') < hyphen) end = hyphen + 1;
+            line += chunk.substr(0, end);
+            chunk.erase(0, end);
+            // A full line takes an empty piece, and textwrap then drops that
+            // piece instead of the trailing space chunk
+            empty_piece = end == 0;
+        }
+        size_t last = line.find_last_not_of(' ');
+        if (!empty_piece && line.size() > 0 && line[line.size() - 1] == ' ') {
+            // Only the trailing space chunk goes, as textwrap drops it whole
+            line.erase(last == std::string::npos ? 0 : last + 1);
+        }
+        if (line.empty()) continue;
+        lines.push_back(line);
+    }
+    return lines;
 }
 
-void run_decode_mode(int port, double threshold_ms)
+// Offline decoding of a -log CSV or -logbin file, the native replacement for
+// offline_decode.py. The log is taken as one message: its first interval
+// (the initial packet, logged as 0.0) is skipped as the live decoder skips
+// it, and every later one is decoded at the fixed thresholds through the
+// same decode_level rule, in SSE2 batches. Writes decoded_bits.txt and
+// decoded_message.txt (printable ASCII, other bytes as '?', wrapped at 70).
+int run_offline_mode(const std::string& logfile, const ThresholdTracker& tracker)
 {
-    std::cout << "=== DECODE MODE ===" << std::endl;
-    std::cout << "Port: " << port << std::endl;
-    std::cout << "Threshold: " << threshold_ms << "ms" << std::endl;
-    std::cout << "==================" << std::endl;
+    if (tracker.is_automatic())
+    {
+        std::cout << "Error: Offline decoding needs fixed thresholds; a log has no training labels" << std::endl;
+        return 1;
+    }
+    const std::vector<double>& thresholds = tracker.thresholds();
+    const int symbol_bits = tracker.symbol_bits();
 
-#ifdef _WIN32
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        std::cout << "WSAStartup failed" << std::endl;
-        return;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<double> iats;
+    std::string error;
+    if (!load_iats(logfile, iats, error))
+    {
+        std::cout << "Error: " << error << std::endl;
+        return 1;
     }
-#endif
+    const double* intervals = iats.empty() ? NULL : &iats[1];
+    size_t count = iats.empty() ? 0 : iats.size() - 1;
 
-    SOCKET recvSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (recvSocket == INVALID_SOCKET) {
-        std::cout << "Unable to create socket" << std::endl;
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return;
+    std::string bit_text;
+    std::vector<uint8_t> bytes;
+    if (symbol_bits == 1)
+    {
+        bytes.resize(count / 8);
+        if (!bytes.empty())
+            decode_bytes(thresholds[0], intervals, count, &bytes[0]);
+        bit_text.reserve(count);
+        for (size_t i = 0; i < bytes.size(); ++i)
+            for (int b = 7; b >= 0; --b)
+                bit_text += (char)('0' + ((bytes[i] >> b) & 1));
+        for (size_t i = bytes.size() * 8; i < count; ++i)
+            bit_text += (char)('0' + decode_level(thresholds, intervals[i]));
+    }
+    else
+    {
+        std::vector<uint8_t> symbols(count);
+        if (count > 0)
+            decode_symbols(thresholds, intervals, count, &symbols[0]);
+        bit_text.reserve(count * symbol_bits);
+        for (size_t i = 0; i < count; ++i)
+            for (int b = symbol_bits - 1; b >= 0; --b)
+                bit_text += (char)('0' + ((symbols[i] >> b) & 1));
+        bytes.resize(bit_text.size() / 8);
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            unsigned byte = 0;
+            for (int b = 0; b < 8; ++b)
+                byte = (byte << 1) | (unsigned)(bit_text[i * 8 + b] - '0');
+            bytes[i] = (uint8_t)byte;
+        }
     }
 
-    sockaddr_in recvAddr;
-    recvAddr.sin_family = AF_INET;
-    recvAddr.sin_port = htons(port);
-    recvAddr.sin_addr.s_addr = INADDR_ANY; 
+    std::string message(bytes.size(), '?');
+    size_t printable = 0;
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        if (bytes[i] >= 32 && bytes[i] <= 126)
+        {
+            message[i] = (char)bytes[i];
+            printable++;
+        }
+    }
 
-    if (bind(recvSocket, (sockaddr*)&recvAddr, sizeof(recvAddr)) == -1) {
-        std::cout << "Bind failed." << std::endl;
-        closesocket(recvSocket);
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return;
+    FILE* bits_file = fopen("decoded_bits.txt", "w");
+    FILE* message_file = fopen("decoded_message.txt", "w");
+    if (!bits_file || !message_file)
+    {
+        std::cout << "Error: Cannot write decoded_bits.txt / decoded_message.txt" << std::endl;
+        if (bits_file) fclose(bits_file);
+        if (message_file) fclose(message_file);
+        return 1;
     }
-    
-    std::cout << "Receiver waiting for packets..." << std::endl;
-    
-    CovertPacket packet;
-    sockaddr_in senderAddr;
-    socklen_t senderAddrSize = sizeof(senderAddr);
+    fwrite(bit_text.data(), 1, bit_text.size(), bits_file);
+    fclose(bits_file);
+    std::vector<std::string> lines = wrap_text(message, 70);
+    for (size_t i = 0; i < lines.size(); ++i)
+        fprintf(message_file, "%s\n", lines[i].c_str());
+    fclose(message_file);
 
-    auto last_arrival_time = std::chrono::high_resolution_clock::now();
-    bool first_packet = true;
-    
-    std::string decoded_message = "";
-    uint8_t current_byte = 0;
-    int bit_count = 0;
-    uint32_t last_seq_num = 0;
-    
-    auto message_start_time = std::chrono::high_resolution_clock::now();
-    int total_packets_received = 0;
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "=== OFFLINE DECODE ===" << std::endl;
+    std::cout << "Log: " << logfile << " (" << count << " intervals after the initial packet)" << std::endl;
+    print_thresholds(tracker);
+    std::cout << "Decoded: " << bit_text.size() << " bits, " << bytes.size() << " bytes ("
+              << printable << " printable)" << std::endl;
+    std::cout << "Wrote decoded_bits.txt and decoded_message.txt in " << std::fixed << std::setprecision(1)
+              << elapsed_ms << "ms" << std::endl;
+    return 0;
+}
 
-    while (true) {
-        int bytesReceived = recvfrom(recvSocket, (char*)&packet, sizeof(packet), 0, (sockaddr*)&senderAddr, &senderAddrSize);
-        if (bytesReceived > 0) {
-            auto arrival_time = std::chrono::high_resolution_clock::now();
-            uint32_t seq_num = ntohl(packet.sequence_number);
+int main(int argc, char *argv[]) {
+    init_timestamp_clock();
 
-            bool is_new_message = false;
-            
-            if (!first_packet) {
-                auto time_since_last = std::chrono::duration<double, std::milli>(arrival_time - last_arrival_time);
-                
-                if (time_since_last.count() > 5000.0 || seq_num <= last_seq_num) {
-                    is_new_message = true;
-                }
+    // Decode mode may be prefixed with -fec <none|hamming|conv> for framed
+    // senders and -out <FILE> to write decoded payloads to a file, and -multi
+    // with both for sender -stripe transfers; any mode
+    // may be prefixed with -rt <CORE|any> to run its receive loop real-time
+    // and -io <auto|blocking|mmsg|uring> to choose the receive backend; the
+    // logging modes take -rotate <SIZE|SPAN> to split long captures; -metrics
+    // <PORT|FILE|-> exports the receive counters while any mode runs
+    bool framed = false;
+    std::string metrics_target;
+    LogRotation rotation = { 0, 0 };
+    TransportKind transport = TRANSPORT_AUTO;
+    FecScheme fec = FEC_NONE;
+    std::string output_path = "-";
+    while (argc >= 3)
+    {
+        std::string option = argv[1];
+        if (option == "-fec")
+        {
+            if (!parse_fec(argv[2], fec))
+            {
+                std::cout << "Error: -fec must be none, hamming or conv" << std::endl;
+                return 1;
             }
-            
-            if (first_packet || is_new_message) {
-                if (is_new_message && !decoded_message.empty()) {
-                    auto message_end_time = std::chrono::high_resolution_clock::now();
-                    auto total_time = std::chrono::duration<double, std::milli>(message_end_time - message_start_time);
-                    
-                    std::cout << "\n=== MESSAGE COMPLETE ===" << std::endl;
-                    std::cout << "Final message: \"" << decoded_message << "\"" << std::endl;
-                    std::cout << "Message length: " << decoded_message.length() << " characters" << std::endl;
-                    std::cout << "Total time: " << std::fixed << std::setprecision(1) << total_time.count() << "ms" << std::endl;
-                    std::cout << "=======================" << std::endl;
-                }
-                
-                decoded_message = "";
-                current_byte = 0;
-                bit_count = 0;
-                first_packet = false;
-                total_packets_received = 0;
-                message_start_time = arrival_time;
-                
-                std::cout << "Received initial packet with Seq Num: " << seq_num << std::endl;
-            } else {
-                if (packet.packet_type == 0) { // Only decode data packets
-                    auto inter_arrival_time = std::chrono::duration<double, std::milli>(arrival_time - last_arrival_time);
-                    double time_diff_ms = inter_arrival_time.count();
-                    
-                    int decoded_bit = (time_diff_ms < threshold_ms) ? 0 : 1;
-                    
-                    current_byte = (current_byte << 1) | decoded_bit;
-                    bit_count++;
-                    
-                    std::cout << "Seq: " << seq_num << ", Time: " << std::fixed << std::setprecision(1) 
-                             << time_diff_ms << "ms, Bit: " << decoded_bit << std::endl;
-
-                    if (bit_count == 8) {
-                        if (current_byte != 0) {  
-                            decoded_message += (char)current_byte;
-                            std::cout << "Decoded character: '" << (char)current_byte 
-                                     << "' - Message so far: \"" << decoded_message << "\"" << std::endl;
-                        }
-                        current_byte = 0;
-                        bit_count = 0;
-                    }
-                }
+            framed = true;
+        }
+        else if (option == "-out")
+        {
+            output_path = argv[2];
+        }
+        else if (option == "-io")
+        {
+            if (!parse_transport(argv[2], transport))
+            {
+                std::cout << "Error: -io must be auto, blocking, mmsg or uring" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "-metrics")
+        {
+            metrics_target = argv[2];
+        }
+        else if (option == "-rotate")
+        {
+            if (!parse_rotation(argv[2], rotation))
+            {
+                std::cout << "Error: -rotate takes a size (512M, 2G) or a span of arrivals (600s, 30min, 1h)" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "-rt" || option == "--rt")
+        {
+            if (!parse_rt_option(argv[2]))
+            {
+                std::cout << "Error: -rt takes a core number or any" << std::endl;
+                return 1;
             }
-            
-            last_arrival_time = arrival_time;
-            last_seq_num = seq_num;
-            total_packets_received++;
         }
+        else
+        {
+            break;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
     }
 
-    closesocket(recvSocket);
-#ifdef _WIN32
-    WSACleanup();
-#endif
-}
+    // The session outlives the exporter, which is stopped when main returns
+    NetSession metrics_net;
+    MetricsExporter exporter;
+    if (!metrics_target.empty())
+    {
+        std::string error;
+        if (!exporter.start(metrics_target, "receiver", error))
+        {
+            std::cout << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Metrics: " << exporter.describe() << std::endl;
+    }
 
-int main(int argc, char *argv[]) {
     // Check for logging mode flag
-    if (argc >= 2 && std::string(argv[1]) == "-log")
+    if (argc >= 2 && (std::string(argv[1]) == "-log" || std::string(argv[1]) == "-logbin"))
     {
-        if (argc != 4)
+        bool binary = std::string(argv[1]) == "-logbin";
+        TimestampSource source = TS_USER;
+        if ((argc != 4 && argc != 5) || (argc == 5 && !parse_timestamp_source(argv[4], source)))
         {
             std::cout << "Logging Mode Usage:" << std::endl;
-            std::cout << "  " << argv[0] << " -log <PORT> <LOGFILE>" << std::endl;
+            std::cout << "  " << argv[0] << " -log <PORT> <LOGFILE> [user|kernel|hw]" << std::endl;
+            std::cout << "  " << argv[0] << " -logbin <PORT> <LOGFILE> [user|kernel|hw]" << std::endl;
             std::cout << "Example:" << std::endl;
-            std::cout << "  " << argv[0] << " -log 9090 jitter_log.csv" << std::endl;
+            std::cout << "  " << argv[0] << " -log 9090 jitter_log.csv kernel" << std::endl;
             return 1;
         }
         
         int port = atoi(argv[2]);
         std::string logfile = argv[3];
         
-        run_logging_mode(port, logfile);
+        run_logging_mode(port, logfile, source, binary, rotation, transport);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "-profile")
+    {
+        TimestampSource source = TS_USER;
+        int bits = argc >= 4 ? atoi(argv[3]) : 1;
+        if (argc < 3 || argc > 5 || bits < 1 || bits > MAX_SYMBOL_BITS ||
+            (argc == 5 && !parse_timestamp_source(argv[4], source)))
+        {
+            std::cout << "Jitter Profile Usage:" << std::endl;
+            std::cout << "  " << argv[0] << " -profile <PORT> [BITS] [user|kernel|hw]" << std::endl;
+            std::cout << "Example:" << std::endl;
+            std::cout << "  " << argv[0] << " -profile 9090 1 kernel" << std::endl;
+            return 1;
+        }
+        run_profile_mode(atoi(argv[2]), bits, source, transport);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "-detect")
+    {
+        TimestampSource source = TS_USER;
+        if (argc < 4 || argc > 7 || (argc == 7 && !parse_timestamp_source(argv[6], source)))
+        {
+            std::cout << "Online Detector Usage:" << std::endl;
+            std::cout << "  " << argv[0] << " -detect <PORT> <LOGFILE> [WINDOW_SIZE[:STRIDE]] [BASELINE_LOG|-] [user|kernel|hw]" << std::endl;
+            std::cout << "Example:" << std::endl;
+            std::cout << "  " << argv[0] << " -detect 9090 live.csv 2000:50 baseline.csv kernel" << std::endl;
+            return 1;
+        }
+
+        int port = atoi(argv[2]);
+        std::string logfile = argv[3];
+        size_t window_size = argc >= 5 ? (size_t)atol(argv[4]) : 2000;
+        const char* colon = argc >= 5 ? strchr(argv[4], ':') : NULL;
+        long stride = colon ? atol(colon + 1) : (long)std::min(window_size, DETECT_STRIDE);
+        if (window_size < 2)
+        {
+            std::cout << "Error: Window size must be at least 2" << std::endl;
+            return 1;
+        }
+        if (stride < 1 || (size_t)stride > window_size)
+        {
+            std::cout << "Error: Stride must be between 1 and the window size" << std::endl;
+            return 1;
+        }
+        std::cout << "Detector: " << window_size << " IAT window, scored every " << stride << std::endl;
+
+        // Logged IATs are in ms; compressibility expects seconds
+        OnlineDetector detector(window_size, (size_t)stride, 1e-3);
+        if (argc >= 6 && std::string(argv[5]) != "-")
+        {
+            std::vector<double> baseline;
+            std::string error;
+            if (!load_iats(argv[5], baseline, error) || baseline.empty())
+            {
+                std::cout << "Error: Cannot load baseline " << argv[5] << (error.empty() ? "" : ": " + error) << std::endl;
+                return 1;
+            }
+            detector.set_baseline(baseline);
+            std::cout << "Baseline: " << baseline.size() << " IATs from " << argv[5] << std::endl;
+        }
+
+        run_logging_mode(port, logfile, source, false, rotation, transport, &detector);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "-multi")
+    {
+        TimestampSource source = TS_USER;
+        int first_port = 0, last_port = 0;
+        if (argc < 4 || argc > 6 || !parse_port_range(argv[2], first_port, last_port) ||
+            (argc == 6 && !parse_timestamp_source(argv[5], source)))
+        {
+            std::cout << "Multi-Flow Usage:" << std::endl;
+            std::cout << "  " << argv[0] << " -multi <PORT|FIRST-LAST> <LOG_PREFIX> [THRESHOLD_MS[,...]|auto[:K]|-] [user|kernel|hw]" << std::endl;
+            std::cout << "  " << argv[0] << " -fec <none|hamming|conv> [-out FILE] -multi <PORT> <LOG_PREFIX> <THRESHOLD_MS[,...]|auto[:K]> [user|kernel|hw]" << std::endl;
+            std::cout << "Example:" << std::endl;
+            std::cout << "  " << argv[0] << " -multi 3331-3337 timings - kernel" << std::endl;
+            return 1;
+        }
+        ThresholdTracker decoder;
+        bool decode = argc >= 5 && std::string(argv[4]) != "-";
+        if (decode && !parse_thresholds(argv[4], decoder))
+        {
+            return 1;
+        }
+        if (framed && !decode)
+        {
+            std::cout << "Error: -fec with -multi needs thresholds to decode the stripes" << std::endl;
+            return 1;
+        }
+        run_multi_flow_mode(first_port, last_port, argv[3], decode ? &decoder : NULL, source, transport,
+                            framed, fec, output_path);
         return 0;
     }
 
+    if (argc >= 2 && std::string(argv[1]) == "-offline")
+    {
+        if (argc != 3 && argc != 4)
+        {
+            std::cout << "Offline Decode Usage:" << std::endl;
+            std::cout << "  " << argv[0] << " -offline <LOGFILE> [THRESHOLD_MS[,...]]" << std::endl;
+            std::cout << "Example:" << std::endl;
+            std::cout << "  " << argv[0] << " -offline data/vpn.csv 150" << std::endl;
+            return 1;
+        }
+        ThresholdTracker tracker; // 125ms unless given, as in decode mode
+        if (argc == 4 && !parse_thresholds(argv[3], tracker))
+        {
+            return 1;
+        }
+        return run_offline_mode(argv[2], tracker);
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "-bin2csv")
+    {
+        if ((argc != 4 && argc != 5) || (argc == 5 && std::string(argv[4]) != "seq" && std::string(argv[4]) != "arrival"))
+        {
+            std::cout << "Binary Log Conversion Usage:" << std::endl;
+            std::cout << "  " << argv[0] << " -bin2csv <BINFILE> <CSVFILE> [arrival|seq]" << std::endl;
+            return 1;
+        }
+        return run_bin2csv_mode(argv[2], argv[3], argc == 5 && std::string(argv[4]) == "seq");
+    }
+
     // Default decode mode
-    if (argc != 2 && argc != 3) { 
+    TimestampSource source = TS_USER;
+    if ((argc != 2 && argc != 3 && argc != 4) || (argc == 4 && !parse_timestamp_source(argv[3], source))) { 
         std::cout << "Decode Mode Usage:" << std::endl;
-        std::cout << "  " << argv[0] << " <PORT> [THRESHOLD_MS]" << std::endl;
+        std::cout << "  " << argv[0] << " [-fec none|hamming|conv] [-out FILE] <PORT> [THRESHOLD_MS[,...]|auto[:K]] [user|kernel|hw]" << std::endl;
+        std::cout << "Logging Mode Usage:" << std::endl;
+        std::cout << "  " << argv[0] << " -log <PORT> <LOGFILE> [user|kernel|hw]" << std::endl;
+        std::cout << "  " << argv[0] << " -logbin <PORT> <LOGFILE> [user|kernel|hw]" << std::endl;
+        std::cout << "  " << argv[0] << " -bin2csv <BINFILE> <CSVFILE> [arrival|seq]" << std::endl;
+        std::cout << "  " << argv[0] << " -offline <LOGFILE> [THRESHOLD_MS[,...]]" << std::endl;
+        std::cout << "  " << argv[0] << " -multi <PORT|FIRST-LAST> <LOG_PREFIX> [THRESHOLD_MS[,...]|auto[:K]|-] [user|kernel|hw]" << std::endl;
+        std::cout << "  " << argv[0] << " -profile <PORT> [BITS] [user|kernel|hw]" << std::endl;
+        std::cout << "Online Detector Usage:" << std::endl;
+        std::cout << "  " << argv[0] << " -detect <PORT> <LOGFILE> [WINDOW_SIZE[:STRIDE]] [BASELINE_LOG|-] [user|kernel|hw]" << std::endl;
+        std::cout << "Any receive mode may be prefixed with -rt <CORE|any> to pin and prioritise its loop," << std::endl;
+        std::cout << "and with -io <auto|blocking|mmsg|uring> to choose how packets are read." << std::endl;
+        std::cout << "-metrics <PORT|FILE|-> serves Prometheus text on PORT, or appends a JSON line a second." << std::endl;
+        return 1;
     }
     
     int port = atoi(argv[1]);
-    double threshold_ms = 125.0;
-    if (argc == 3) {
-        threshold_ms = atof(argv[2]);
+    ThresholdTracker tracker; // 125ms unless given
+    if (argc >= 3 && !parse_thresholds(argv[2], tracker)) {
+        return 1;
     }
     
-    run_decode_mode(port, threshold_ms);
+    run_decode_mode(port, tracker, source, framed, fec, output_path, transport);
     return 0;
 }
\ No newline at end of file
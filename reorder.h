@@ -0,0 +1,154 @@
+// Sequence-order decoding shared by receiver decode mode, its -multi flows
+// and simulate.
+//
+// Arrivals are put back into sequence order by ReorderBuffer, then each data
+// packet's interval is decoded, split or erased by decode_interval(), so the
+// live receiver and the simulator make exactly the same decisions.
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "payload.h"
+#include "symbols.h"
+
+// A packet as the decoder sees it once back in sequence order
+struct Arrival {
+    uint32_t seq_num;
+    uint8_t packet_type;
+    PayloadCodec codec;
+    int64_t arrival_ns;
+    bool late; // overtaken by a packet with a higher sequence number
+};
+
+// What push() did with a packet
+enum PushResult { PUSH_HELD, PUSH_DUPLICATE, PUSH_LATE };
+
+// Puts arrivals back into sequence order. A packet is held until the one
+// before it has been released, or until more than REORDER_WINDOW packets
+// are waiting, when the missing ones are given up as lost. The first packet
+// pushed starts the sequence. Duplicates are rejected, and so are stragglers
+// whose slot has already been given up; the last RELEASED_MEMORY sequence
+// numbers released are remembered to tell the two apart.
+class ReorderBuffer {
+public:
+    static const size_t REORDER_WINDOW = 8;
+    static const uint32_t RELEASED_MEMORY = 1024;
+
+    ReorderBuffer() : released(RELEASED_MEMORY / 64, 0) { reset(); }
+
+    void reset()
+    {
+        pending.clear();
+        std::fill(released.begin(), released.end(), 0);
+        released_any = false;
+        next_seq = 0;
+        highest = 0;
+        duplicate_count = 0;
+        late_count = 0;
+        reordered_count = 0;
+    }
+
+    PushResult push(Arrival arrival)
+    {
+        if (pending.count(arrival.seq_num)) {
+            duplicate_count++;
+            return PUSH_DUPLICATE;
+        }
+        if (released_any && (int32_t)(arrival.seq_num - next_seq) < 0) {
+            // Too old to tell is counted as late
+            if (next_seq - arrival.seq_num <= RELEASED_MEMORY && was_released(arrival.seq_num)) {
+                duplicate_count++;
+                return PUSH_DUPLICATE;
+            }
+            late_count++;
+            return PUSH_LATE;
+        }
+        arrival.late = (released_any || !pending.empty()) && (int32_t)(arrival.seq_num - highest) < 0;
+        if (arrival.late)
+            reordered_count++;
+        else
+            highest = arrival.seq_num;
+        pending[arrival.seq_num] = arrival;
+        return PUSH_HELD;
+    }
+
+    // Releases the next packet in order, if it is due. `flush` releases
+    // everything still waiting.
+    bool pop(Arrival& arrival, bool flush)
+    {
+        if (pending.empty()) return false;
+        std::map<uint32_t, Arrival>::iterator head = pending.begin();
+        if (released_any && head->first != next_seq && !flush && pending.size() <= REORDER_WINDOW)
+            return false;
+        arrival = head->second;
+        pending.erase(head);
+        // Slots skipped over were given up as lost, not released
+        if (released_any) {
+            uint32_t skipped = arrival.seq_num - next_seq;
+            for (uint32_t i = 0; i < skipped && i < RELEASED_MEMORY; ++i) mark_released(next_seq + i, false);
+        }
+        mark_released(arrival.seq_num, true);
+        released_any = true;
+        next_seq = arrival.seq_num + 1;
+        return true;
+    }
+
+    uint32_t highest_seq() const { return highest; }
+    size_t duplicates() const { return duplicate_count; }
+    // Stragglers that came after their slot had been given up as lost
+    size_t late() const { return late_count; }
+    size_t reordered() const { return reordered_count; }
+
+private:
+    bool was_released(uint32_t seq) const
+    {
+        uint32_t bit = seq % RELEASED_MEMORY;
+        return (released[bit / 64] >> (bit % 64)) & 1;
+    }
+
+    void mark_released(uint32_t seq, bool value)
+    {
+        uint32_t bit = seq % RELEASED_MEMORY;
+        if (value) released[bit / 64] |= (uint64_t)1 << (bit % 64);
+        else released[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+    }
+
+    std::map<uint32_t, Arrival> pending;
+    std::vector<uint64_t> released; // bitmap of the last RELEASED_MEMORY sequence numbers
+    bool released_any;
+    uint32_t next_seq;
+    uint32_t highest;
+    size_t duplicate_count;
+    size_t late_count;
+    size_t reordered_count;
+};
+
+// What became of one data packet's interval
+enum IntervalDecision { INTERVAL_SYMBOL, INTERVAL_SPLIT, INTERVAL_ERASED };
+
+// Decodes the interval ending at `arrival`. It is only trusted when both of
+// its packets arrived in order; one that spans a single lost packet is split
+// into two equal symbols when the levels make that unambiguous, and anything
+// else is erased. `symbols` is how many symbols the interval stands for: one
+// per lost packet plus its own, after the preamble as well as within data.
+inline IntervalDecision decode_interval(ThresholdTracker& tracker, const Arrival& previous, const Arrival& arrival,
+                                        unsigned& symbol, size_t& symbols)
+{
+    double iat_ms = (arrival.arrival_ns - previous.arrival_ns) / 1e6;
+    uint32_t lost = arrival.seq_num - previous.seq_num - 1;
+    bool reliable = !arrival.late && !previous.late && iat_ms >= 0;
+    symbols = lost + 1;
+    symbol = 0;
+    if (reliable && lost == 0) {
+        symbol = tracker.decode(iat_ms);
+        return INTERVAL_SYMBOL;
+    }
+    if (reliable && symbols == 2 && tracker.split_merged(iat_ms, symbol)) return INTERVAL_SPLIT;
+    return INTERVAL_ERASED;
+}
+
+#endif
@@ -24,9 +24,9 @@ def get_file_scores(filepath, encoding='utf-8'):
     try:
         # Try reading with provided encoding, fallback to default if needed
         try:
-            df = pd.read_csv(filepath, encoding=encoding)
+            df = pd.read_csv(filepath, encoding=encoding, comment='#')
         except:
-            df = pd.read_csv(filepath) # Try default encoding
+            df = pd.read_csv(filepath, comment='#') # Try default encoding
             
         # Attempt to find the time column (looking for 'Time', 'IAT', or first column)
         if "Time" in df.columns:
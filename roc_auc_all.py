@@ -44,7 +44,7 @@ if __name__ == "__main__":
     # Load data
     print(f"\nLoading covert traffic from '{COVERT_FILE}'...")
     try:
-        covert_iat = pd.to_numeric(pd.read_csv(COVERT_FILE).iloc[:,0], errors='coerce').dropna()
+        covert_iat = pd.to_numeric(pd.read_csv(COVERT_FILE, comment='#').iloc[:,0], errors='coerce').dropna()
         print(f"  → {len(covert_iat):,} inter-arrival times loaded")
     except Exception as e:
         print(f"Error loading covert data: {e}")
@@ -53,7 +53,7 @@ if __name__ == "__main__":
     n_covert = len(covert_iat)
     print(f"\nLoading legitimate traffic from '{LEGIT_FILE}' (limited to {n_covert:,} samples)...")
     try:
-        legit_iat = pd.to_numeric(pd.read_csv(LEGIT_FILE, encoding='utf-16').iloc[:,0], errors='coerce').dropna().iloc[:n_covert].reset_index(drop=True)
+        legit_iat = pd.to_numeric(pd.read_csv(LEGIT_FILE, encoding='utf-16', comment='#').iloc[:,0], errors='coerce').dropna().iloc[:n_covert].reset_index(drop=True)
         print(f"  → {len(legit_iat):,} inter-arrival times loaded")
     except Exception as e:
         print(f"Error loading legit data: {e}")
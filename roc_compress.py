@@ -87,11 +87,11 @@ def run_analysis(iat_series, label_name):
 def main():
     try:
         # Chỉ Load dữ liệu thô (Raw Data), tuyệt đối CHƯA LỌC ở bước này
-        legit_df = pd.read_csv(LEGIT_FILE, encoding='utf-16')
+        legit_df = pd.read_csv(LEGIT_FILE, encoding='utf-16', comment='#')
         legit_iat = pd.to_numeric(legit_df.iloc[:, 0], errors='coerce').dropna().reset_index(drop=True)
         legit_scores = run_analysis(legit_iat, "Legitimate")
 
-        covert_df = pd.read_csv(COVERT_FILE)
+        covert_df = pd.read_csv(COVERT_FILE, comment='#')
         covert_iat = pd.to_numeric(covert_df.iloc[:, 0], errors='coerce').dropna().reset_index(drop=True)
         covert_scores = run_analysis(covert_iat, "Covert (Fuzzed)")
 
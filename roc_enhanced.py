@@ -47,11 +47,11 @@ def run_analysis(iat_series, detection_function):
 try:
     # 1. Load all 3 datasets
     print("Loading legitimate traffic...")
-    legit_df = pd.read_csv(LEGIT_FILE, encoding='utf-16')
+    legit_df = pd.read_csv(LEGIT_FILE, encoding='utf-16', comment='#')
     legit_iat = pd.to_numeric(legit_df.iloc[:, 0], errors='coerce').dropna()
     
     print("Loading covert traffic...")
-    covert_df = pd.read_csv(COVERT_FILE)
+    covert_df = pd.read_csv(COVERT_FILE, comment='#')
     covert_iat = pd.to_numeric(covert_df.iloc[:, 0], errors='coerce').dropna()
 
     # 2. Run analysis with ORIGINAL detector
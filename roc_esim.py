@@ -38,9 +38,9 @@ def fun_eps(x):
 def process_traffic(file_path, label_name, encoding='utf-8'):
     print(f"Loading {label_name} from {file_path}...")
     try:
-        df = pd.read_csv(file_path, encoding=encoding)
+        df = pd.read_csv(file_path, encoding=encoding, comment='#')
     except UnicodeDecodeError:
-        df = pd.read_csv(file_path, encoding='utf-16') 
+        df = pd.read_csv(file_path, encoding='utf-16', comment='#') 
         
     iat = pd.to_numeric(df.iloc[:, 0], errors='coerce').dropna().reset_index(drop=True)
     
@@ -0,0 +1,172 @@
+// Opt-in real-time profile for the sender and receiver hot loops (-rt).
+//
+// A descheduled hot thread shows up as an IAT outlier that looks exactly
+// like network jitter. The profile pins the calling thread to one core,
+// gives it SCHED_FIFO (THREAD_PRIORITY_TIME_CRITICAL on Windows), locks
+// memory against page faults and asks for busy polling on receive sockets.
+// Each step may be refused without privileges; what was actually granted is
+// printed, and the program carries on with whatever it got.
+//
+// Enter the profile just before the hot loop, after helper threads (the
+// telemetry and output writers) have started, so they do not inherit it.
+// Several hot threads (sender -stripe) each enter it with their own core
+// offset.
+#ifndef RT_H
+#define RT_H
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+    #ifndef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/socket.h>
+    #include <unistd.h>
+    #ifdef __linux__
+        #include <pthread.h>
+        #include <sched.h>
+        #include <sys/mman.h>
+        #include <sys/resource.h>
+    #endif
+#endif
+
+struct RtProfile {
+    bool enabled;
+    int core;         // -1: no pinning
+    int priority;     // SCHED_FIFO priority
+    int busy_poll_us; // SO_BUSY_POLL budget per blocking read
+};
+
+const int RT_PRIORITY = 80; // leaves the top of the range to kernel threads
+const int RT_BUSY_POLL_US = 50;
+
+inline RtProfile& rt_profile()
+{
+    static RtProfile profile = { false, -1, RT_PRIORITY, RT_BUSY_POLL_US };
+    return profile;
+}
+
+// Takes the -rt argument, a core number or "any", and turns the profile on
+inline bool parse_rt_option(const std::string& text)
+{
+    RtProfile& profile = rt_profile();
+    if (text == "any") {
+        profile.core = -1;
+    } else {
+        char* end;
+        long core = strtol(text.c_str(), &end, 10);
+        if (text.empty() || *end != '\0' || core < 0 || core > 1023) return false;
+        profile.core = (int)core;
+    }
+    profile.enabled = true;
+    return true;
+}
+
+// Applies the profile to the calling thread and the process, and reports it.
+// The thread is pinned `core_offset` cores past the -rt core.
+inline void enter_rt_profile(int core_offset = 0)
+{
+    RtProfile profile = rt_profile();
+    if (!profile.enabled) return;
+    if (profile.core >= 0) profile.core += core_offset;
+    static std::mutex report;
+    std::lock_guard<std::mutex> lock(report);
+    std::cout << "=== REAL-TIME PROFILE ===" << std::endl;
+
+#ifdef _WIN32
+    if (profile.core >= 0) {
+        DWORD_PTR mask = (DWORD_PTR)1 << (profile.core % (8 * sizeof(DWORD_PTR)));
+        if (SetThreadAffinityMask(GetCurrentThread(), mask) != 0)
+            std::cout << "CPU affinity: core " << profile.core << std::endl;
+        else
+            std::cout << "CPU affinity: denied (error " << GetLastError() << ")" << std::endl;
+    } else {
+        std::cout << "CPU affinity: not pinned" << std::endl;
+    }
+    // REALTIME_PRIORITY_CLASS needs administrator rights and silently becomes HIGH without them
+    SetPriorityClass(GetCurrentProcess(), REALTIME_PRIORITY_CLASS);
+    DWORD priority_class = GetPriorityClass(GetCurrentProcess());
+    bool critical = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+    std::cout << "Scheduling: " << (priority_class == REALTIME_PRIORITY_CLASS ? "REALTIME" :
+                                    priority_class == HIGH_PRIORITY_CLASS ? "HIGH" : "NORMAL")
+              << " class, thread " << (critical ? "TIME_CRITICAL" : "priority denied") << std::endl;
+    std::cout << "Memory lock: not supported on Windows" << std::endl;
+#elif defined(__linux__)
+    if (profile.core >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(profile.core, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc == 0)
+            std::cout << "CPU affinity: core " << profile.core << std::endl;
+        else
+            std::cout << "CPU affinity: denied (" << strerror(rc) << ")" << std::endl;
+    } else {
+        std::cout << "CPU affinity: not pinned" << std::endl;
+    }
+
+    sched_param param = sched_param();
+    param.sched_priority = profile.priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    int policy;
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    if (policy == SCHED_FIFO)
+        std::cout << "Scheduling: SCHED_FIFO priority " << param.sched_priority << std::endl;
+    else
+        std::cout << "Scheduling: SCHED_FIFO denied (" << strerror(rc) << "), running SCHED_OTHER" << std::endl;
+
+    // Locking future mappings as well is only safe without a memlock limit;
+    // otherwise a later allocation past the limit would fail
+    rlimit limit;
+    bool unlimited = geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY);
+    if (mlockall(unlimited ? MCL_CURRENT | MCL_FUTURE : MCL_CURRENT) == 0) {
+        // Fault in some stack now rather than in the loop
+        volatile char stack[256 * 1024];
+        memset((char*)stack, 0, sizeof(stack));
+        std::cout << "Memory lock: " << (unlimited ? "current and future pages" : "current pages (RLIMIT_MEMLOCK)") << std::endl;
+    } else {
+        std::cout << "Memory lock: denied (" << strerror(errno) << ")" << std::endl;
+    }
+#else
+    std::cout << "Real-time profile: not supported on this platform" << std::endl;
+#endif
+}
+
+// Asks the kernel to busy-poll the device queue on blocking reads of `sock`,
+// instead of sleeping until the interrupt. Reported once per process.
+template <typename Socket>
+inline void apply_rt_socket(Socket sock)
+{
+    const RtProfile& profile = rt_profile();
+    static bool reported = false;
+    if (!profile.enabled) return;
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    int budget = profile.busy_poll_us;
+    bool granted = setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &budget, sizeof(budget)) == 0;
+    int error = errno;
+    socklen_t length = sizeof(budget);
+    getsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &budget, &length);
+    if (!reported) {
+        if (granted)
+            std::cout << "Busy poll: " << budget << "us per read" << std::endl;
+        else
+            std::cout << "Busy poll: denied (" << strerror(error) << ")" << std::endl;
+    }
+#else
+    (void)sock;
+    if (!reported) std::cout << "Busy poll: not supported on this platform" << std::endl;
+#endif
+    reported = true;
+}
+
+#endif
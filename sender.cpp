@@ -4,146 +4,741 @@
 #include <thread>
 #include <iomanip>
 #include <fstream>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+
+#include "dataset.h"
+#include "symbols.h"
+#include "framing.h"
+#include "histogram.h"
+#include "payload.h"
+#include "pacing.h"
+#include "rt.h"
+#include "transport.h"
+#include "metrics.h"
+
 const bool DEBUG = false;
 #ifdef _WIN32
-#ifndef _WIN32_WINNT
-#define _WIN32_WINNT 0x0600
-#endif
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <windows.h>
 #include <timeapi.h>
 #pragma comment(lib, "winmm.lib")
 #pragma comment(lib, "ws2_32.lib")
-#include <cstdint>
-#define close closesocket
-#else
-#include <sys/socket.h>
-#include <arpa/inet.h>
-#include <unistd.h>
-#define SOCKET int
-#define INVALID_SOCKET -1
-#define closesocket close
 #endif
 
-#pragma pack(push, 1)
-struct CovertPacket
+// Sleeps until `deadline`, counting the time spent waiting; returns the
+// wake-up time
+deadline_clock::time_point metered_sleep(MetricsShard &metrics, deadline_clock::time_point deadline)
 {
-    uint32_t sequence_number;
-    uint8_t packet_type; // 0 = data, 1 = probe
-};
-#pragma pack(pop)
+    auto before = deadline_clock::now();
+    sleep_until_deadline(deadline);
+    auto woke = deadline_clock::now();
+    metrics.add(METRIC_WAIT_NS, (uint64_t)(woke - before).count());
+    return woke;
+}
 
-const auto MESSAGE_TIMEOUT = std::chrono::milliseconds(5000);
+// Per-packet send telemetry. The encode loop only copies a record into a
+// preallocated single-producer/single-consumer ring; a background thread
+// drains it to CSV so no formatting or file I/O happens between packets.
+struct SendRecord
+{
+    uint32_t seq;
+    double target_ms;
+    double actual_ms;
+    int64_t send_ts_ns; // since transmission start
+    bool scheduled;     // the launch handed to the kernel; no TX stamp came back
+};
 
-void precise_sleep_ms(double duration_ms)
+class TelemetryRing
 {
+public:
+    explicit TelemetryRing(size_t capacity)
+        : slots(capacity), head(0), tail(0), dropped(0), stopping(false) {}
+
+    ~TelemetryRing() { stop(); }
+
+    bool start(const std::string &filename)
+    {
+        out.open(filename.c_str());
+        if (!out.is_open())
+            return false;
+        out << "Seq,TargetMs,ActualMs,SendTsNs,Timing" << std::endl;
+        writer = std::thread(&TelemetryRing::drain_loop, this);
+        return true;
+    }
+
+    // Never blocks the sender: when the writer falls behind, the record is counted and dropped.
+    void push(const SendRecord &record)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= slots.size())
+        {
+            dropped++;
+            return;
+        }
+        slots[h % slots.size()] = record;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    void stop()
+    {
+        if (!writer.joinable())
+            return;
+        stopping.store(true);
+        writer.join();
 #ifdef _WIN32
-    Sleep((DWORD)duration_ms);
-#else
-    usleep((useconds_t)(duration_ms * 1000));
+#undef close
 #endif
-}
+        out.close();
+#ifdef _WIN32
+#define close closesocket
+#endif
+    }
+
+    size_t dropped_count() const { return dropped; }
+
+private:
+    void drain()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        for (; t != h; ++t)
+        {
+            const SendRecord &r = slots[t % slots.size()];
+            out << r.seq << ',' << std::fixed << std::setprecision(3) << r.target_ms << ','
+                << r.actual_ms << ',' << r.send_ts_ns << ',' << (r.scheduled ? "scheduled" : "actual") << '\n';
+        }
+        tail.store(t, std::memory_order_release);
+    }
+
+    void drain_loop()
+    {
+        while (!stopping.load())
+        {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        drain();
+        out.flush();
+    }
+
+    std::vector<SendRecord> slots;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    size_t dropped;
+    std::atomic<bool> stopping;
+    std::ofstream out;
+    std::thread writer;
+};
+
+const char *TELEMETRY_FILE = "sender_telemetry.csv";
+const size_t TELEMETRY_CAPACITY = 1 << 16;
+const int SUMMARY_INTERVAL = 500;
 
-void run_probe_mode(const char *targetIp, int port, double probe_delay_ms, int packet_count)
+// A -txtime block is handed to the kernel this long before its first launch
+const auto TXTIME_LEAD = std::chrono::milliseconds(2);
+
+#ifdef __linux__
+// Kernel-paced transmission (-txtime). Launch times for a block of packets
+// are computed ahead and each packet carries its own through SO_TXTIME, so
+// the qdisc (etf, or fq) or NIC launch-time offload releases it on time and
+// the sender wakes once per block instead of once per packet. The egress
+// interface needs a qdisc that honours SO_TXTIME; without one every packet
+// of a block leaves at once. Software TX stamps (SO_TIMESTAMPING) on the
+// error queue say when each packet really left; its telemetry record is
+// written once that stamp is back, or with the launch time, marked
+// scheduled, when none comes.
+class TxTimePacer
 {
-    std::cout << "=== PROBE MODE ===" << std::endl;
-    std::cout << "Target: " << targetIp << ":" << port << std::endl;
-    std::cout << "Probe delay: " << probe_delay_ms << "ms" << std::endl;
-    std::cout << "Packet count: " << packet_count << std::endl;
-    std::cout << "==================" << std::endl;
+public:
+    static const size_t MAX_BLOCK = 1024;
 
-#ifdef _WIN32
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    TxTimePacer()
+        : sock(INVALID_SOCKET), sender(NULL), clock_id(CLOCK_MONOTONIC), block_size(64), pending(0), missed(0), rejected(0),
+          tx_stamps(false), next_id(0), telemetry(NULL), last_departure_ns(0) {}
+    ~TxTimePacer() { delete sender; }
+
+    // `tai` selects CLOCK_TAI, as etf expects; otherwise CLOCK_MONOTONIC, as fq uses
+    bool open(SOCKET s, const sockaddr_in &to, bool tai, size_t block, std::string &error)
     {
-        std::cout << "WSAStartup failed" << std::endl;
-        return;
+        sock_txtime config = sock_txtime();
+        config.clockid = tai ? CLOCK_TAI : CLOCK_MONOTONIC;
+        config.flags = SOF_TXTIME_REPORT_ERRORS;
+        if (setsockopt(s, SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) != 0)
+        {
+            error = std::string("SO_TXTIME: ") + strerror(errno);
+            return false;
+        }
+        // Numbered (OPT_ID) stamps from the driver; the payload is not echoed back
+        int stamping = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID |
+                       SOF_TIMESTAMPING_OPT_TSONLY;
+        tx_stamps = setsockopt(s, SOL_SOCKET, SO_TIMESTAMPING, &stamping, sizeof(stamping)) == 0;
+        sock = s;
+        block_size = std::min(std::max(block, (size_t)1), MAX_BLOCK);
+        std::string note;
+        sender = open_sender(TRANSPORT_MMSG, s, to, (int)block_size, note);
+        clock_id = config.clockid;
+        packets.resize(block_size);
+        launches.resize(block_size);
+        launch_ns.resize(block_size);
+        records.resize(block_size);
+        return true;
     }
-#endif
 
-    SOCKET sendSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sendSocket == INVALID_SOCKET)
+    size_t block() const { return block_size; }
+    bool measures_departures() const { return tx_stamps; }
+
+    // Where records passed to queue() go once their packet has left
+    void record_to(TelemetryRing &ring, deadline_clock::time_point start)
     {
-        std::cout << "Unable to create socket" << std::endl;
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return;
+        telemetry = &ring;
+        transmission_start = start;
     }
 
-    sockaddr_in recvAddr;
-    recvAddr.sin_family = AF_INET;
-    recvAddr.sin_port = htons(port);
+    // Queues a packet to leave at `launch`, with its telemetry `record`
+    // (seq and target) if it has one; returns how many sends failed if this
+    // filled a block and it was handed to the kernel
+    int queue(const CovertPacket &packet, deadline_clock::time_point launch, const SendRecord *record)
+    {
+        packets[pending] = packet;
+        launches[pending] = launch;
+        records[pending].has_record = record != NULL;
+        if (record)
+            records[pending].record = *record;
+        return ++pending == block_size ? flush() : 0;
+    }
 
-    if (inet_pton(AF_INET, targetIp, &recvAddr.sin_addr) <= 0)
+    // Sends whatever is queued, then waits for the last launch so that
+    // missed deadlines are counted
+    int finish()
     {
-        std::cout << "Invalid IP address: " << targetIp << std::endl;
-        closesocket(sendSocket);
-#ifdef _WIN32
-        WSACleanup();
-#endif
-        return;
+        deadline_clock::time_point last = pending > 0 ? launches[pending - 1] : deadline_clock::now();
+        int failures = flush();
+        metered_sleep(metrics_shard(), last + std::chrono::milliseconds(1));
+        drain_errors();
+        release_departures(true);
+        return failures;
     }
 
-    uint32_t seq_num = 0;
-    int packets_sent = 0;
+    // Packets the qdisc dropped because their launch time had passed or was invalid
+    size_t missed_count() const { return missed; }
+    size_t rejected_count() const { return rejected; }
 
-    std::cout << "Starting probe transmission..." << std::endl;
+private:
+    int flush()
+    {
+        if (pending == 0)
+            return 0;
+        MetricsShard &metrics = metrics_shard();
+        metered_sleep(metrics, launches[0] - TXTIME_LEAD);
+        // Launch times go out on the qdisc's clock; re-read per block, as NTP
+        // slews it against the deadline clock
+        int64_t clock_offset_ns = kernel_clock_offset_ns(clock_id);
+        for (size_t i = 0; i < pending; ++i)
+            launch_ns[i] = (uint64_t)(launches[i].time_since_epoch().count() + clock_offset_ns);
 
-    auto test_start = std::chrono::high_resolution_clock::now();
+        int sent = sender->send(&packets[0], (int)pending, &launch_ns[0]);
+        int failures = (int)pending - sent;
+        for (size_t i = 0; i < pending; ++i)
+        {
+            Departure departure;
+            departure.id = next_id;
+            departure.has_record = records[i].has_record;
+            departure.record = records[i].record;
+            departure.launch_ns = launches[i].time_since_epoch().count();
+            departure.stamp_ns = 0;
+            departure.awaiting = tx_stamps && (int)i < sent;
+            departures.push_back(departure);
+            next_id += (int)i < sent;
+        }
+        if (failures > 0)
+            std::cout << "Send failed for " << failures << " packet(s) from Seq Num "
+                      << ntohl(packets[sent].sequence_number) << std::endl;
+        pending = 0;
+        drain_errors();
+        return failures;
+    }
 
-    // Send initial packet immediately
-    CovertPacket packet;
-    packet.sequence_number = htonl(seq_num);
-    packet.packet_type = 1; // Probe packet
-    sendto(sendSocket, (const char *)&packet, sizeof(packet), 0, (sockaddr *)&recvAddr, sizeof(recvAddr));
-    packets_sent++;
-    seq_num++;
+    void drain_errors()
+    {
+        char control[256];
+        char data[64];
+        // Software stamps are CLOCK_REALTIME
+        int64_t realtime_offset_ns = kernel_clock_offset_ns(CLOCK_REALTIME);
+        for (;;)
+        {
+            iovec iov = {data, sizeof(data)};
+            msghdr msg = msghdr();
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+                break;
+            sock_extended_err err;
+            bool have_error = false;
+            int64_t stamp_ns = 0;
+            for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING &&
+                    cmsg->cmsg_len >= CMSG_LEN(sizeof(scm_timestamping)))
+                {
+                    scm_timestamping stamps;
+                    memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+                    stamp_ns = (int64_t)stamps.ts[0].tv_sec * 1000000000LL + stamps.ts[0].tv_nsec;
+                }
+                else if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVERR &&
+                         cmsg->cmsg_len >= CMSG_LEN(sizeof(err)))
+                {
+                    memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                    have_error = true;
+                }
+            }
+            if (!have_error)
+                continue;
+            if (err.ee_origin == SO_EE_ORIGIN_TXTIME)
+            {
+                if (err.ee_code == SO_EE_CODE_TXTIME_MISSED)
+                    missed++;
+                else
+                    rejected++;
+            }
+            else if (err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING && stamp_ns != 0)
+                departed(err.ee_data, stamp_ns - realtime_offset_ns);
+        }
+        release_departures(false);
+    }
 
-    auto last_send_time = std::chrono::high_resolution_clock::now();
+    // Packet `id` left at `departure_ns` (now_ns() clock). Stamps come back
+    // in launch order, so earlier packets still waiting lost theirs, most
+    // likely to a qdisc drop.
+    void departed(uint32_t id, int64_t departure_ns)
+    {
+        for (size_t i = 0; i < departures.size(); ++i)
+        {
+            Departure &departure = departures[i];
+            if (departure.awaiting && departure.id == id)
+            {
+                departure.stamp_ns = departure_ns;
+                departure.awaiting = false;
+                metrics_shard().observe_lateness(departure_ns - departure.launch_ns);
+                for (size_t j = 0; j < i; ++j)
+                    departures[j].awaiting = false;
+                return;
+            }
+        }
+    }
 
-    // Send remaining packets with precise timing
-    while (packets_sent < packet_count)
+    // Writes the records of packets that are no longer waiting for a stamp,
+    // in order; `all` gives up on the rest. The actual gap of each is from
+    // the packet before it, stamped or not.
+    void release_departures(bool all)
     {
-        precise_sleep_ms(probe_delay_ms);
+        // A driver that never stamps must not hold records back for good
+        while (departures.size() > 2 * MAX_BLOCK)
+            release_front();
+        while (!departures.empty() && (all || !departures.front().awaiting))
+            release_front();
+    }
 
-        auto send_time = std::chrono::high_resolution_clock::now();
-        packet.sequence_number = htonl(seq_num);
-        packet.packet_type = 1;
+    void release_front()
+    {
+        const Departure &departure = departures.front();
+        int64_t at_ns = departure.stamp_ns != 0 ? departure.stamp_ns : departure.launch_ns;
+        if (departure.has_record && telemetry)
+        {
+            SendRecord record = departure.record;
+            record.actual_ms = (at_ns - last_departure_ns) / 1e6;
+            record.send_ts_ns = at_ns - transmission_start.time_since_epoch().count();
+            record.scheduled = departure.stamp_ns == 0;
+            telemetry->push(record);
+        }
+        last_departure_ns = at_ns;
+        departures.pop_front();
+    }
+
+    struct QueuedRecord
+    {
+        bool has_record;
+        SendRecord record;
+    };
+
+    struct Departure
+    {
+        uint32_t id; // OPT_ID key of the stamp's error message
+        bool has_record;
+        SendRecord record;
+        int64_t launch_ns;
+        int64_t stamp_ns; // 0 until the TX stamp is back
+        bool awaiting;
+    };
+
+    SOCKET sock;
+    PacketSender *sender;
+    clockid_t clock_id;
+    size_t block_size;
+    size_t pending;
+    std::vector<CovertPacket> packets;
+    std::vector<deadline_clock::time_point> launches;
+    std::vector<uint64_t> launch_ns; // on the qdisc's clock
+    std::vector<QueuedRecord> records;
+    size_t missed;
+    size_t rejected;
+    bool tx_stamps;
+    uint32_t next_id;
+    std::deque<Departure> departures; // handed to the kernel, record not yet written
+    TelemetryRing *telemetry;
+    deadline_clock::time_point transmission_start;
+    int64_t last_departure_ns;
+};
+#endif
+
+// Shape of a probe run. The defaults give the classic probe: one packet
+// every delay_ms on one flow from one thread.
+struct ProbeLoad
+{
+    double delay_ms;  // mean gap between packets, over all flows
+    int packet_count; // over all flows
+    int burst;        // packets sent back to back per slot; slots are burst * delay_ms apart
+    int flows;        // flow ids flow_id .. flow_id + flows - 1, each numbered from 0
+    int threads;      // each thread sends its share of the flows from its own socket
+    int batch;        // most due packets handed to one sendmmsg call
+};
 
-        int bytesSent = sendto(sendSocket, (const char *)&packet, sizeof(packet), 0, (sockaddr *)&recvAddr, sizeof(recvAddr));
+struct ProbeThreadResult
+{
+    int sent;
+    int failures;
+    LatencyHistogram lateness; // ns from each packet's deadline to its send call
+};
 
-        if (bytesSent == -1)
+// Sends this thread's packets of a probe run. Packet g of the run belongs to
+// flow g % flows, carries sequence number g / flows and is due at
+// start + (g / burst) slots; thread `index` sends g = index, index + threads, ...
+// Whatever is due when the thread wakes goes out together, up to a batch,
+// so a thread that falls behind catches up instead of drifting.
+void run_probe_thread(SOCKET sock, const sockaddr_in &to, const ProbeLoad &load, uint16_t flow_id, int index,
+                      deadline_clock::time_point start, std::atomic<int> &progress, ProbeThreadResult &result)
+{
+    const double slot_ns = load.delay_ms * 1e6 * load.burst;
+    auto deadline_of = [&](int g)
+    {
+        return start + std::chrono::nanoseconds((int64_t)((g / load.burst) * slot_ns));
+    };
+
+    std::vector<CovertPacket> packets(load.batch);
+    std::string note;
+    PacketSender *sender = open_sender(TRANSPORT_AUTO, sock, to, load.batch, note);
+
+    auto next_report = start + std::chrono::seconds(1);
+    result.sent = 0;
+    result.failures = 0;
+    MetricsShard &metrics = metrics_shard();
+    int g = index;
+    while (g < load.packet_count)
+    {
+        auto now = metered_sleep(metrics, deadline_of(g));
+        int count = 0;
+        while (g < load.packet_count && count < load.batch && deadline_of(g) <= now)
         {
-            std::cout << "Send failed for packet " << seq_num << std::endl;
+            CovertPacket &packet = packets[count++];
+            packet.sequence_number = htonl((uint32_t)(g / load.flows));
+            packet.packet_type = 1; // Probe packet
+            packet.flow_id = htons((uint16_t)(flow_id + g % load.flows));
+            packet.flags = 0;
+            result.lateness.record((now - deadline_of(g)).count());
+            metrics.observe_lateness((now - deadline_of(g)).count());
+            g += load.threads;
         }
-        else if (packets_sent % 500 == 0)
+
+        int sent = sender->send(&packets[0], count);
+        if (sent < count && result.failures == 0)
+            std::cout << "Send failed for packet " << ntohl(packets[sent].sequence_number)
+                      << " of flow " << ntohs(packets[sent].flow_id) << std::endl;
+        result.sent += sent;
+        result.failures += count - sent;
+        progress += count;
+
+        if (index == 0 && now >= next_report)
         {
-            auto actual_interval = std::chrono::duration<double, std::milli>(send_time - last_send_time);
-            std::cout << "Sent packet " << seq_num << " (Total: " << packets_sent
-                      << ", Actual interval: " << std::fixed << std::setprecision(1)
-                      << actual_interval.count() << "ms)" << std::endl;
+            auto elapsed = std::chrono::duration<double>(now - start).count();
+            std::cout << "Sent " << progress.load() << " packets (" << std::fixed << std::setprecision(0)
+                      << progress.load() / elapsed << " pps)" << std::endl;
+            next_report += std::chrono::seconds(1);
         }
+    }
+    delete sender;
+}
 
-        last_send_time = send_time;
-        packets_sent++;
-        seq_num++;
+void run_probe_mode(const char *targetIp, int port, const ProbeLoad &load, uint16_t flow_id)
+{
+    std::cout << "=== PROBE MODE ===" << std::endl;
+    std::cout << "Target: " << targetIp << ":" << port << std::endl;
+    std::cout << "Probe delay: " << load.delay_ms << "ms (" << std::fixed << std::setprecision(0)
+              << 1000.0 / load.delay_ms << " pps)" << std::defaultfloat << std::setprecision(6) << std::endl;
+    std::cout << "Packet count: " << load.packet_count << std::endl;
+    if (load.flows > 1)
+        std::cout << "Flow IDs: " << flow_id << "-" << flow_id + load.flows - 1 << std::endl;
+    else
+        std::cout << "Flow ID: " << flow_id << std::endl;
+    if (load.burst > 1)
+        std::cout << "Burst: " << load.burst << " packets" << std::endl;
+    if (load.threads > 1)
+        std::cout << "Threads: " << load.threads << std::endl;
+    if (load.batch > 1)
+        std::cout << "Batch: up to " << load.batch << " packets per sendmmsg" << std::endl;
+    std::cout << "Spin margin: " << std::chrono::duration_cast<std::chrono::microseconds>(spin_margin()).count() << "us" << std::endl;
+    std::cout << "Clock: " << timestamp_clock_name() << std::endl;
+    std::cout << "==================" << std::endl;
+
+    NetSession net;
+    if (!net.ok())
+    {
+        std::cout << "WSAStartup failed" << std::endl;
+        return;
     }
 
-    auto test_end = std::chrono::high_resolution_clock::now();
+    // One socket per thread, so the threads do not contend on a socket lock
+    sockaddr_in recvAddr;
+    std::vector<SOCKET> sockets;
+    for (int t = 0; t < load.threads; ++t)
+    {
+        std::string socket_error;
+        SOCKET sock = open_send_socket(targetIp, port, recvAddr, socket_error);
+        if (sock == INVALID_SOCKET)
+        {
+            std::cout << socket_error << std::endl;
+            for (size_t i = 0; i < sockets.size(); ++i)
+                closesocket(sockets[i]);
+            return;
+        }
+        sockets.push_back(sock);
+    }
+
+    std::cout << "Starting probe transmission..." << std::endl;
+
+    // The first packet leaves once every thread is running
+    auto test_start = deadline_clock::now() + std::chrono::milliseconds(load.threads > 1 ? 10 : 0);
+    std::atomic<int> progress(0);
+    std::vector<ProbeThreadResult> results(load.threads);
+    std::vector<std::thread> workers;
+    for (int t = 1; t < load.threads; ++t)
+        workers.push_back(std::thread(run_probe_thread, sockets[t], std::cref(recvAddr), std::cref(load), flow_id, t,
+                                      test_start, std::ref(progress), std::ref(results[t])));
+    enter_rt_profile();
+    run_probe_thread(sockets[0], recvAddr, load, flow_id, 0, test_start, progress, results[0]);
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    auto test_end = deadline_clock::now();
     auto total_duration = std::chrono::duration<double>(test_end - test_start);
 
+    int packets_sent = 0;
+    int failures = 0;
+    LatencyHistogram lateness;
+    for (int t = 0; t < load.threads; ++t)
+    {
+        packets_sent += results[t].sent;
+        failures += results[t].failures;
+        lateness.merge(results[t].lateness);
+    }
+    // A packet is behind schedule once it is later than the gap it should keep
+    int64_t gap_ns = (int64_t)(load.delay_ms * load.burst * 1e6);
+    uint64_t behind = lateness.count() - lateness.count_at_or_below(gap_ns);
+
     std::cout << "\n=== PROBE COMPLETE ===" << std::endl;
-    std::cout << "Total packets sent: " << packets_sent << std::endl;
+    std::cout << "Total packets sent: " << packets_sent;
+    if (failures > 0)
+        std::cout << " (" << failures << " failed)";
+    std::cout << std::endl;
     std::cout << "Total duration: " << std::fixed << std::setprecision(1) << total_duration.count() << " seconds" << std::endl;
-    std::cout << "Average rate: " << (double)packets_sent / total_duration.count() << " packets/second" << std::endl;
+    std::cout << "Average rate: " << (double)packets_sent / total_duration.count() << " packets/second (target "
+              << 1000.0 / load.delay_ms << ")" << std::endl;
+    std::cout << "Send lateness: p50=" << lateness.percentile(50) / 1000.0 << "us p99=" << lateness.percentile(99) / 1000.0
+              << "us p99.9=" << lateness.percentile(99.9) / 1000.0 << "us max=" << lateness.max() / 1000.0 << "us" << std::endl;
+    std::cout << "Behind schedule: " << behind << " packets later than one " << (load.burst > 1 ? "slot" : "gap") << std::endl;
+    if (load.threads > 1)
+    {
+        for (int t = 0; t < load.threads; ++t)
+            std::cout << "  Thread " << t << ": " << results[t].sent << " packets, p99 lateness "
+                      << results[t].lateness.percentile(99) / 1000.0 << "us" << std::endl;
+    }
     std::cout << "======================" << std::endl;
 
-    closesocket(sendSocket);
-#ifdef _WIN32
-    WSACleanup();
-#endif
+    for (size_t i = 0; i < sockets.size(); ++i)
+        closesocket(sockets[i]);
+}
+
+struct StripeResult
+{
+    int packets_sent;
+    int failures;
+    double total_error_ms; // sum of |actual - target| over data packets
+    deadline_clock::time_point finished;
+};
+
+// One stripe of sender -stripe, on its own socket and timing thread: an
+// initial packet at `start`, the training preamble, then one symbol per
+// packet of this stripe's coded frames. The flow's packets are numbered and
+// timed exactly as a single-flow transfer would be.
+void run_stripe_flow(SOCKET sock, const sockaddr_in &to, const std::vector<uint8_t> &bits, const std::vector<double> &levels,
+                     int symbol_bits, int training_cycles, uint16_t flow_id, uint8_t flags, int index,
+                     deadline_clock::time_point start, StripeResult &result)
+{
+    enter_rt_profile(index);
+    result.packets_sent = 0;
+    result.failures = 0;
+    result.total_error_ms = 0.0;
+
+    CovertPacket packet;
+    packet.flow_id = htons(flow_id);
+    packet.flags = flags;
+    uint32_t seq_num = 0;
+    auto next_deadline = start;
+    auto last_send_time = start;
+    MetricsShard &metrics = metrics_shard();
+    std::string note;
+    PacketSender *sender = open_sender(TRANSPORT_AUTO, sock, to, 1, note);
+    auto send_packet = [&](uint8_t type) -> deadline_clock::time_point
+    {
+        packet.sequence_number = htonl(seq_num++);
+        packet.packet_type = type;
+        auto sent_at = metered_sleep(metrics, next_deadline);
+        metrics.observe_lateness((sent_at - next_deadline).count());
+        if (!sender->send(packet))
+            result.failures++;
+        result.packets_sent++;
+        return sent_at;
+    };
+
+    last_send_time = send_packet(0);
+    for (int i = 0; i < training_cycles * (int)levels.size(); ++i)
+    {
+        next_deadline += ms_to_duration(levels[i % levels.size()]);
+        last_send_time = send_packet(PACKET_TYPE_TRAINING);
+    }
+    for (size_t pos = 0; pos < bits.size(); pos += symbol_bits)
+    {
+        unsigned symbol = 0;
+        for (int b = 0; b < symbol_bits; ++b)
+            symbol = (symbol << 1) | (pos + b < bits.size() ? bits[pos + b] : 0);
+        double target_delay_ms = symbol_delay_ms(levels, symbol);
+        next_deadline += ms_to_duration(target_delay_ms);
+        auto send_time = send_packet(0);
+        result.total_error_ms += std::abs(std::chrono::duration<double, std::milli>(send_time - last_send_time).count() - target_delay_ms);
+        last_send_time = send_time;
+    }
+    result.finished = last_send_time;
+    delete sender;
+}
+
+// sender -stripe: the payload is framed, frame i goes to flow
+// flow_id + i % flows, and every flow sends its frames at the same time from
+// its own socket (so its own source port) and thread. The frame index is the
+// chunk's offset, so receiver -fec ... -multi can put the payload back in
+// order whichever flow delivered what.
+int run_stripe_transfer(const char *targetIp, int port, PayloadReader &reader, const std::string &message_label,
+                        FecScheme fec, const std::vector<double> &levels, int symbol_bits, int training_cycles,
+                        uint16_t flow_id, int flows)
+{
+    // Striping needs every frame up front to deal them out
+    std::string payload;
+    std::vector<uint8_t> chunk(PayloadReader::CHUNK_BYTES);
+    size_t got;
+    while (payload.size() < MAX_FRAMED_BYTES && (got = reader.read(&chunk[0], chunk.size())) > 0)
+        payload.append((const char *)&chunk[0], got);
+    bool truncated = payload.size() > MAX_FRAMED_BYTES || !reader.at_end();
+    if (payload.size() > MAX_FRAMED_BYTES)
+        payload.resize(MAX_FRAMED_BYTES);
+
+    size_t frames = payload.empty() ? 1 : (payload.size() + FRAME_PAYLOAD_BYTES - 1) / FRAME_PAYLOAD_BYTES;
+    if ((size_t)flows > frames)
+    {
+        std::cout << "Note: " << frames << " frame(s) only, striping over " << frames << " flow(s)" << std::endl;
+        flows = (int)frames;
+    }
+    std::vector<std::vector<uint8_t> > stripes;
+    build_striped_frames(payload, (size_t)flows, fec, stripes);
+
+    std::cout << "=== STRIPED TRANSMISSION ===" << std::endl;
+    std::cout << "Message: " << message_label << std::endl;
+    std::cout << "Payload: " << payload.size() << " bytes in " << frames << " frames, FEC: " << fec_name(fec) << std::endl;
+    if (reader.payload_codec() != CODEC_NONE)
+        std::cout << "Compression: " << codec_name(reader.payload_codec()) << " of " << reader.input_bytes_read() << " bytes" << std::endl;
+    std::cout << "Flows: " << flows << " (flow ids " << flow_id << "-" << flow_id + flows - 1 << ")" << std::endl;
+    size_t longest = 0;
+    for (int f = 0; f < flows; ++f)
+        longest = std::max(longest, (stripes[f].size() + symbol_bits - 1) / symbol_bits);
+    std::cout << "Packets per flow: up to " << longest << " (+1 initial, +" << training_cycles * levels.size() << " training)" << std::endl;
+    std::cout << "============================" << std::endl;
+
+    NetSession net;
+    if (!net.ok())
+    {
+        std::cout << "WSAStartup failed" << std::endl;
+        return 1;
+    }
+
+    sockaddr_in recvAddr;
+    std::vector<SOCKET> sockets;
+    for (int f = 0; f < flows; ++f)
+    {
+        std::string socket_error;
+        SOCKET sock = open_send_socket(targetIp, port, recvAddr, socket_error);
+        if (sock == INVALID_SOCKET)
+        {
+            std::cout << socket_error << std::endl;
+            for (size_t i = 0; i < sockets.size(); ++i)
+                closesocket(sockets[i]);
+            return 1;
+        }
+        sockets.push_back(sock);
+    }
+
+    // Every flow starts together once all threads are up
+    auto start = deadline_clock::now() + std::chrono::milliseconds(10);
+    std::vector<StripeResult> results(flows);
+    std::vector<std::thread> workers;
+    for (int f = 0; f < flows; ++f)
+        workers.push_back(std::thread(run_stripe_flow, sockets[f], std::cref(recvAddr), std::cref(stripes[f]),
+                                      std::cref(levels), symbol_bits, training_cycles, (uint16_t)(flow_id + f),
+                                      (uint8_t)reader.payload_codec(), f, start, std::ref(results[f])));
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    int packets_sent = 0, failures = 0;
+    double total_error_ms = 0.0;
+    auto finished = start;
+    for (int f = 0; f < flows; ++f)
+    {
+        packets_sent += results[f].packets_sent;
+        failures += results[f].failures;
+        total_error_ms += results[f].total_error_ms;
+        finished = std::max(finished, results[f].finished);
+    }
+    double total_time_ms = std::chrono::duration<double, std::milli>(finished - start).count();
+
+    std::cout << "\n=== TRANSMISSION COMPLETE ===" << std::endl;
+    std::cout << "Packets sent: " << packets_sent << " (" << failures << " failed)" << std::endl;
+    std::cout << "Payload sent: " << payload.size() << " bytes over " << flows << " flows" << std::endl;
+    if (truncated)
+        std::cout << "Warning: input beyond " << MAX_FRAMED_BYTES << " bytes was not sent (frame index limit)" << std::endl;
+    for (int f = 0; f < flows; ++f)
+        std::cout << "  Flow " << flow_id + f << ": " << results[f].packets_sent << " packets, "
+                  << std::fixed << std::setprecision(1)
+                  << std::chrono::duration<double, std::milli>(results[f].finished - start).count() << "ms" << std::endl;
+    std::cout << "Total time: " << std::fixed << std::setprecision(1) << total_time_ms << "ms" << std::endl;
+    int data_packets = packets_sent - flows * (1 + training_cycles * (int)levels.size());
+    if (data_packets > 0)
+        std::cout << "Mean timing error: " << std::setprecision(3) << total_error_ms / data_packets << "ms" << std::endl;
+    if (total_time_ms > 0)
+        std::cout << "Goodput: " << std::setprecision(1) << payload.size() * 8 * 1000.0 / total_time_ms << " bit/s" << std::endl;
+
+    for (size_t i = 0; i < sockets.size(); ++i)
+        closesocket(sockets[i]);
+    return 0;
 }
 
 int main(int argc, char *argv[])
@@ -151,30 +746,217 @@ int main(int argc, char *argv[])
 #ifdef _WIN32
     timeBeginPeriod(1); // Set Windows timer resolution to 1ms
 #endif
+    init_timestamp_clock();
+    calibrate_spin_margin();
+
+    // Optional prefixes: a flow id so several senders can share one receiver
+    // -multi port, and M-ary delay levels (see symbols.h)
+    uint16_t flow_id = 0;
+    std::vector<double> levels;
+    int symbol_bits = 1;
+    std::string probe_log;
+    bool bits_given = false; // -bits or -levels-from, which -levels excludes
+    int training_cycles = 0;
+    bool framed = false;
+    FecScheme fec = FEC_NONE;
+    PayloadCodec codec = CODEC_NONE;
+    std::string txtime_qdisc; // empty: user-space pacing
+    size_t txtime_block = 64;
+    ProbeLoad load = { 0.0, 0, 1, 0, 1, 1 }; // probe mode shape; flows default to one per thread
+    int stripe_flows = 0; // -stripe: frames dealt out over this many flows
+    std::string metrics_target; // -metrics: Prometheus port or JSON lines file
+    while (argc >= 3)
+    {
+        std::string option = argv[1];
+        int consumed = 2;
+        if (option == "-flow")
+        {
+            flow_id = (uint16_t)atoi(argv[2]);
+        }
+        else if (option == "-levels")
+        {
+            if (bits_given)
+            {
+                std::cout << "Error: -levels sets the bits per symbol itself; drop -bits or -levels-from" << std::endl;
+                return 1;
+            }
+            if (!parse_ms_list(argv[2], levels) || (symbol_bits = symbol_bits_for_levels(levels.size())) == 0)
+            {
+                std::cout << "Error: -levels needs 2, 4, 8 or 16 increasing delays in ms, e.g. -levels 20,40,60,80" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "-calibrate")
+        {
+            training_cycles = atoi(argv[2]);
+            if (training_cycles < 1)
+            {
+                std::cout << "Error: -calibrate needs a positive cycle count" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "-compress")
+        {
+            if (!parse_codec(argv[2], codec))
+            {
+                std::cout << "Error: -compress must be none or deflate" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "-fec")
+        {
+            if (!parse_fec(argv[2], fec))
+            {
+                std::cout << "Error: -fec must be none, hamming or conv" << std::endl;
+                return 1;
+            }
+            framed = true;
+        }
+        else if (option == "-txtime")
+        {
+#ifdef __linux__
+            txtime_qdisc = argv[2];
+            if (txtime_qdisc != "etf" && txtime_qdisc != "fq")
+            {
+                std::cout << "Error: -txtime must be etf or fq" << std::endl;
+                return 1;
+            }
+#else
+            std::cout << "Error: -txtime needs Linux (SO_TXTIME)" << std::endl;
+            return 1;
+#endif
+        }
+        else if (option == "-txblock")
+        {
+            long block = atol(argv[2]);
+            if (block < 1)
+            {
+                std::cout << "Error: -txblock needs a positive packet count" << std::endl;
+                return 1;
+            }
+            txtime_block = (size_t)block;
+        }
+        else if (option == "-stripe")
+        {
+            stripe_flows = atoi(argv[2]);
+            if (stripe_flows < 1 || stripe_flows > 256)
+            {
+                std::cout << "Error: -stripe needs a flow count between 1 and 256" << std::endl;
+                return 1;
+            }
+            framed = true;
+        }
+        else if (option == "-burst" || option == "-flows" || option == "-threads" || option == "-batch")
+        {
+            long value = atol(argv[2]);
+            if (value < 1 || value > 65535)
+            {
+                std::cout << "Error: " << option << " needs a count between 1 and 65535" << std::endl;
+                return 1;
+            }
+            int &field = option == "-burst" ? load.burst : option == "-flows" ? load.flows :
+                         option == "-threads" ? load.threads : load.batch;
+            field = (int)value;
+        }
+        else if (option == "-rt" || option == "--rt")
+        {
+            if (!parse_rt_option(argv[2]))
+            {
+                std::cout << "Error: -rt takes a core number or any" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "-metrics")
+        {
+            metrics_target = argv[2];
+        }
+        else if (option == "-bits" || (option == "-levels-from" && argc >= 4))
+        {
+            if (!levels.empty())
+            {
+                std::cout << "Error: -levels sets the bits per symbol itself; drop " << option << std::endl;
+                return 1;
+            }
+            if (option == "-levels-from")
+            {
+                probe_log = argv[2];
+                consumed = 3;
+            }
+            int bits = atoi(argv[consumed]);
+            if (bits < 1 || bits > MAX_SYMBOL_BITS || symbol_bits_for_levels((size_t)1 << bits) != bits)
+            {
+                std::cout << "Error: Bits per symbol must be between 1 and " << MAX_SYMBOL_BITS << std::endl;
+                return 1;
+            }
+            symbol_bits = bits;
+            bits_given = true;
+        }
+        else
+        {
+            break;
+        }
+        argv[consumed] = argv[0];
+        argv += consumed;
+        argc -= consumed;
+    }
+
+    // The session outlives the exporter, which is stopped when main returns
+    NetSession metrics_net;
+    MetricsExporter exporter;
+    if (!metrics_target.empty())
+    {
+        std::string error;
+        if (!exporter.start(metrics_target, "sender", error))
+        {
+            std::cout << "Error: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Metrics: " << exporter.describe() << std::endl;
+    }
+
     // Check for probe mode
     if (argc >= 2 && std::string(argv[1]) == "-probe")
     {
         if (argc != 6)
         {
             std::cout << "Probe Mode Usage:" << std::endl;
-            std::cout << "  " << argv[0] << " -probe <IP_ADDRESS> <PORT> <DELAY_MS> <PACKET_COUNT>" << std::endl;
+            std::cout << "  " << argv[0] << " [-burst N] [-flows N] [-threads N] [-batch N] -probe <IP_ADDRESS> <PORT> <DELAY_MS|RATEpps> <PACKET_COUNT>" << std::endl;
             std::cout << "Example:" << std::endl;
             std::cout << "  " << argv[0] << " -probe 127.0.0.1 9090 20 5000" << std::endl;
+            std::cout << "  " << argv[0] << " -threads 2 -batch 64 -probe 127.0.0.1 9090 200000pps 2000000" << std::endl;
             return 1;
         }
 
         const char *targetIp = argv[2];
         int port = atoi(argv[3]);
-        double probe_delay_ms = atof(argv[4]);
-        int packet_count = atoi(argv[5]);
+        // A delay, or a rate with a "pps" suffix
+        std::string delay = argv[4];
+        bool rate = delay.size() > 3 && delay.compare(delay.size() - 3, 3, "pps") == 0;
+        double value = atof(delay.c_str());
+        load.delay_ms = rate ? (value > 0 ? 1000.0 / value : 0.0) : value;
+        load.packet_count = atoi(argv[5]);
+        if (load.flows == 0)
+            load.flows = load.threads;
 
-        if (probe_delay_ms <= 0 || packet_count <= 0)
+        if (load.delay_ms <= 0 || load.packet_count <= 0)
         {
             std::cout << "Error: Delay and packet count must be positive" << std::endl;
             return 1;
         }
+        if (load.flows % load.threads != 0)
+        {
+            std::cout << "Error: -flows must be a multiple of -threads, each thread sends whole flows" << std::endl;
+            return 1;
+        }
+#ifndef __linux__
+        if (load.batch > 1)
+        {
+            std::cout << "Warning: sendmmsg needs Linux, sending one packet per call" << std::endl;
+            load.batch = 1;
+        }
+#endif
 
-        run_probe_mode(targetIp, port, probe_delay_ms, packet_count);
+        run_probe_mode(targetIp, port, load, flow_id);
 #ifdef _WIN32
         timeEndPeriod(1);
 #endif
@@ -188,13 +970,32 @@ int main(int argc, char *argv[])
         std::cout << "  " << argv[0] << " <IP_ADDRESS> <PORT> \"<MESSAGE>\" [ZERO_DELAY_MS] [ONE_DELAY_MS]" << std::endl;
         std::cout << "  " << argv[0] << " <IP_ADDRESS> <PORT> -f <FILENAME> [ZERO_DELAY_MS] [ONE_DELAY_MS]" << std::endl;
         std::cout << "Probe Mode Usage:" << std::endl;
-        std::cout << "  " << argv[0] << " -probe <IP_ADDRESS> <PORT> <DELAY_MS> <PACKET_COUNT>" << std::endl;
+        std::cout << "  " << argv[0] << " -probe <IP_ADDRESS> <PORT> <DELAY_MS|RATEpps> <PACKET_COUNT>" << std::endl;
+        std::cout << "Options (before the other arguments):" << std::endl;
+        std::cout << "  -flow <FLOW_ID>              tag packets for receiver -multi (default 0)" << std::endl;
+        std::cout << "  -bits <K>                    K bits per packet, 2^K levels from ZERO to ONE delay" << std::endl;
+        std::cout << "  -levels <D0,D1,...>          explicit delay levels (2, 4, 8 or 16)" << std::endl;
+        std::cout << "  -levels-from <PROBE_LOG> <K> 2^K levels from ZERO delay, spaced from probe jitter" << std::endl;
+        std::cout << "  -calibrate <CYCLES>          send a training preamble for receiver threshold auto" << std::endl;
+        std::cout << "  -fec <none|hamming|conv>     CRC-checked frames, optionally error-corrected" << std::endl;
+        std::cout << "  -compress <none|deflate>     compress the payload; the receiver inflates it" << std::endl;
+        std::cout << "  -txtime <etf|fq>             kernel pacing via SO_TXTIME and sendmmsg (Linux)" << std::endl;
+        std::cout << "  -txblock <PACKETS>           packets per -txtime block (default 64)" << std::endl;
+        std::cout << "  -rt <CORE|any>               pin the send loop to CORE with SCHED_FIFO and locked memory" << std::endl;
+        std::cout << "  -metrics <PORT|FILE|->       serve send counters on PORT (Prometheus) or append JSON lines" << std::endl;
+        std::cout << "  -stripe <FLOWS>              deal frames over FLOWS flows sent in parallel (receiver -fec ... -multi)" << std::endl;
+        std::cout << "  -burst <N>                   probe: N packets back to back per slot" << std::endl;
+        std::cout << "  -flows <N>                   probe: spread packets over N flow ids from -flow" << std::endl;
+        std::cout << "  -threads <N>                 probe: N sending threads, each with its own socket" << std::endl;
+        std::cout << "  -batch <N>                   probe: up to N due packets per sendmmsg (Linux)" << std::endl;
         return 1;
     }
 
     const char *targetIp = argv[1];
     int port = atoi(argv[2]);
-    std::string message;
+    PayloadReader reader;
+    reader.set_codec(codec);
+    std::string message_label; // console description of the payload
     double zero_ms = 50.0; // Use double for milliseconds
     double one_ms = 150.0; // Use double for milliseconds
 
@@ -206,30 +1007,21 @@ int main(int argc, char *argv[])
             return 1;
         }
 
+        // Sent byte for byte, read in chunks as the transfer goes; "-" is stdin
         std::string filename = argv[4];
-        std::ifstream file(filename);
-        if (!file.is_open())
+        std::string error;
+        if (!reader.open(filename, error))
         {
             std::cout << "Error: Cannot open file " << filename << std::endl;
             return 1;
         }
 
-        std::string line;
-        while (std::getline(file, line))
-        {
-            message += line + "\n";
-        }
-
-        if (message.empty())
+        if (reader.at_end() || reader.input_bytes_read() == 0)
         {
             std::cout << "Error: File is empty" << std::endl;
             return 1;
         }
-
-        if (!message.empty() && message.back() == '\n')
-        {
-            message.pop_back();
-        }
+        message_label = filename == "-" ? "<stdin>" : filename;
 
         // Handle optional delay parameters for file mode
         if (argc >= 6)
@@ -240,7 +1032,13 @@ int main(int argc, char *argv[])
     else
     {
         // Regular message mode
-        message = argv[3];
+        std::string error;
+        if (!reader.open_string(argv[3], error))
+        {
+            std::cout << "Error: " << error << std::endl;
+            return 1;
+        }
+        message_label = "\"" + std::string(argv[3]) + "\"";
         if (argc >= 5)
             zero_ms = atof(argv[4]);
         if (argc >= 6)
@@ -253,102 +1051,299 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    std::cout << "Using delays: " << zero_ms << "ms (0-bit), " << one_ms << "ms (1-bit)" << std::endl;
-
-#ifdef _WIN32
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+    if (!probe_log.empty())
     {
-        std::cout << "WSAStartup failed" << std::endl;
+        std::vector<double> probe_iats;
+        std::string error;
+        if (!load_iats(probe_log, probe_iats, error) || !levels_from_probe(probe_iats, zero_ms, symbol_bits, levels))
+        {
+            std::cout << "Error: Cannot derive levels from " << probe_log << (error.empty() ? "" : ": " + error) << std::endl;
+            return 1;
+        }
+    }
+    else if (levels.empty())
+    {
+        levels = even_levels(zero_ms, one_ms, symbol_bits);
+    }
+    if (levels.size() != (size_t)1 << symbol_bits)
+    {
+        std::cout << "Error: " << levels.size() << " delay levels cannot carry " << symbol_bits << "-bit symbols" << std::endl;
         return 1;
     }
-#endif
 
-    SOCKET sendSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sendSocket == INVALID_SOCKET)
+    if (symbol_bits == 1)
+    {
+        std::cout << "Using delays: " << levels[0] << "ms (0-bit), " << levels[1] << "ms (1-bit)" << std::endl;
+    }
+    else
     {
-        std::cout << "Unable to create socket" << std::endl;
+        std::cout << "Using " << symbol_bits << " bits per packet, delay levels: " << format_ms_list(levels) << "ms" << std::endl;
+    }
+    std::cout << "Receiver thresholds: " << format_ms_list(level_thresholds(levels)) << std::endl;
+    std::cout << "Spin margin: " << std::chrono::duration_cast<std::chrono::microseconds>(spin_margin()).count() << "us" << std::endl;
+    std::cout << "Clock: " << timestamp_clock_name() << std::endl;
+
+    if (stripe_flows > 0)
+    {
+        if (!txtime_qdisc.empty())
+        {
+            std::cout << "Error: -stripe paces each flow in its own thread and cannot be combined with -txtime" << std::endl;
+            return 1;
+        }
+        int result = run_stripe_transfer(targetIp, port, reader, message_label, fec, levels, symbol_bits,
+                                         training_cycles, flow_id, stripe_flows);
 #ifdef _WIN32
-        WSACleanup();
+        timeEndPeriod(1);
 #endif
+        return result;
+    }
+
+    NetSession net;
+    if (!net.ok())
+    {
+        std::cout << "WSAStartup failed" << std::endl;
         return 1;
     }
 
     sockaddr_in recvAddr;
-    recvAddr.sin_family = AF_INET;
-    recvAddr.sin_port = htons(port);
-
-    if (inet_pton(AF_INET, targetIp, &recvAddr.sin_addr) <= 0)
+    std::string socket_error;
+    SOCKET sendSocket = open_send_socket(targetIp, port, recvAddr, socket_error);
+    if (sendSocket == INVALID_SOCKET)
     {
-        std::cout << "Invalid IP address: " << targetIp << std::endl;
-        closesocket(sendSocket);
-#ifdef _WIN32
-        WSACleanup();
-#endif
+        std::cout << socket_error << std::endl;
         return 1;
     }
 
+    const bool txtime = !txtime_qdisc.empty();
+#ifdef __linux__
+    TxTimePacer pacer;
+    if (txtime)
+    {
+        std::string error;
+        if (!pacer.open(sendSocket, recvAddr, txtime_qdisc == "etf", txtime_block, error))
+        {
+            std::cout << "Error: Cannot enable kernel pacing: " << error << std::endl;
+            closesocket(sendSocket);
+            return 1;
+        }
+        std::cout << "Pacing: SO_TXTIME for " << txtime_qdisc << " (" << (txtime_qdisc == "etf" ? "CLOCK_TAI" : "CLOCK_MONOTONIC")
+                  << "), " << pacer.block() << " packets per sendmmsg block" << std::endl;
+        if (!pacer.measures_departures())
+            std::cout << "Warning: no TX timestamps, telemetry holds scheduled launch times" << std::endl;
+    }
+#endif
+
     uint32_t seq_num = 0;
-    int total_bits = message.length() * 8;
+
+    // Bits on the wire: the message itself, or its frames after FEC,
+    // produced as the payload is read
+    PayloadBits tx_bits(reader, framed, fec);
+    int64_t message_bytes = reader.size(); // bytes after compression, when known
+    int64_t total_bits = tx_bits.total_bits();
+    int64_t total_symbols = total_bits < 0 ? -1 : (total_bits + symbol_bits - 1) / symbol_bits; // the last symbol is zero-padded
 
     std::cout << "=== TRANSMISSION ANALYSIS ===" << std::endl;
-    std::cout << "Message: \"" << message << "\"" << std::endl;
-    std::cout << "Message length: " << message.length() << " characters" << std::endl;
-    std::cout << "Total bits to encode: " << total_bits << std::endl;
+    std::cout << "Message: " << message_label << std::endl;
+    if (reader.input_size() >= 0)
+        std::cout << "Message length: " << reader.input_size() << " bytes" << std::endl;
+    else
+        std::cout << "Message length: unknown (streamed)" << std::endl;
+    if (codec != CODEC_NONE)
+        std::cout << "Compression: " << codec_name(codec) << ", as the payload is read" << std::endl;
+    if (framed)
+    {
+        std::cout << "Framing: frames of up to " << FRAME_PAYLOAD_BYTES << " bytes, FEC: " << fec_name(fec) << std::endl;
+        if (message_bytes >= 0 && (uint64_t)message_bytes > MAX_FRAMED_BYTES)
+            std::cout << "Warning: only the first " << MAX_FRAMED_BYTES << " bytes fit in framed mode" << std::endl;
+    }
+    int training_packets = training_cycles * (int)levels.size();
+    if (total_symbols >= 0)
+    {
+        std::cout << "Total bits to encode: " << total_bits << std::endl;
+        std::cout << "Packets to send: " << total_symbols;
+        if (training_packets > 0)
+            std::cout << " (+" << training_packets << " training)";
+        std::cout << std::endl;
+    }
 
-    auto transmission_start = std::chrono::high_resolution_clock::now();
+    TelemetryRing telemetry(TELEMETRY_CAPACITY);
+    if (!telemetry.start(TELEMETRY_FILE))
+    {
+        std::cout << "Warning: Cannot open telemetry file " << TELEMETRY_FILE << std::endl;
+    }
+
+    enter_rt_profile();
 
-    // Send first packet immediately
+    auto transmission_start = deadline_clock::now();
     CovertPacket packet;
+    deadline_clock::time_point sent_at; // when the last packet left, or is due to with -txtime
+    MetricsShard &metrics = metrics_shard();
+    std::string send_note;
+    PacketSender *sender = open_sender(TRANSPORT_AUTO, sendSocket, recvAddr, 1, send_note);
+
+#ifdef __linux__
+    if (txtime)
+        pacer.record_to(telemetry, transmission_start);
+#endif
+
+    // Sends `packet` at `deadline`, or with -txtime queues it for the kernel
+    // to launch then, together with its telemetry `record` (seq and target)
+    // if it has one; returns the number of failed sends
+    auto send_packet = [&](deadline_clock::time_point deadline, const SendRecord *record) -> int
+    {
+#ifdef __linux__
+        if (txtime)
+        {
+            sent_at = deadline;
+            return pacer.queue(packet, deadline, record);
+        }
+#endif
+        sent_at = metered_sleep(metrics, deadline);
+        metrics.observe_lateness((sent_at - deadline).count());
+        if (!sender->send(packet))
+        {
+            std::cout << "Send failed for " << (packet.packet_type == PACKET_TYPE_TRAINING ? "training packet " : "packet ")
+                      << ntohl(packet.sequence_number) << std::endl;
+            return 1;
+        }
+        return 0;
+    };
+
+    // Send first packet immediately; kernel pacing needs it in the future
+    int packets_sent = 0;
+    int send_failures = 0;
     packet.sequence_number = htonl(seq_num);
     packet.packet_type = 0; // Data packet
-    sendto(sendSocket, (const char *)&packet, sizeof(packet), 0, (sockaddr *)&recvAddr, sizeof(recvAddr));
-    std::cout << "Sent initial packet, Seq Num: " << seq_num << std::endl;
+    packet.flow_id = htons(flow_id);
+    packet.flags = (uint8_t)reader.payload_codec();
+    auto next_deadline = transmission_start + (txtime ? TXTIME_LEAD : deadline_clock::duration(0));
+    send_failures += send_packet(next_deadline, NULL);
+    auto last_send_time = sent_at;
+    std::cout << (txtime ? "Queued" : "Sent") << " initial packet, Seq Num: " << seq_num << std::endl;
     seq_num++;
 
-    // Encode message - ALL IN MILLISECONDS
-    for (char c : message)
+    double summary_error_ms = 0.0; // sum of |actual - target| since the last summary
+
+    // Training preamble: every level in turn, so the receiver can fit its
+    // thresholds to the delays as this path delivers them (see symbols.h)
+    packet.packet_type = PACKET_TYPE_TRAINING;
+    for (int i = 0; i < training_packets; ++i)
+    {
+        next_deadline += ms_to_duration(levels[i % levels.size()]);
+        packet.sequence_number = htonl(seq_num);
+        send_failures += send_packet(next_deadline, NULL);
+        seq_num++;
+    }
+    if (training_packets > 0)
+    {
+        last_send_time = sent_at;
+        std::cout << "Sent " << training_packets << " training packets" << std::endl;
+    }
+
+    // Encode message - ALL IN MILLISECONDS. Bits are taken MSB-first,
+    // symbol_bits at a time, across character boundaries.
+    uint64_t bits_taken = 0;
+    for (bool more = true; more;)
     {
-        std::cout << "Encoding character: '" << c << "' (ASCII " << (int)c << ")" << std::endl;
-        for (int i = 7; i >= 0; --i)
+        unsigned symbol = 0;
+        int symbol_bits_read = 0;
+        for (int b = 0; b < symbol_bits; ++b)
+        {
+            uint8_t bit = 0;
+            if (tx_bits.next_bit(bit))
+                symbol_bits_read++;
+            symbol = (symbol << 1) | bit;
+        }
+        if (symbol_bits_read == 0)
+            break;
+        more = symbol_bits_read == symbol_bits;
+        if (DEBUG && !framed && bits_taken % 8 < (uint64_t)symbol_bits)
         {
-            int bit = (c >> i) & 1;
-            double target_delay_ms = (bit == 0) ? zero_ms : one_ms;
+            char c = (char)tx_bits.current_byte();
+            std::cout << "Encoding character: '" << c << "' (ASCII " << (int)(unsigned char)c << ")" << std::endl;
+        }
+        bits_taken += symbol_bits;
+        double target_delay_ms = symbol_delay_ms(levels, symbol);
 
-            auto sleep_start = std::chrono::high_resolution_clock::now();
-            precise_sleep_ms(target_delay_ms);
-            auto sleep_end = std::chrono::high_resolution_clock::now();
+        next_deadline += ms_to_duration(target_delay_ms);
+        packet.sequence_number = htonl(seq_num);
+        packet.packet_type = 0;
+        SendRecord record;
+        record.seq = seq_num;
+        record.target_ms = target_delay_ms;
+        record.scheduled = false;
+        int failures = send_packet(next_deadline, &record);
+        send_failures += failures;
+        auto send_time = sent_at;
 
-            auto actual_delay = std::chrono::duration<double, std::milli>(sleep_end - sleep_start);
-            double actual_delay_ms = actual_delay.count();
+        auto actual_delay = std::chrono::duration<double, std::milli>(send_time - last_send_time);
+        double actual_delay_ms = actual_delay.count();
+        last_send_time = send_time;
 
-            packet.sequence_number = htonl(seq_num);
-            packet.packet_type = 0;
+        // With -txtime the pacer writes the record once the packet has left
+        if (!txtime)
+        {
+            record.actual_ms = actual_delay_ms;
+            record.send_ts_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(send_time - transmission_start).count();
+            telemetry.push(record);
+        }
 
-            int bytesSent = sendto(sendSocket, (const char *)&packet, sizeof(packet), 0, (sockaddr *)&recvAddr, sizeof(recvAddr));
-            if (bytesSent == -1)
-            {
-                std::cout << "Send failed for packet " << seq_num << std::endl;
-            }
+        if (failures == 0 && DEBUG)
+        {
+            std::cout << "Sent Seq Num: " << seq_num << ", " << (symbol_bits == 1 ? "Bit: " : "Symbol: ") << symbol
+                      << " (Target: " << std::fixed << std::setprecision(1) << target_delay_ms
+                      << "ms, Actual: " << actual_delay_ms << "ms)" << std::endl;
+        }
+
+        summary_error_ms += std::abs(actual_delay_ms - target_delay_ms);
+        packets_sent++;
+        if (packets_sent % SUMMARY_INTERVAL == 0)
+        {
+            std::cout << (txtime ? "Queued packet " : "Sent packet ") << seq_num << " (Total: " << packets_sent;
+            if (total_symbols >= 0)
+                std::cout << "/" << total_symbols;
+            std::cout << ", Byte: " << tx_bits.bytes_read();
+            if (message_bytes >= 0)
+                std::cout << "/" << message_bytes;
+            if (txtime) // launch times are exact; the kernel owns the error
+                std::cout << ")" << std::endl;
             else
-            {
-                std::cout << "Sent Seq Num: " << seq_num << ", Bit: " << bit
-                          << " (Target: " << std::fixed << std::setprecision(1) << target_delay_ms
-                          << "ms, Actual: " << actual_delay_ms << "ms)" << std::endl;
-            }
-            seq_num++;
+                std::cout << ", Mean error: " << std::fixed << std::setprecision(3)
+                          << summary_error_ms / SUMMARY_INTERVAL << "ms)" << std::endl;
+            summary_error_ms = 0.0;
         }
+        seq_num++;
     }
 
-    auto transmission_end = std::chrono::high_resolution_clock::now();
+#ifdef __linux__
+    if (txtime)
+        send_failures += pacer.finish();
+#endif
+    auto transmission_end = deadline_clock::now();
     auto total_time = std::chrono::duration<double, std::milli>(transmission_end - transmission_start);
 
+    telemetry.stop();
+
     std::cout << "\n=== TRANSMISSION COMPLETE ===" << std::endl;
+    std::cout << "Packets sent: " << packets_sent << " (" << send_failures << " failed)" << std::endl;
+#ifdef __linux__
+    if (txtime && pacer.missed_count() + pacer.rejected_count() > 0)
+        std::cout << "Kernel pacing: " << pacer.missed_count() << " packet(s) dropped for a missed launch time, "
+                  << pacer.rejected_count() << " rejected" << std::endl;
+#endif
+    std::cout << "Payload sent: " << tx_bits.bytes_read() << " bytes";
+    if (codec != CODEC_NONE && reader.input_bytes_read() > 0)
+        std::cout << " (" << codec_name(codec) << " of " << reader.input_bytes_read() << " bytes, "
+                  << std::setprecision(1) << 100.0 * tx_bits.bytes_read() / reader.input_bytes_read() << "%)";
+    std::cout << std::endl;
+    if (tx_bits.truncated())
+        std::cout << "Warning: input beyond " << MAX_FRAMED_BYTES << " bytes was not sent (frame index limit)" << std::endl;
     std::cout << "Total time: " << std::fixed << std::setprecision(1) << total_time.count() << "ms" << std::endl;
+    std::cout << "Telemetry: " << TELEMETRY_FILE << " (" << telemetry.dropped_count() << " records dropped)" << std::endl;
 
+    delete sender;
     closesocket(sendSocket);
 #ifdef _WIN32
-    WSACleanup();
     timeEndPeriod(1);
 #endif
 
@@ -0,0 +1,653 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "dataset.h"
+#include "symbols.h"
+#include "framing.h"
+#include "payload.h"
+#include "reorder.h"
+
+// Virtual-time channel simulator. Each configuration runs the sender's
+// encoder (PayloadBits, Gray-coded delay levels) and the receiver's decoder
+// (ReorderBuffer, decode_interval, FEC and frame parsing) in-process, with
+// packet timing, loss and reordering drawn from an empirical trace or a
+// parametric model instead of a real network and a real clock. A sweep over
+// tau, threshold, bits per symbol and FEC runs on a thread pool.
+
+enum JitterModel
+{
+    JITTER_NONE,
+    JITTER_NORMAL, // one-way delay varies as N(0, sigma)
+    JITTER_EXP,    // one-way delay grows by an exponential queueing delay
+    JITTER_TRACE   // each interval is perturbed by a residual from a trace
+};
+
+struct Channel
+{
+    JitterModel jitter;
+    double jitter_ms;
+    std::vector<double> residuals_ms; // trace IATs minus their nearest cluster centre
+    double loss;
+    double loss_burst; // mean packets per loss burst; 1 is independent loss
+    double reorder;
+    double reorder_ms; // extra delay of a reordered packet
+    double duplicate;
+};
+
+// Which encoding a run uses; scheme is meaningful only when framed
+struct Config
+{
+    double tau_ms;
+    int bits;
+    double threshold; // position between adjacent levels, 0.5 is the midpoint
+    bool framed;
+    FecScheme fec;
+};
+
+struct RunResult
+{
+    uint64_t packets;
+    uint64_t lost;
+    uint64_t coded_bits;
+    uint64_t bit_errors;   // wrong, among bits the decoder produced
+    uint64_t erased_bits;  // erased or never decoded
+    uint64_t payload_bytes;
+    uint64_t correct_bytes;
+    uint64_t frames_ok;
+    uint64_t frames_expected;
+    double duration_s;
+};
+
+std::string encoding_name(const Config& config)
+{
+    return config.framed ? fec_name(config.fec) : "raw";
+}
+
+// One sent packet as it reaches the receiver
+struct Delivery
+{
+    int64_t arrival_ns;
+    uint32_t seq_num;
+};
+
+class LossModel
+{
+public:
+    LossModel(double rate, double burst) : rate(rate), bad(false)
+    {
+        // Gilbert model with the requested mean loss rate and burst length
+        leave_bad = burst > 1 ? 1.0 / burst : 1.0;
+        enter_bad = rate < 1 ? rate * leave_bad / (1.0 - rate) : 1.0;
+    }
+
+    bool drop(std::mt19937_64& rng)
+    {
+        if (rate <= 0)
+            return false;
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        bad = bad ? uniform(rng) >= leave_bad : uniform(rng) < enter_bad;
+        return bad;
+    }
+
+private:
+    double rate;
+    double enter_bad;
+    double leave_bad;
+    bool bad;
+};
+
+// Sends the message's symbols through the channel and returns the arrivals
+// in the order the receiver would see them
+void transmit(const std::vector<double>& delays_ms, const Channel& channel, std::mt19937_64& rng,
+              std::vector<Delivery>& deliveries, uint64_t& lost)
+{
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::exponential_distribution<double> exponential(1.0);
+    LossModel loss(channel.loss, channel.loss_burst);
+    size_t trace_pos = channel.residuals_ms.empty() ? 0 : (size_t)(uniform(rng) * channel.residuals_ms.size());
+
+    deliveries.clear();
+    lost = 0;
+    double send_ms = 0.0;
+    double traced_ms = 0.0; // trace model: arrival before reordering
+    for (size_t i = 0; i <= delays_ms.size(); ++i)
+    {
+        // Packet 0 is the initial packet; packet i ends symbol i - 1
+        double delay = i == 0 ? 0.0 : delays_ms[i - 1];
+        send_ms += delay;
+        double arrival_ms = send_ms;
+        switch (channel.jitter)
+        {
+        case JITTER_NORMAL:
+            arrival_ms += channel.jitter_ms * normal(rng);
+            break;
+        case JITTER_EXP:
+            arrival_ms += channel.jitter_ms * exponential(rng);
+            break;
+        case JITTER_TRACE:
+            traced_ms += delay + (i == 0 ? 0.0 : channel.residuals_ms[trace_pos]);
+            if (i > 0)
+                trace_pos = (trace_pos + 1) % channel.residuals_ms.size();
+            arrival_ms = traced_ms;
+            break;
+        case JITTER_NONE:
+            break;
+        }
+        if (loss.drop(rng))
+        {
+            lost++;
+            continue;
+        }
+        if (channel.reorder > 0 && uniform(rng) < channel.reorder)
+            arrival_ms += channel.reorder_ms;
+        Delivery delivery = { (int64_t)std::llround(arrival_ms * 1e6), (uint32_t)i };
+        deliveries.push_back(delivery);
+        if (channel.duplicate > 0 && uniform(rng) < channel.duplicate)
+        {
+            delivery.arrival_ns += 10000; // 10 us behind the original
+            deliveries.push_back(delivery);
+        }
+    }
+    std::stable_sort(deliveries.begin(), deliveries.end(),
+                     [](const Delivery& a, const Delivery& b) { return a.arrival_ns < b.arrival_ns; });
+}
+
+RunResult simulate_run(const Config& config, const Channel& channel, const std::string& message, uint64_t seed)
+{
+    RunResult result = RunResult();
+    std::seed_seq seq{(uint32_t)seed, (uint32_t)(seed >> 32)};
+    std::mt19937_64 rng(seq);
+
+    // Sender: the same bit source and symbol mapping as sender.cpp
+    PayloadReader reader;
+    std::string error;
+    reader.open_string(message, error);
+    PayloadBits source(reader, config.framed, config.fec);
+    std::vector<uint8_t> tx_bits;
+    uint8_t bit;
+    while (source.next_bit(bit))
+        tx_bits.push_back(bit);
+    while (tx_bits.size() % config.bits)
+        tx_bits.push_back(0); // the last symbol is zero-padded
+
+    std::vector<double> levels = even_levels(config.tau_ms, 2 * config.tau_ms, config.bits);
+    std::vector<double> thresholds;
+    for (size_t i = 1; i < levels.size(); ++i)
+        thresholds.push_back(levels[i - 1] + config.threshold * (levels[i] - levels[i - 1]));
+    std::vector<double> delays;
+    for (size_t i = 0; i < tx_bits.size(); i += config.bits)
+    {
+        unsigned symbol = 0;
+        for (int b = 0; b < config.bits; ++b)
+            symbol = (symbol << 1) | tx_bits[i + b];
+        delays.push_back(symbol_delay_ms(levels, symbol));
+    }
+
+    std::vector<Delivery> deliveries;
+    transmit(delays, channel, rng, deliveries, result.lost);
+    result.packets = delays.size() + 1;
+
+    // Receiver: reorder, then decode each interval as decode mode does
+    ThresholdTracker tracker;
+    tracker.set_fixed(thresholds);
+    ReorderBuffer reorder;
+    std::vector<int8_t> rx_bits;
+    Arrival previous = Arrival();
+    bool started = false;
+    int64_t first_ns = 0, last_ns = 0;
+    auto process = [&](const Arrival& arrival)
+    {
+        if (started)
+        {
+            unsigned symbol;
+            size_t symbols;
+            IntervalDecision decision = decode_interval(tracker, previous, arrival, symbol, symbols);
+            if (decision == INTERVAL_ERASED)
+            {
+                rx_bits.insert(rx_bits.end(), symbols * config.bits, BIT_ERASED);
+            }
+            else
+            {
+                for (int copy = decision == INTERVAL_SPLIT ? 2 : 1; copy > 0; --copy)
+                {
+                    for (int b = config.bits - 1; b >= 0; --b)
+                        rx_bits.push_back((int8_t)((symbol >> b) & 1));
+                }
+            }
+        }
+        else
+        {
+            first_ns = arrival.arrival_ns;
+        }
+        started = true;
+        previous = arrival;
+        last_ns = arrival.arrival_ns;
+    };
+    for (size_t i = 0; i < deliveries.size(); ++i)
+    {
+        Arrival arrival = Arrival();
+        arrival.seq_num = deliveries[i].seq_num;
+        arrival.arrival_ns = deliveries[i].arrival_ns;
+        if (reorder.push(arrival) != PUSH_HELD)
+            continue;
+        while (reorder.pop(arrival, false))
+            process(arrival);
+    }
+    Arrival arrival;
+    while (reorder.pop(arrival, true))
+        process(arrival);
+    result.duration_s = (last_ns - first_ns) / 1e9;
+
+    // Channel errors, position by position, as the receiver's output lines up
+    result.coded_bits = tx_bits.size();
+    for (size_t i = 0; i < tx_bits.size(); ++i)
+    {
+        if (i >= rx_bits.size() || rx_bits[i] == BIT_ERASED)
+            result.erased_bits++;
+        else if ((uint8_t)rx_bits[i] != tx_bits[i])
+            result.bit_errors++;
+    }
+
+    result.payload_bytes = message.size();
+    if (!config.framed)
+    {
+        for (size_t byte = 0; byte < message.size(); ++byte)
+        {
+            bool correct = (byte + 1) * 8 <= rx_bits.size();
+            for (size_t b = 0; correct && b < 8; ++b)
+                correct = rx_bits[byte * 8 + b] == (int8_t)((message[byte] >> (7 - b)) & 1);
+            result.correct_bytes += correct;
+        }
+        return result;
+    }
+
+    std::vector<uint8_t> frame_bits;
+    fec_decode(config.fec, rx_bits, frame_bits);
+    std::string decoded;
+    FrameStats stats;
+    parse_frames(frame_bits, decoded, stats);
+    result.frames_ok = stats.frames_ok;
+    result.frames_expected = (message.size() + FRAME_PAYLOAD_BYTES - 1) / FRAME_PAYLOAD_BYTES;
+    if (result.frames_expected == 0)
+        result.frames_expected = 1;
+    // Good frames are concatenated in index order with the lost ones left out
+    size_t missing = 0, pos = 0;
+    for (unsigned frame = 0; frame < stats.frames_expected; ++frame)
+    {
+        if (missing < stats.missing.size() && stats.missing[missing] == frame)
+        {
+            missing++;
+            continue;
+        }
+        size_t offset = (size_t)frame * FRAME_PAYLOAD_BYTES;
+        for (size_t i = 0; i < FRAME_PAYLOAD_BYTES && pos < decoded.size(); ++i, ++pos)
+            result.correct_bytes += offset + i < message.size() && decoded[pos] == message[offset + i];
+    }
+    return result;
+}
+
+struct Summary
+{
+    Config config;
+    RunResult total; // summed over runs
+};
+
+bool load_trace(const std::string& path, double to_ms, size_t clusters, std::vector<double>& residuals, std::string& error)
+{
+    std::vector<double> iats;
+    if (!load_iats(path, iats, error))
+        return false;
+    if (!iats.empty() && iats[0] == 0.0)
+        iats.erase(iats.begin()); // -log start marker
+    for (size_t i = 0; i < iats.size(); ++i)
+        iats[i] *= to_ms;
+    std::vector<double> centres;
+    if (!fit_level_centres(iats, clusters, centres))
+    {
+        error = "cannot fit " + std::to_string(clusters) + " cluster(s) to " + path;
+        return false;
+    }
+    std::vector<double> bounds = level_thresholds(centres);
+    residuals.resize(iats.size());
+    for (size_t i = 0; i < iats.size(); ++i)
+        residuals[i] = iats[i] - centres[decode_level(bounds, iats[i])];
+    return true;
+}
+
+bool parse_probability(const std::string& text, double& p)
+{
+    char* end;
+    p = strtod(text.c_str(), &end);
+    return !text.empty() && *end == '\0' && p >= 0 && p <= 1;
+}
+
+// "P" or "P,X" with a probability and an optional positive amount
+bool parse_rate_pair(const std::string& text, double& p, double& x)
+{
+    size_t comma = text.find(',');
+    if (!parse_probability(text.substr(0, comma), p))
+        return false;
+    if (comma == std::string::npos)
+        return true;
+    char* end;
+    x = strtod(text.c_str() + comma + 1, &end);
+    return *end == '\0' && x > 0;
+}
+
+void print_usage(const char* program)
+{
+    std::cout << "Simulation Usage:" << std::endl;
+    std::cout << "  " << program << " [options] <MESSAGE|-f FILE>" << std::endl;
+    std::cout << "Sweep (comma-separated lists, every combination runs):" << std::endl;
+    std::cout << "  -tau MS           zero delay; levels span tau..2*tau (default 5,10,20,30,40,50,100)" << std::endl;
+    std::cout << "  -bits N           bits per symbol (default 1)" << std::endl;
+    std::cout << "  -threshold F      threshold position between levels, 0.5 = midpoint (default 0.5)" << std::endl;
+    std::cout << "  -fec LIST         raw, none, hamming, conv (default raw)" << std::endl;
+    std::cout << "Channel:" << std::endl;
+    std::cout << "  -jitter MODEL     none, normal:SIGMA_MS, exp:MEAN_MS or trace:FILE (default normal:1)" << std::endl;
+    std::cout << "  -trace-unit U     s or ms, the unit of the trace (default s, as in data/)" << std::endl;
+    std::cout << "  -clusters K       delay levels in the trace; residuals are taken from the nearest (default 1)" << std::endl;
+    std::cout << "  -loss P[,BURST]   loss rate and mean burst length in packets" << std::endl;
+    std::cout << "  -reorder P,MS     chance of a packet being held back by MS" << std::endl;
+    std::cout << "  -dup P            chance of a packet being duplicated" << std::endl;
+    std::cout << "Run:" << std::endl;
+    std::cout << "  -runs N, -seed N, -threads N, -csv FILE" << std::endl;
+    std::cout << "Example:" << std::endl;
+    std::cout << "  " << program << " -jitter trace:data/no_vpn_no_fuzzy.csv -clusters 2 -fec raw,conv -f pg76895.txt" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<double> taus, bit_list, threshold_list;
+    parse_ms_list("5,10,20,30,40,50,100", taus);
+    bit_list.push_back(1);
+    threshold_list.push_back(0.5);
+    std::vector<std::pair<bool, FecScheme> > encodings(1, std::make_pair(false, FEC_NONE));
+    Channel channel = Channel();
+    channel.jitter = JITTER_NORMAL;
+    channel.jitter_ms = 1.0;
+    channel.loss_burst = 1.0;
+    std::string trace_file;
+    double trace_to_ms = 1000.0;
+    size_t clusters = 1;
+    size_t runs = 1;
+    uint64_t seed = 1;
+    size_t threads = std::thread::hardware_concurrency();
+    std::string csv_file;
+
+    while (argc >= 3)
+    {
+        std::string option = argv[1];
+        std::string value = argv[2];
+        bool ok = true;
+        if (option == "-tau")
+        {
+            ok = parse_ms_list(value, taus);
+        }
+        else if (option == "-bits")
+        {
+            ok = parse_ms_list(value, bit_list);
+            for (size_t i = 0; ok && i < bit_list.size(); ++i)
+                ok = bit_list[i] == std::floor(bit_list[i]) && bit_list[i] <= MAX_SYMBOL_BITS;
+        }
+        else if (option == "-threshold")
+        {
+            ok = parse_ms_list(value, threshold_list) && threshold_list.back() < 1;
+        }
+        else if (option == "-fec")
+        {
+            encodings.clear();
+            std::stringstream stream(value);
+            std::string name;
+            while (ok && std::getline(stream, name, ','))
+            {
+                FecScheme scheme = FEC_NONE;
+                ok = name == "raw" || parse_fec(name, scheme);
+                encodings.push_back(std::make_pair(name != "raw", scheme));
+            }
+            ok = ok && !encodings.empty();
+        }
+        else if (option == "-jitter")
+        {
+            size_t colon = value.find(':');
+            std::string model = value.substr(0, colon);
+            std::string arg = colon == std::string::npos ? "" : value.substr(colon + 1);
+            char* end;
+            channel.jitter_ms = strtod(arg.c_str(), &end);
+            if (model == "none")
+                channel.jitter = JITTER_NONE;
+            else if (model == "normal" || model == "exp")
+            {
+                channel.jitter = model == "normal" ? JITTER_NORMAL : JITTER_EXP;
+                ok = !arg.empty() && *end == '\0' && channel.jitter_ms >= 0;
+            }
+            else if (model == "trace" && !arg.empty())
+            {
+                channel.jitter = JITTER_TRACE;
+                trace_file = arg;
+            }
+            else
+                ok = false;
+        }
+        else if (option == "-trace-unit")
+        {
+            ok = value == "s" || value == "ms";
+            trace_to_ms = value == "s" ? 1000.0 : 1.0;
+        }
+        else if (option == "-clusters")
+        {
+            clusters = (size_t)atol(value.c_str());
+            ok = clusters >= 1;
+        }
+        else if (option == "-loss")
+        {
+            ok = parse_rate_pair(value, channel.loss, channel.loss_burst) && channel.loss < 1;
+        }
+        else if (option == "-reorder")
+        {
+            ok = parse_rate_pair(value, channel.reorder, channel.reorder_ms) && value.find(',') != std::string::npos;
+        }
+        else if (option == "-dup")
+        {
+            ok = parse_probability(value, channel.duplicate);
+        }
+        else if (option == "-runs")
+        {
+            runs = (size_t)atol(value.c_str());
+            ok = runs >= 1;
+        }
+        else if (option == "-seed")
+        {
+            seed = strtoull(value.c_str(), NULL, 10);
+        }
+        else if (option == "-threads")
+        {
+            threads = (size_t)atol(value.c_str());
+        }
+        else if (option == "-csv")
+        {
+            csv_file = value;
+        }
+        else
+        {
+            break;
+        }
+        if (!ok)
+        {
+            std::cout << "Error: Invalid value for " << option << ": " << value << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+    if (threads == 0)
+        threads = 1;
+
+    std::string message;
+    std::string message_label;
+    if (argc == 3 && std::string(argv[1]) == "-f")
+    {
+        std::string error;
+        if (!read_file_bytes(argv[2], message, error))
+        {
+            std::cout << "Error: " << error << std::endl;
+            return 1;
+        }
+        message_label = argv[2];
+    }
+    else if (argc == 2 && argv[1][0] != '-')
+    {
+        message = argv[1];
+        message_label = "\"" + message + "\"";
+    }
+    else
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (message.size() > MAX_FRAMED_BYTES)
+    {
+        message.resize(MAX_FRAMED_BYTES);
+        std::cout << "Warning: message cut to " << MAX_FRAMED_BYTES << " bytes, the framed mode limit" << std::endl;
+    }
+
+    if (channel.jitter == JITTER_TRACE)
+    {
+        std::string error;
+        if (!load_trace(trace_file, trace_to_ms, clusters, channel.residuals_ms, error) || channel.residuals_ms.empty())
+        {
+            std::cout << "Error: " << (error.empty() ? "no intervals in " + trace_file : error) << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Summary> summaries;
+    for (size_t t = 0; t < taus.size(); ++t)
+        for (size_t b = 0; b < bit_list.size(); ++b)
+            for (size_t h = 0; h < threshold_list.size(); ++h)
+                for (size_t e = 0; e < encodings.size(); ++e)
+                {
+                    Summary summary = Summary();
+                    summary.config.tau_ms = taus[t];
+                    summary.config.bits = (int)bit_list[b];
+                    summary.config.threshold = threshold_list[h];
+                    summary.config.framed = encodings[e].first;
+                    summary.config.fec = encodings[e].second;
+                    summaries.push_back(summary);
+                }
+
+    std::cout << "=== SIMULATION ===" << std::endl;
+    std::cout << "Message: " << message_label << " (" << message.size() << " bytes)" << std::endl;
+    std::cout << "Jitter: ";
+    if (channel.jitter == JITTER_TRACE)
+        std::cout << "trace " << trace_file << " (" << channel.residuals_ms.size() << " residuals, " << clusters
+                  << " cluster(s))";
+    else if (channel.jitter == JITTER_NONE)
+        std::cout << "none";
+    else
+        std::cout << (channel.jitter == JITTER_NORMAL ? "normal, sigma " : "exponential, mean ") << channel.jitter_ms << "ms";
+    std::cout << std::endl;
+    std::cout << "Loss: " << channel.loss << " (burst " << channel.loss_burst << "), reorder: " << channel.reorder
+              << " (+" << channel.reorder_ms << "ms), duplicate: " << channel.duplicate << std::endl;
+    std::cout << summaries.size() << " configuration(s) x " << runs << " run(s) on " << threads << " threads" << std::endl;
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::vector<RunResult> results(summaries.size() * runs);
+    std::atomic<size_t> next_job(0);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        pool.push_back(std::thread([&]() {
+            size_t i;
+            while ((i = next_job.fetch_add(1)) < results.size())
+                results[i] = simulate_run(summaries[i / runs].config, channel, message, seed * 1000003 + i);
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); ++t)
+        pool[t].join();
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    double simulated_s = 0.0;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        RunResult& total = summaries[i / runs].total;
+        const RunResult& run = results[i];
+        total.packets += run.packets;
+        total.lost += run.lost;
+        total.coded_bits += run.coded_bits;
+        total.bit_errors += run.bit_errors;
+        total.erased_bits += run.erased_bits;
+        total.payload_bytes += run.payload_bytes;
+        total.correct_bytes += run.correct_bytes;
+        total.frames_ok += run.frames_ok;
+        total.frames_expected += run.frames_expected;
+        total.duration_s += run.duration_s;
+        simulated_s += run.duration_s;
+    }
+
+    std::ofstream csv;
+    if (!csv_file.empty())
+    {
+        csv.open(csv_file.c_str());
+        if (!csv.is_open())
+        {
+            std::cout << "Error: Cannot open output file " << csv_file << std::endl;
+            return 1;
+        }
+        csv << "TauMs,Bits,Threshold,FEC,Runs,Packets,Lost,CodedBits,BitErrors,ErasedBits,BER,PayloadBytes,"
+               "CorrectBytes,ByteErrorRate,FramesOk,FramesExpected,DurationS,RawRate,Goodput\n";
+    }
+
+    std::cout << "\n" << std::setw(8) << "Tau ms" << std::setw(6) << "Bits" << std::setw(7) << "Thr" << std::setw(9)
+              << "FEC" << std::setw(12) << "BER" << std::setw(10) << "Erased" << std::setw(10) << "ByteErr"
+              << std::setw(10) << "Frames" << std::setw(12) << "Goodput" << std::setw(12) << "Time" << std::endl;
+    for (size_t s = 0; s < summaries.size(); ++s)
+    {
+        const Config& config = summaries[s].config;
+        const RunResult& total = summaries[s].total;
+        uint64_t decoded_bits = total.coded_bits - total.erased_bits;
+        double ber = decoded_bits ? (double)total.bit_errors / decoded_bits : 0.0;
+        double erased = total.coded_bits ? (double)total.erased_bits / total.coded_bits : 0.0;
+        double byte_errors = total.payload_bytes ? 1.0 - (double)total.correct_bytes / total.payload_bytes : 0.0;
+        double raw_rate = total.duration_s > 0 ? total.coded_bits / total.duration_s : 0.0;
+        double goodput = total.duration_s > 0 ? total.correct_bytes * 8 / total.duration_s : 0.0;
+        std::string frames = config.framed ? std::to_string(total.frames_ok) + "/" + std::to_string(total.frames_expected) : "-";
+
+        std::cout << std::setw(8) << config.tau_ms << std::setw(6) << config.bits << std::setw(7) << config.threshold
+                  << std::setw(9) << encoding_name(config) << std::scientific << std::setprecision(2) << std::setw(12)
+                  << ber << std::fixed << std::setprecision(4) << std::setw(10) << erased << std::setw(10) << byte_errors
+                  << std::setw(10) << frames << std::setprecision(2) << std::setw(8) << goodput << "b/s"
+                  << std::setprecision(1) << std::setw(11) << total.duration_s / runs / 60 << "m" << std::endl;
+        std::cout.unsetf(std::ios::fixed | std::ios::scientific);
+        std::cout << std::setprecision(6);
+
+        if (csv.is_open())
+        {
+            csv << format_double(config.tau_ms) << ',' << config.bits << ',' << format_double(config.threshold) << ','
+                << encoding_name(config) << ',' << runs << ',' << total.packets << ',' << total.lost << ','
+                << total.coded_bits << ',' << total.bit_errors << ',' << total.erased_bits << ',' << format_double(ber)
+                << ',' << total.payload_bytes << ',' << total.correct_bytes << ',' << format_double(byte_errors) << ','
+                << total.frames_ok << ',' << total.frames_expected << ',' << format_double(total.duration_s / runs)
+                << ',' << format_double(raw_rate) << ',' << format_double(goodput) << '\n';
+        }
+    }
+
+    std::cout << "\nSimulated " << std::fixed << std::setprecision(1) << simulated_s / 3600 << " hours of channel time in "
+              << std::setprecision(2) << elapsed_s << "s" << std::endl;
+    if (csv.is_open())
+        std::cout << "Results written to " << csv_file << std::endl;
+    return 0;
+}
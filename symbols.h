@@ -0,0 +1,419 @@
+// M-ary timing symbols shared by sender and receiver.
+//
+// A symbol carries `bits` message bits as one of 2^bits inter-packet delays.
+// Values are Gray-coded onto the delay levels, so the usual error (landing in
+// a neighbouring level) costs one bit. With one bit per symbol this is the
+// original zero/one encoding and a single threshold.
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SYMBOLS_SSE2 1
+#endif
+
+const int MAX_SYMBOL_BITS = 4;
+
+// Lowest spacing levels_from_probe() will choose between adjacent levels
+const double MIN_LEVEL_SPACING_MS = 1.0;
+
+// packet_type of the training preamble. The sender's first training packet
+// follows the initial packet by level 0's delay, the next by level 1's, and
+// so on through every level, `cycles` times over; data follows. So the
+// training packet with sequence number s used level (s - start - 1) % levels.
+const uint8_t PACKET_TYPE_TRAINING = 2;
+
+inline unsigned gray_encode(unsigned value) { return value ^ (value >> 1); }
+
+inline unsigned gray_decode(unsigned gray)
+{
+    for (unsigned shift = gray >> 1; shift; shift >>= 1) gray ^= shift;
+    return gray;
+}
+
+// Bits per symbol for a level (or threshold + 1) count, or 0 when the count
+// is not a power of two between 2 and 2^MAX_SYMBOL_BITS.
+inline int symbol_bits_for_levels(size_t levels)
+{
+    for (int bits = 1; bits <= MAX_SYMBOL_BITS; ++bits) {
+        if (levels == ((size_t)1 << bits)) return bits;
+    }
+    return 0;
+}
+
+// Parses "a,b,c" into strictly increasing positive millisecond values.
+inline bool parse_ms_list(const std::string& text, std::vector<double>& values)
+{
+    values.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end;
+        double value = strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || !(value > 0)) return false;
+        if (!values.empty() && value <= values.back()) return false;
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+inline std::string format_ms_list(const std::vector<double>& values)
+{
+    std::ostringstream out;
+    for (size_t i = 0; i < values.size(); ++i) out << (i ? "," : "") << values[i];
+    return out.str();
+}
+
+// 2^bits levels spread evenly from lo_ms to hi_ms
+inline std::vector<double> even_levels(double lo_ms, double hi_ms, int bits)
+{
+    size_t count = (size_t)1 << bits;
+    std::vector<double> levels(count);
+    for (size_t i = 0; i < count; ++i) levels[i] = lo_ms + (hi_ms - lo_ms) * i / (count - 1);
+    return levels;
+}
+
+// Levels starting at base_ms, twice `p99_deviation_ms` apart (rounded up to
+// 0.1 ms, at least MIN_LEVEL_SPACING_MS)
+inline std::vector<double> levels_from_deviation(double p99_deviation_ms, double base_ms, int bits)
+{
+    double spacing = std::max(MIN_LEVEL_SPACING_MS, std::ceil(2.0 * p99_deviation_ms * 10.0) / 10.0);
+    return even_levels(base_ms, base_ms + spacing * (((size_t)1 << bits) - 1), bits);
+}
+
+// Levels starting at base_ms, spaced from the jitter of a probe run (receiver
+// -log output of sender -probe, in ms). Adjacent levels sit twice the 99th
+// percentile deviation from the median apart, so with thresholds at the
+// midpoints a symbol is misread about 1% of the time.
+inline bool levels_from_probe(const std::vector<double>& probe_iats_ms, double base_ms, int bits,
+                              std::vector<double>& levels)
+{
+    std::vector<double> iats;
+    for (size_t i = 1; i < probe_iats_ms.size(); ++i) { // the first entry is the 0.0 start marker
+        if (probe_iats_ms[i] > 0) iats.push_back(probe_iats_ms[i]);
+    }
+    if (iats.size() < 10) return false;
+
+    std::sort(iats.begin(), iats.end());
+    double median = iats[iats.size() / 2];
+    std::vector<double> deviations(iats.size());
+    for (size_t i = 0; i < iats.size(); ++i) deviations[i] = std::fabs(iats[i] - median);
+    std::sort(deviations.begin(), deviations.end());
+    double p99 = deviations[(size_t)(0.99 * (deviations.size() - 1))];
+
+    levels = levels_from_deviation(p99, base_ms, bits);
+    return true;
+}
+
+// Decision thresholds halfway between adjacent levels
+inline std::vector<double> level_thresholds(const std::vector<double>& levels)
+{
+    std::vector<double> thresholds;
+    for (size_t i = 1; i < levels.size(); ++i) thresholds.push_back((levels[i - 1] + levels[i]) / 2.0);
+    return thresholds;
+}
+
+// Delay level that carries `value`
+inline double symbol_delay_ms(const std::vector<double>& levels, unsigned value)
+{
+    return levels[gray_decode(value)];
+}
+
+// Level of an interval: the number of thresholds it is not below. An IAT
+// equal to a threshold falls in the upper level, as the single-threshold
+// decoder has always done. This is the one decision rule; live decoding,
+// the batch decoders below and ThresholdTracker all go through it or an
+// exact vector equivalent.
+inline size_t decode_level(const std::vector<double>& thresholds, double iat_ms)
+{
+    return std::upper_bound(thresholds.begin(), thresholds.end(), iat_ms) - thresholds.begin();
+}
+
+// Symbol value of an interval
+inline unsigned decode_symbol(const std::vector<double>& thresholds, double iat_ms)
+{
+    return gray_encode((unsigned)decode_level(thresholds, iat_ms));
+}
+
+// decode_symbol() over `count` intervals at fixed thresholds. SSE2 compares
+// two intervals per instruction; "not less than" matches upper_bound
+// exactly, NaN included.
+inline void decode_symbols(const std::vector<double>& thresholds, const double* iats_ms, size_t count, uint8_t* symbols)
+{
+    size_t i = 0;
+#ifdef SYMBOLS_SSE2
+    for (; i + 2 <= count; i += 2) {
+        __m128d x = _mm_loadu_pd(iats_ms + i);
+        unsigned level0 = 0, level1 = 0;
+        for (size_t k = 0; k < thresholds.size(); ++k) {
+            int mask = _mm_movemask_pd(_mm_cmpnlt_pd(x, _mm_set1_pd(thresholds[k])));
+            level0 += mask & 1;
+            level1 += mask >> 1;
+        }
+        symbols[i] = (uint8_t)gray_encode(level0);
+        symbols[i + 1] = (uint8_t)gray_encode(level1);
+    }
+#endif
+    for (; i < count; ++i) symbols[i] = (uint8_t)decode_symbol(thresholds, iats_ms[i]);
+}
+
+// One-threshold fast path: decodes count / 8 whole bytes, bits MSB-first as
+// the sender sends them. With SSE2 each byte is four compares whose lanes
+// are swapped so movemask yields the earlier interval in the higher bit.
+inline void decode_bytes(double threshold, const double* iats_ms, size_t count, uint8_t* bytes)
+{
+    size_t n = 0;
+#ifdef SYMBOLS_SSE2
+    __m128d t = _mm_set1_pd(threshold);
+    for (; (n + 1) * 8 <= count; ++n) {
+        const double* p = iats_ms + n * 8;
+        unsigned byte = 0;
+        for (int pair = 0; pair < 4; ++pair) {
+            __m128d x = _mm_loadu_pd(p + pair * 2);
+            x = _mm_shuffle_pd(x, x, 1);
+            byte |= (unsigned)_mm_movemask_pd(_mm_cmpnlt_pd(x, t)) << (6 - 2 * pair);
+        }
+        bytes[n] = (uint8_t)byte;
+    }
+#endif
+    std::vector<double> thresholds(1, threshold);
+    for (; (n + 1) * 8 <= count; ++n) {
+        unsigned byte = 0;
+        for (int b = 0; b < 8; ++b) byte = (byte << 1) | (unsigned)decode_level(thresholds, iats_ms[n * 8 + b]);
+        bytes[n] = (uint8_t)byte;
+    }
+}
+
+// Fits `count` level centres to the IATs of a training preamble with 1-D
+// k-medians: start from an equal-count split of the sorted sample (the
+// preamble visits every level equally often), then alternate nearest-centre
+// assignment and per-cluster medians. Medians keep a stray scheduling stall
+// from dragging the top level. Returns false if some cluster ends up empty.
+inline bool fit_level_centres(const std::vector<double>& iats_ms, size_t count, std::vector<double>& centres)
+{
+    if (iats_ms.size() < count * 2) return false;
+    std::vector<double> sorted(iats_ms);
+    std::sort(sorted.begin(), sorted.end());
+
+    centres.assign(count, 0.0);
+    for (size_t k = 0; k < count; ++k) {
+        size_t begin = sorted.size() * k / count, end = sorted.size() * (k + 1) / count;
+        centres[k] = sorted[(begin + end) / 2];
+    }
+
+    // Clusters are contiguous runs of the sorted sample, split at the midpoints
+    std::vector<size_t> bounds(count + 1);
+    for (int iteration = 0; iteration < 50; ++iteration) {
+        std::vector<double> thresholds = level_thresholds(centres);
+        bounds[0] = 0;
+        bounds[count] = sorted.size();
+        for (size_t k = 0; k + 1 < count; ++k) {
+            bounds[k + 1] = std::upper_bound(sorted.begin(), sorted.end(), thresholds[k]) - sorted.begin();
+        }
+        bool moved = false;
+        for (size_t k = 0; k < count; ++k) {
+            if (bounds[k + 1] <= bounds[k]) return false;
+            double median = sorted[(bounds[k] + bounds[k + 1] - 1) / 2];
+            moved = moved || median != centres[k];
+            centres[k] = median;
+        }
+        if (!moved) break;
+    }
+    return true;
+}
+
+// Decision thresholds for the decoder: either fixed, or fitted to a training
+// preamble and then following drift. Every decoded interval pulls the centre
+// of its level towards it by an exponential moving average; once fitted, the
+// thresholds follow and stay at the midpoints between centres.
+class ThresholdTracker {
+public:
+    static constexpr double EMA_ALPHA = 0.05;
+
+    ThresholdTracker() : bits(1), automatic(false), calibrated(false) { set_fixed(std::vector<double>(1, 125.0)); }
+
+    void set_fixed(const std::vector<double>& fixed_thresholds) {
+        current = fixed_thresholds;
+        bits = symbol_bits_for_levels(current.size() + 1);
+        centres.assign(current.size() + 1, std::numeric_limits<double>::quiet_NaN()); // learnt from traffic
+        automatic = false;
+        calibrated = false;
+    }
+
+    // Calibrate from preambles; until one arrives, decode with `fallback_levels`
+    void set_automatic(int symbol_bits, const std::vector<double>& fallback_levels) {
+        bits = symbol_bits;
+        centres = fallback_levels;
+        current = level_thresholds(centres);
+        automatic = true;
+        calibrated = false;
+    }
+
+    bool is_automatic() const { return automatic; }
+    bool is_calibrated() const { return calibrated; }
+    int symbol_bits() const { return bits; }
+    const std::vector<double>& thresholds() const { return current; }
+    const std::vector<double>& level_centres() const { return centres; }
+    size_t pending_training() const { return training.size(); }
+
+    // One preamble interval and the level the sender used for it
+    void add_training(unsigned expected_level, double iat_ms) {
+        training.push_back(iat_ms);
+        labels.push_back(expected_level);
+    }
+
+    void clear_training() {
+        training.clear();
+        labels.clear();
+    }
+
+    // Fits the pending preamble. On success the previous calibration is
+    // replaced and `misread` is the share of training intervals the new
+    // thresholds put in the wrong level; `bit_errors`, if given, gets the
+    // decoded bits those misreads flip.
+    bool calibrate(double& misread, size_t* bit_errors = NULL) {
+        std::vector<double> fitted;
+        bool ok = automatic && fit_level_centres(training, (size_t)1 << bits, fitted);
+        if (ok) {
+            centres = fitted;
+            current = level_thresholds(centres);
+            calibrated = true;
+            size_t wrong = 0;
+            size_t flipped = 0;
+            for (size_t i = 0; i < training.size(); ++i) {
+                size_t level = decode_level(current, training[i]);
+                wrong += level != labels[i];
+                for (unsigned diff = gray_encode((unsigned)level) ^ gray_encode((unsigned)labels[i]); diff; diff &= diff - 1)
+                    flipped++;
+            }
+            misread = (double)wrong / training.size();
+            if (bit_errors) *bit_errors = flipped;
+        }
+        clear_training();
+        return ok;
+    }
+
+    // Decodes one interval and tracks its level's centre
+    unsigned decode(double iat_ms) {
+        size_t level = decode_level(current, iat_ms);
+        if (centres[level] != centres[level]) {
+            centres[level] = iat_ms;
+        } else {
+            centres[level] += EMA_ALPHA * (iat_ms - centres[level]);
+        }
+        if (calibrated) {
+            if (level > 0) current[level - 1] = (centres[level - 1] + centres[level]) / 2.0;
+            if (level + 1 < centres.size()) current[level] = (centres[level] + centres[level + 1]) / 2.0;
+        }
+        return gray_encode((unsigned)level);
+    }
+
+    // An interval that spans a lost packet holds two symbols. Their order is
+    // unknowable, but when the nearest sum of two level centres is twice one
+    // level, and no pair of different levels sums to within half a level
+    // spacing of it, both symbols must be that level. Returns false when the
+    // split is ambiguous or a centre has not been seen yet.
+    bool split_merged(double merged_ms, unsigned& value) const {
+        double spacing = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < centres.size(); ++i) {
+            if (centres[i] != centres[i]) return false;
+            if (i > 0) spacing = std::min(spacing, centres[i] - centres[i - 1]);
+        }
+        size_t best_i = 0, best_j = 0;
+        double best = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < centres.size(); ++i) {
+            for (size_t j = i; j < centres.size(); ++j) {
+                double distance = std::fabs(merged_ms - (centres[i] + centres[j]));
+                if (distance < best) {
+                    best = distance;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+        if (best_i != best_j) return false;
+        double pure = 2.0 * centres[best_i];
+        for (size_t i = 0; i < centres.size(); ++i) {
+            for (size_t j = i + 1; j < centres.size(); ++j) {
+                if (std::fabs(centres[i] + centres[j] - pure) < spacing / 2.0) return false;
+            }
+        }
+        value = gray_encode((unsigned)best_i);
+        return true;
+    }
+
+private:
+    int bits;
+    bool automatic;
+    bool calibrated;
+    std::vector<double> current;  // thresholds in use
+    std::vector<double> centres;  // level centres, NaN until seen
+    std::vector<double> training;
+    std::vector<unsigned> labels;
+};
+
+// Collects decoded bits MSB-first into bytes. NUL bytes, including the
+// padding the sender adds to fill the last symbol, are dropped unless the
+// payload is binary (set_keep_nul), such as a compressed stream. A byte with
+// an erased bit becomes ERASED_CHAR, keeping later bytes aligned.
+const char ERASED_CHAR = '?';
+
+class BitAccumulator {
+public:
+    BitAccumulator() : current(0), count(0), damaged(false), keep_nul(false), erased_count(0) {}
+
+    void clear() { current = 0; count = 0; damaged = false; erased_count = 0; }
+    void set_keep_nul(bool keep) { keep_nul = keep; }
+
+    // Appends the low `bits` bits of `value`; returns true if a character was added.
+    bool push(unsigned value, int bits, std::string& message) {
+        bool added = false;
+        for (int i = bits - 1; i >= 0; --i) {
+            added = push_bit((value >> i) & 1, false, message) || added;
+        }
+        return added;
+    }
+
+    // Appends `bits` erased bits
+    bool push_erased(int bits, std::string& message) {
+        bool added = false;
+        for (int i = 0; i < bits; ++i) {
+            added = push_bit(0, true, message) || added;
+        }
+        return added;
+    }
+
+    // Bytes output as ERASED_CHAR since the last clear()
+    size_t erased_bytes() const { return erased_count; }
+
+private:
+    bool push_bit(unsigned bit, bool erased, std::string& message) {
+        current = (uint8_t)((current << 1) | bit);
+        damaged = damaged || erased;
+        if (++count < 8) return false;
+        bool added = damaged || current != 0 || keep_nul;
+        if (added) message += damaged ? ERASED_CHAR : (char)current;
+        if (damaged) erased_count++;
+        current = 0;
+        count = 0;
+        damaged = false;
+        return added;
+    }
+
+    uint8_t current;
+    int count;
+    bool damaged;
+    bool keep_nul;
+    size_t erased_count;
+};
+
+#endif
@@ -0,0 +1,911 @@
+// Packet I/O shared by the sender and receiver: the wire format, socket
+// setup, arrival timestamps, and the receive and send backends every mode
+// goes through.
+//
+// A mode opens its socket here and gets a PacketReceiver from
+// open_receiver(), which picks the cheapest backend the platform offers:
+// - blocking: one recvfrom/recvmsg per datagram (the only one on Windows)
+// - mmsg: recvmmsg drains up to 64 queued datagrams per call (Linux)
+// - uring: one multishot recvmsg on io_uring fills a ring of registered
+//   provided buffers, so a burst costs no syscall per packet (Linux 6.0+)
+// The batched backends need kernel or hardware stamps. With user stamps a
+// whole batch would share one clock read, so auto keeps blocking reads.
+// Every backend counts its calls, packets and time, and on Linux the drops
+// the socket reports through SO_RXQ_OVFL, into the calling thread's metrics.
+//
+// Sends go through a PacketSender from open_sender(): blocking (sendto, or
+// sendmsg for a packet with an SO_TXTIME launch time) or mmsg (sendmmsg,
+// Linux), counting calls, packets, failures and time the same way.
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "clock.h"
+#include "metrics.h"
+
+#ifdef _WIN32
+    #ifndef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #define close closesocket
+    typedef int socklen_t;
+#else
+    #include <sys/socket.h>
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <errno.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <time.h>
+    #ifdef __linux__
+        #include <linux/net_tstamp.h>
+        #include <linux/errqueue.h>
+        #include <sys/mman.h>
+        #include <sys/syscall.h>
+        #include <linux/io_uring.h>
+        #if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT) // with provided buffer rings (5.19)
+            #define TRANSPORT_HAS_URING 1
+        #endif
+    #endif
+    #define SOCKET int
+    #define INVALID_SOCKET -1
+    #define closesocket close
+#endif
+
+#pragma pack(push, 1)
+struct CovertPacket {
+    uint32_t sequence_number;
+    uint8_t packet_type; // 0 = data, 1 = probe
+    uint16_t flow_id;    // lets one receiver port carry several experiments
+    uint8_t flags;       // payload codec id (PACKET_CODEC_MASK)
+};
+#pragma pack(pop)
+
+// Senders from before flow ids send 5-byte packets; those are flow 0.
+inline uint16_t packet_flow_id(const CovertPacket& packet, int length)
+{
+    return length >= (int)offsetof(CovertPacket, flags) ? ntohs(packet.flow_id) : 0;
+}
+
+const auto MESSAGE_TIMEOUT = std::chrono::milliseconds(5000);
+
+// Winsock startup and cleanup for the lifetime of a mode; nothing elsewhere
+class NetSession {
+public:
+    NetSession() : started(true) {
+#ifdef _WIN32
+        WSADATA wsaData;
+        started = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#endif
+    }
+    ~NetSession() {
+#ifdef _WIN32
+        if (started) WSACleanup();
+#endif
+    }
+    bool ok() const { return started; }
+
+private:
+    NetSession(const NetSession&);
+    NetSession& operator=(const NetSession&);
+    bool started;
+};
+
+// UDP socket bound to `port` on all interfaces; INVALID_SOCKET and `error` on failure
+inline SOCKET open_receive_socket(int port, std::string& error)
+{
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == INVALID_SOCKET) {
+        error = "Unable to create socket";
+        return INVALID_SOCKET;
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sock, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        error = "Bind failed on port " + std::to_string(port);
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+#ifdef SO_RXQ_OVFL
+    // Each datagram then carries the socket's running count of queue drops
+    int enable = 1;
+    setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+#endif
+    return sock;
+}
+
+// UDP socket for sending to `ip`:`port`, whose address is left in `to`
+inline SOCKET open_send_socket(const char* ip, int port, sockaddr_in& to, std::string& error)
+{
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &to.sin_addr) <= 0) {
+        error = std::string("Invalid IP address: ") + ip;
+        return INVALID_SOCKET;
+    }
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == INVALID_SOCKET) error = "Unable to create socket";
+    return sock;
+}
+
+inline void set_receive_timeout(SOCKET sock, int ms)
+{
+#ifdef _WIN32
+    DWORD timeout = (DWORD)ms;
+#else
+    timeval timeout;
+    timeout.tv_sec = ms / 1000;
+    timeout.tv_usec = (ms % 1000) * 1000;
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+// Where packet arrival times come from. User-space stamps are taken after
+// recvfrom returns and include wake-up latency; kernel (SO_TIMESTAMPNS) and
+// hardware (SO_TIMESTAMPING) stamps are taken when the packet reaches the
+// stack or the NIC, and arrive with the datagram as control messages.
+enum TimestampSource { TS_USER = 0, TS_KERNEL = 1, TS_HARDWARE = 2 };
+
+inline const char* timestamp_source_name(TimestampSource source)
+{
+    switch (source) {
+    case TS_KERNEL: return "kernel";
+    case TS_HARDWARE: return "hardware";
+    default: return "user";
+    }
+}
+
+inline bool parse_timestamp_source(const std::string& name, TimestampSource& source)
+{
+    if (name == "user") source = TS_USER;
+    else if (name == "kernel") source = TS_KERNEL;
+    else if (name == "hw" || name == "hardware") source = TS_HARDWARE;
+    else return false;
+    return true;
+}
+
+struct RxTimestamps {
+    RxTimestamps() : source(TS_USER), resolved(false), queue_drops(0) {}
+
+    TimestampSource source;
+    bool resolved;        // hardware requests are confirmed or downgraded by the first packet
+    uint32_t queue_drops; // last SO_RXQ_OVFL count, already added to the metrics
+};
+
+inline int64_t user_clock_ns()
+{
+    return now_ns();
+}
+
+// Kernel and hardware stamps are CLOCK_REALTIME; use the same clock when a
+// datagram arrives without one so intervals stay meaningful.
+inline int64_t wall_clock_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Resolution of the clock behind a timestamp source, for the binary log header.
+inline int64_t clock_resolution_ns(TimestampSource source)
+{
+    if (source == TS_USER) return now_ns_resolution();
+#if defined(__linux__)
+    timespec res;
+    if (source == TS_HARDWARE) return 1;
+    if (clock_getres(CLOCK_REALTIME, &res) == 0) {
+        return (int64_t)res.tv_sec * 1000000000LL + res.tv_nsec;
+    }
+#else
+    (void)source;
+#endif
+    return (int64_t)(1e9 * std::chrono::system_clock::period::num / std::chrono::system_clock::period::den);
+}
+
+// Reading of the arrival clock used by `source`, comparable with its stamps.
+inline int64_t source_clock_ns(TimestampSource source)
+{
+    return source == TS_USER ? user_clock_ns() : wall_clock_ns();
+}
+
+// Asks the kernel for the requested stamps; returns the source actually in effect.
+inline TimestampSource enable_timestamps(SOCKET sock, TimestampSource requested)
+{
+#ifdef __linux__
+    if (requested == TS_HARDWARE) {
+        int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+                  | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+            return TS_HARDWARE;
+        }
+        requested = TS_KERNEL;
+    }
+    if (requested == TS_KERNEL) {
+        int enable = 1;
+        if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0) {
+            return TS_KERNEL;
+        }
+    }
+#else
+    (void)sock;
+    (void)requested;
+#endif
+    return TS_USER;
+}
+
+#ifdef __linux__
+// Pulls the arrival stamp out of a received message's control data, and
+// counts new receive queue drops. False when there is no usable stamp.
+inline bool extract_timestamp(msghdr* msg, RxTimestamps& ts, int64_t& arrival_ns)
+{
+    bool stamped = false;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+
+    #ifdef SO_RXQ_OVFL
+        if (cmsg->cmsg_type == SO_RXQ_OVFL && cmsg->cmsg_len >= CMSG_LEN(sizeof(uint32_t))) {
+            uint32_t dropped;
+            memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+            if (dropped != ts.queue_drops) metrics_shard().add(METRIC_RX_QUEUE_DROPS, dropped - ts.queue_drops);
+            ts.queue_drops = dropped;
+            continue;
+        }
+    #endif
+        if (stamped) continue;
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec stamp;
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+            arrival_ns = (int64_t)stamp.tv_sec * 1000000000LL + stamp.tv_nsec;
+            stamped = true;
+        }
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            bool has_hw = stamps.ts[2].tv_sec != 0 || stamps.ts[2].tv_nsec != 0;
+            if (!ts.resolved) {
+                // The NIC clock and the software clock differ, so a run never mixes them
+                if (!has_hw) ts.source = TS_KERNEL;
+                ts.resolved = true;
+            }
+            const timespec& stamp = (ts.source == TS_HARDWARE && has_hw) ? stamps.ts[2] : stamps.ts[0];
+            if (stamp.tv_sec == 0 && stamp.tv_nsec == 0) continue;
+            arrival_ns = (int64_t)stamp.tv_sec * 1000000000LL + stamp.tv_nsec;
+            stamped = true;
+        }
+    }
+    return stamped;
+}
+#endif
+
+// Receives one datagram and its arrival time in nanoseconds.
+inline int receive_packet(SOCKET sock, CovertPacket& packet, sockaddr_in& senderAddr, RxTimestamps& ts, int64_t& arrival_ns,
+                          int flags = 0)
+{
+#ifdef __linux__
+    // recvmsg even for user stamps, for the queue drop count
+    {
+        iovec iov;
+        iov.iov_base = &packet;
+        iov.iov_len = sizeof(packet);
+        char control[256];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &senderAddr;
+        msg.msg_namelen = sizeof(senderAddr);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        int bytesReceived = (int)recvmsg(sock, &msg, flags);
+        int64_t user_ns = user_clock_ns();
+        if (bytesReceived > 0 && (!extract_timestamp(&msg, ts, arrival_ns) || ts.source == TS_USER)) {
+            arrival_ns = ts.source == TS_USER ? user_ns : wall_clock_ns();
+        }
+        return bytesReceived;
+    }
+#else
+    socklen_t senderAddrSize = sizeof(senderAddr);
+    int bytesReceived = recvfrom(sock, (char*)&packet, sizeof(packet), flags, (sockaddr*)&senderAddr, &senderAddrSize);
+    arrival_ns = user_clock_ns();
+    return bytesReceived;
+#endif
+}
+
+enum TransportKind { TRANSPORT_AUTO, TRANSPORT_BLOCKING, TRANSPORT_MMSG, TRANSPORT_URING };
+
+inline bool parse_transport(const std::string& name, TransportKind& kind)
+{
+    if (name == "auto") kind = TRANSPORT_AUTO;
+    else if (name == "blocking") kind = TRANSPORT_BLOCKING;
+    else if (name == "mmsg") kind = TRANSPORT_MMSG;
+    else if (name == "uring" || name == "io_uring") kind = TRANSPORT_URING;
+    else return false;
+    return true;
+}
+
+// Receives datagrams from one socket in batches. After receive() returns
+// n > 0, entries 0..n-1 hold the packets (zero-padded when shorter), their
+// lengths, senders and arrival stamps; empty datagrams are skipped.
+class PacketReceiver {
+public:
+    static const int BATCH_SIZE = 64;
+    static const int CONTROL_SIZE = 256;
+
+    virtual ~PacketReceiver() {}
+
+    // Blocks until at least one datagram has arrived or the timeout set by
+    // set_timeout() has passed; returns the count, 0 on timeout, -1 on error
+    int receive() {
+        MetricsShard& metrics = metrics_shard();
+        int64_t start = now_ns();
+        int count = fetch();
+        metrics.add(METRIC_RECEIVE_NS, (uint64_t)(now_ns() - start));
+        metrics.add(METRIC_RECEIVE_CALLS, 1);
+        if (count > 0) metrics.add(METRIC_PACKETS_RECEIVED, (uint64_t)count);
+        return count;
+    }
+    // 0 makes receive() return at once when nothing is queued, for callers
+    // that wait for readiness themselves
+    virtual void set_timeout(int ms) {
+        timeout_ms = ms;
+        if (ms > 0) set_receive_timeout(sock, ms);
+    }
+    virtual std::string describe() const = 0;
+    // What to wait on for readiness when several receivers share one loop
+    virtual int wait_handle() const { return (int)sock; }
+
+    const CovertPacket& packet(int i) const { return packets[i]; }
+    const sockaddr_in& sender(int i) const { return senders[i]; }
+    int length(int i) const { return lengths[i]; }
+    int64_t arrival_ns(int i) const { return arrivals[i]; }
+
+protected:
+    PacketReceiver(SOCKET s, RxTimestamps& stamps) : sock(s), ts(stamps), timeout_ms(-1) {}
+
+    // The backend's receive
+    virtual int fetch() = 0;
+
+    // Flag for a read that must not block
+    int nonblocking() const {
+#ifdef _WIN32
+        return 0; // Windows callers wait with select() first
+#else
+        return timeout_ms == 0 ? MSG_DONTWAIT : 0;
+#endif
+    }
+
+    static bool timed_out() {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAETIMEDOUT || WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+    }
+
+    SOCKET sock;
+    RxTimestamps& ts;
+    int timeout_ms; // -1: block
+    CovertPacket packets[BATCH_SIZE];
+    sockaddr_in senders[BATCH_SIZE];
+    int lengths[BATCH_SIZE];
+    int64_t arrivals[BATCH_SIZE];
+};
+
+class BlockingReceiver : public PacketReceiver {
+public:
+    BlockingReceiver(SOCKET s, RxTimestamps& stamps) : PacketReceiver(s, stamps) {}
+
+    int fetch() {
+        memset(&packets[0], 0, sizeof(CovertPacket));
+        int length = receive_packet(sock, packets[0], senders[0], ts, arrivals[0], nonblocking());
+        if (length < 0) return timed_out() ? 0 : -1;
+        if (length == 0) return 0;
+        lengths[0] = length;
+        return 1;
+    }
+
+    std::string describe() const {
+        return ts.source == TS_USER ? "blocking recvfrom" : "blocking recvmsg";
+    }
+};
+
+#ifdef __linux__
+// Receives up to BATCH_SIZE datagrams per recvmmsg call into preallocated
+// buffers. Every message carries its own kernel stamp, so batching never
+// collapses the arrival times of a burst onto one clock read.
+class MmsgReceiver : public PacketReceiver {
+public:
+    MmsgReceiver(SOCKET s, RxTimestamps& stamps) : PacketReceiver(s, stamps) {
+        memset(messages, 0, sizeof(messages));
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            iovecs[i].iov_base = &scratch[i];
+            iovecs[i].iov_len = sizeof(CovertPacket);
+        }
+    }
+
+    // Blocks until at least one datagram is queued, then drains what is ready.
+    int fetch() {
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            msghdr& hdr = messages[i].msg_hdr;
+            hdr.msg_name = &scratch_senders[i];
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_iov = &iovecs[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = controls[i];
+            hdr.msg_controllen = CONTROL_SIZE;
+            hdr.msg_flags = 0;
+            memset(&scratch[i], 0, sizeof(CovertPacket));
+        }
+
+        int received = recvmmsg(sock, messages, BATCH_SIZE, MSG_WAITFORONE | nonblocking(), NULL);
+        if (received < 0) return timed_out() ? 0 : -1;
+
+        int count = 0;
+        int64_t fallback_ns = ts.source == TS_USER ? user_clock_ns() : 0;
+        for (int i = 0; i < received; ++i) {
+            if (messages[i].msg_len == 0) continue;
+            packets[count] = scratch[i];
+            senders[count] = scratch_senders[i];
+            lengths[count] = (int)messages[i].msg_len;
+            if (!extract_timestamp(&messages[i].msg_hdr, ts, arrivals[count]) || ts.source == TS_USER) {
+                if (fallback_ns == 0) fallback_ns = wall_clock_ns();
+                arrivals[count] = fallback_ns;
+            }
+            count++;
+        }
+        return count;
+    }
+
+    std::string describe() const {
+        return "recvmmsg (batch " + std::to_string(BATCH_SIZE) + ")";
+    }
+
+private:
+    mmsghdr messages[BATCH_SIZE];
+    iovec iovecs[BATCH_SIZE];
+    CovertPacket scratch[BATCH_SIZE];
+    sockaddr_in scratch_senders[BATCH_SIZE];
+    char controls[BATCH_SIZE][CONTROL_SIZE];
+};
+#endif
+
+#ifdef TRANSPORT_HAS_URING
+// One multishot recvmsg stays armed on the socket. The kernel picks a free
+// buffer from a ring registered with IORING_REGISTER_PBUF_RING for each
+// datagram (recvmsg header, address, control data and payload) and posts a
+// completion; receive() reaps completions and hands the buffers back, and
+// only enters the kernel when the completion queue is empty. Raw syscalls,
+// so liburing is not needed.
+class UringReceiver : public PacketReceiver {
+public:
+    static const unsigned BUFFER_COUNT = 256; // a power of two
+    static const unsigned BUFFER_SIZE = 512;
+    static const unsigned short BUFFER_GROUP = 0;
+
+    UringReceiver(SOCKET s, RxTimestamps& stamps)
+        : PacketReceiver(s, stamps), ring_fd(-1), ring(MAP_FAILED), ring_size(0), sqe_area(MAP_FAILED), sqe_size(0),
+          buffer_ring(NULL), buffer_tail(0), rearm(false), unsubmitted(0) {}
+
+    ~UringReceiver() {
+        if (sqe_area != MAP_FAILED) munmap(sqe_area, sqe_size);
+        if (ring != MAP_FAILED) munmap(ring, ring_size);
+        if (ring_fd >= 0) ::close(ring_fd);
+        free(buffer_ring);
+    }
+
+    bool open(std::string& error) {
+        // Room for a completion per buffer, so a burst never overflows the queue
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = 2 * BUFFER_COUNT;
+        ring_fd = (int)syscall(__NR_io_uring_setup, 8, &params);
+        if (ring_fd < 0) {
+            error = std::string("io_uring_setup: ") + strerror(errno);
+            return false;
+        }
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            error = "kernel too old";
+            return false;
+        }
+        size_t sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ring_size = sq_bytes > cq_bytes ? sq_bytes : cq_bytes;
+        ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        sqe_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqe_area = mmap(NULL, sqe_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (ring == MAP_FAILED || sqe_area == MAP_FAILED) {
+            error = std::string("mmap: ") + strerror(errno);
+            return false;
+        }
+        char* base = (char*)ring;
+        sq_tail = (unsigned*)(base + params.sq_off.tail);
+        sq_mask = *(unsigned*)(base + params.sq_off.ring_mask);
+        sq_array = (unsigned*)(base + params.sq_off.array);
+        cq_head = (unsigned*)(base + params.cq_off.head);
+        cq_tail = (unsigned*)(base + params.cq_off.tail);
+        cq_mask = *(unsigned*)(base + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(base + params.cq_off.cqes);
+        sqes = (io_uring_sqe*)sqe_area;
+
+        void* memory = NULL;
+        if (posix_memalign(&memory, 4096, BUFFER_COUNT * sizeof(io_uring_buf)) != 0) {
+            error = "out of memory";
+            return false;
+        }
+        memset(memory, 0, BUFFER_COUNT * sizeof(io_uring_buf));
+        buffer_ring = (io_uring_buf_ring*)memory;
+        buffers.assign((size_t)BUFFER_COUNT * BUFFER_SIZE, 0);
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)buffer_ring;
+        reg.ring_entries = BUFFER_COUNT;
+        reg.bgid = BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+            error = std::string("provided buffer ring: ") + strerror(errno);
+            return false;
+        }
+        for (unsigned i = 0; i < BUFFER_COUNT; ++i) recycle(i);
+        __atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE);
+
+        // The template only sizes the address and control parts of each buffer
+        memset(&layout, 0, sizeof(layout));
+        layout.msg_namelen = sizeof(sockaddr_in);
+        layout.msg_controllen = CONTROL_SIZE;
+        arm();
+        if (enter(0) < 0) {
+            error = std::string("io_uring_enter: ") + strerror(errno);
+            return false;
+        }
+        // Kernels without multishot recvmsg reject the request straight away
+        unsigned head = *cq_head;
+        if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) && cqes[head & cq_mask].res < 0 &&
+            cqes[head & cq_mask].res != -ENOBUFS) {
+            error = std::string("multishot recvmsg: ") + strerror(-cqes[head & cq_mask].res);
+            return false;
+        }
+        return true;
+    }
+
+    void set_timeout(int ms) { timeout_ms = ms; }
+
+    int fetch() {
+        for (;;) {
+            if (rearm) arm();
+            if (unsubmitted > 0 && enter(0) < 0 && errno != EINTR) return -1;
+            if (*cq_head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                if (timeout_ms >= 0) {
+                    pollfd ready;
+                    ready.fd = ring_fd;
+                    ready.events = POLLIN;
+                    ready.revents = 0;
+                    int polled = poll(&ready, 1, timeout_ms);
+                    if (polled == 0) return 0;
+                    if (polled < 0) return errno == EINTR ? 0 : -1;
+                    // Flushes completions the kernel still holds back
+                    if (enter(0, true) < 0 && errno != EINTR) return -1;
+                } else if (enter(1) < 0 && errno != EINTR) {
+                    return -1;
+                }
+            }
+            int count = reap();
+            if (count > 0) return count;
+        }
+    }
+
+    std::string describe() const {
+        return "io_uring multishot recvmsg (" + std::to_string(BUFFER_COUNT) + " provided buffers)";
+    }
+
+    int wait_handle() const { return ring_fd; }
+
+private:
+    // Submits pending requests and optionally waits for `wait` completions
+    int enter(unsigned wait, bool get_events = false) {
+        unsigned submit = unsubmitted;
+        unsigned flags = wait > 0 || get_events ? IORING_ENTER_GETEVENTS : 0;
+        int rc = (int)syscall(__NR_io_uring_enter, ring_fd, submit, wait, flags, NULL, 0);
+        if (rc >= 0) unsubmitted -= (unsigned)rc < submit ? (unsigned)rc : submit;
+        return rc;
+    }
+
+    void arm() {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & sq_mask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sock;
+        sqe->addr = (uint64_t)(uintptr_t)&layout;
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted++;
+        rearm = false;
+    }
+
+    void recycle(unsigned id) {
+        // Not buffer_ring->bufs: in C++ the uapi flex-array wrapper moves it
+        // 8 bytes past where the kernel reads the entries
+        io_uring_buf* entry = (io_uring_buf*)buffer_ring + (buffer_tail & (BUFFER_COUNT - 1));
+        entry->addr = (uint64_t)(uintptr_t)&buffers[(size_t)id * BUFFER_SIZE];
+        entry->len = BUFFER_SIZE;
+        entry->bid = (unsigned short)id;
+        buffer_tail++;
+    }
+
+    int reap() {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        int count = 0;
+        int64_t fallback_ns = ts.source == TS_USER ? user_clock_ns() : 0;
+        for (; head != tail && count < BATCH_SIZE; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cq_mask];
+            // The request ends on errors and when buffers ran out; arm it again
+            if (!(cqe.flags & IORING_CQE_F_MORE)) rearm = true;
+            if (!(cqe.flags & IORING_CQE_F_BUFFER)) continue;
+            unsigned id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            char* buffer = &buffers[(size_t)id * BUFFER_SIZE];
+            if (cqe.res > 0 && take(buffer, cqe.res, count)) {
+                if (ts.source == TS_USER) {
+                    stamp(buffer, arrivals[count]); // for the queue drop count
+                    arrivals[count] = fallback_ns;
+                } else {
+                    if (fallback_ns == 0) fallback_ns = wall_clock_ns();
+                    if (!stamp(buffer, arrivals[count])) arrivals[count] = fallback_ns;
+                }
+                count++;
+            }
+            recycle(id);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        __atomic_store_n(&buffer_ring->tail, buffer_tail, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    // Copies the datagram and its sender out of a completed buffer
+    bool take(const char* buffer, int filled, int slot) {
+        const io_uring_recvmsg_out* out = (const io_uring_recvmsg_out*)buffer;
+        size_t payload_at = sizeof(io_uring_recvmsg_out) + layout.msg_namelen + layout.msg_controllen;
+        if (out->payloadlen == 0 || (size_t)filled <= payload_at) return false;
+        size_t available = (size_t)filled - payload_at;
+        size_t copied = available < sizeof(CovertPacket) ? available : sizeof(CovertPacket);
+        memset(&packets[slot], 0, sizeof(CovertPacket));
+        memcpy(&packets[slot], buffer + payload_at, copied);
+        memset(&senders[slot], 0, sizeof(sockaddr_in));
+        memcpy(&senders[slot], buffer + sizeof(io_uring_recvmsg_out),
+               out->namelen < sizeof(sockaddr_in) ? out->namelen : sizeof(sockaddr_in));
+        lengths[slot] = (int)copied;
+        return true;
+    }
+
+    bool stamp(const char* buffer, int64_t& arrival_ns) {
+        const io_uring_recvmsg_out* out = (const io_uring_recvmsg_out*)buffer;
+        msghdr view;
+        memset(&view, 0, sizeof(view));
+        view.msg_control = (void*)(buffer + sizeof(io_uring_recvmsg_out) + layout.msg_namelen);
+        view.msg_controllen = out->controllen;
+        return extract_timestamp(&view, ts, arrival_ns);
+    }
+
+    int ring_fd;
+    void* ring;
+    size_t ring_size;
+    void* sqe_area;
+    size_t sqe_size;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+    io_uring_sqe* sqes;
+    io_uring_buf_ring* buffer_ring;
+    unsigned short buffer_tail;
+    std::vector<char> buffers;
+    msghdr layout;
+    bool rearm;
+    unsigned unsubmitted;
+};
+#endif
+
+// Picks the backend for `requested` (auto: the cheapest that keeps per-packet
+// stamps). An unavailable backend falls back to the next cheaper one, with
+// the reason in `note`. The caller owns the result.
+inline PacketReceiver* open_receiver(TransportKind requested, SOCKET sock, RxTimestamps& ts, std::string& note)
+{
+    note.clear();
+    TransportKind kind = requested;
+#ifdef __linux__
+    if (kind == TRANSPORT_AUTO) kind = ts.source != TS_USER ? TRANSPORT_URING : TRANSPORT_BLOCKING;
+    if (kind == TRANSPORT_URING) {
+    #ifdef TRANSPORT_HAS_URING
+        UringReceiver* receiver = new UringReceiver(sock, ts);
+        std::string error;
+        if (receiver->open(error)) {
+            if (ts.source == TS_USER) note = "user stamps are shared by each batch";
+            return receiver;
+        }
+        delete receiver;
+        note = "io_uring unavailable (" + error + ")";
+    #else
+        note = "io_uring not supported by this build";
+    #endif
+        kind = TRANSPORT_MMSG;
+    }
+    if (kind == TRANSPORT_MMSG) {
+        if (ts.source == TS_USER) note += std::string(note.empty() ? "" : "; ") + "user stamps are shared by each batch";
+        return new MmsgReceiver(sock, ts);
+    }
+#else
+    if (kind == TRANSPORT_MMSG || kind == TRANSPORT_URING) note = "batched receive needs Linux";
+#endif
+    return new BlockingReceiver(sock, ts);
+}
+
+// Sends datagrams from one socket to one destination. send() hands packets
+// 0..count-1 to the backend in order, as few calls as it takes, and returns
+// how many went out; on a short count packets[result] failed and the rest
+// were not tried. `launch_ns`, when given, holds each packet's SO_TXTIME
+// launch time on the clock the socket was configured with (Linux). Every
+// call's time, packets and failures go into the calling thread's metrics.
+class PacketSender {
+public:
+    virtual ~PacketSender() {}
+
+    int send(const CovertPacket* packets, int count, const uint64_t* launch_ns = NULL) {
+        MetricsShard& metrics = metrics_shard();
+        int sent = 0;
+        while (sent < count) {
+            int64_t start = now_ns();
+            int n = transmit(packets + sent, count - sent, launch_ns ? launch_ns + sent : NULL);
+            metrics.add(METRIC_SEND_NS, (uint64_t)(now_ns() - start));
+            metrics.add(METRIC_SEND_CALLS, 1);
+            if (n < 0 && interrupted()) continue;
+            if (n <= 0) break;
+            metrics.add(METRIC_PACKETS_SENT, (uint64_t)n);
+            sent += n;
+        }
+        if (sent < count) metrics.add(METRIC_SEND_FAILURES, (uint64_t)(count - sent));
+        return sent;
+    }
+    bool send(const CovertPacket& packet) { return send(&packet, 1) == 1; }
+
+    virtual std::string describe() const = 0;
+
+protected:
+    PacketSender(SOCKET s, const sockaddr_in& to) : sock(s), destination(to) {}
+
+    // The backend's send of up to `count` packets; how many went out, or -1
+    virtual int transmit(const CovertPacket* packets, int count, const uint64_t* launch_ns) = 0;
+
+    static bool interrupted() {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEINTR;
+#else
+        return errno == EINTR;
+#endif
+    }
+
+#ifdef __linux__
+    static const size_t LAUNCH_CONTROL_SIZE = CMSG_SPACE(sizeof(uint64_t));
+
+    // Points `msg` at `packet` for the destination, with its launch time in
+    // `control` (LAUNCH_CONTROL_SIZE bytes) when there is one
+    void describe_message(msghdr& msg, iovec& iov, const CovertPacket& packet, const uint64_t* launch_ns, char* control) {
+        iov.iov_base = (void*)&packet;
+        iov.iov_len = sizeof(CovertPacket);
+        msg = msghdr();
+        msg.msg_name = &destination;
+        msg.msg_namelen = sizeof(destination);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (!launch_ns) return;
+        msg.msg_control = control;
+        msg.msg_controllen = LAUNCH_CONTROL_SIZE;
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_TXTIME;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+        memcpy(CMSG_DATA(cmsg), launch_ns, sizeof(uint64_t));
+    }
+#endif
+
+    SOCKET sock;
+    sockaddr_in destination;
+};
+
+// One sendto per datagram, or sendmsg when it carries a launch time
+class BlockingSender : public PacketSender {
+public:
+    BlockingSender(SOCKET s, const sockaddr_in& to) : PacketSender(s, to) {}
+
+    int transmit(const CovertPacket* packets, int, const uint64_t* launch_ns) {
+#ifdef __linux__
+        if (launch_ns) {
+            msghdr msg;
+            iovec iov;
+            char control[LAUNCH_CONTROL_SIZE];
+            describe_message(msg, iov, packets[0], launch_ns, control);
+            return sendmsg(sock, &msg, 0) < 0 ? -1 : 1;
+        }
+#endif
+        return sendto(sock, (const char*)&packets[0], sizeof(CovertPacket), 0, (const sockaddr*)&destination,
+                      sizeof(destination)) < 0 ? -1 : 1;
+    }
+
+    std::string describe() const { return "sendto"; }
+};
+
+#ifdef __linux__
+// Hands up to `batch` datagrams to one sendmmsg call. The headers are
+// preallocated and point straight at the caller's packets.
+class MmsgSender : public PacketSender {
+public:
+    MmsgSender(SOCKET s, const sockaddr_in& to, int batch)
+        : PacketSender(s, to), messages(batch), iovecs(batch), controls(batch * LAUNCH_CONTROL_SIZE) {}
+
+    int transmit(const CovertPacket* packets, int count, const uint64_t* launch_ns) {
+        int n = std::min(count, (int)messages.size());
+        for (int i = 0; i < n; ++i)
+            describe_message(messages[i].msg_hdr, iovecs[i], packets[i], launch_ns ? launch_ns + i : NULL,
+                             &controls[i * LAUNCH_CONTROL_SIZE]);
+        return sendmmsg(sock, &messages[0], (unsigned)n, 0);
+    }
+
+    std::string describe() const {
+        return "sendmmsg (batch " + std::to_string(messages.size()) + ")";
+    }
+
+private:
+    std::vector<mmsghdr> messages;
+    std::vector<iovec> iovecs;
+    std::vector<char> controls;
+};
+#endif
+
+// Picks the send backend for `requested` and the most packets the caller
+// hands over at once (auto: sendmmsg for batches, sendto otherwise). There
+// is no io_uring send backend: a paced send goes out as its deadline comes
+// round and due packets already share one sendmmsg, so uring falls back to
+// sendmmsg.
+// The caller owns the result.
+inline PacketSender* open_sender(TransportKind requested, SOCKET sock, const sockaddr_in& to, int batch, std::string& note)
+{
+    note.clear();
+    TransportKind kind = requested;
+    if (kind == TRANSPORT_AUTO) kind = batch > 1 ? TRANSPORT_MMSG : TRANSPORT_BLOCKING;
+    if (kind == TRANSPORT_URING) {
+        note = "io_uring sends are not supported, using sendmmsg";
+        kind = TRANSPORT_MMSG;
+    }
+#ifdef __linux__
+    if (kind == TRANSPORT_MMSG) return new MmsgSender(sock, to, std::max(batch, 1));
+#else
+    if (kind == TRANSPORT_MMSG) note = "sendmmsg needs Linux, sending one packet per call";
+#endif
+    return new BlockingSender(sock, to);
+}
+
+#endif
@@ -4,7 +4,7 @@ files = ["timings_1_cleaned.csv", "timings_2_cleaned.csv", "timings_3_cleaned.cs
 window_size = 2000
 
 for file in files:
-    df = pd.read_csv(file, header=None)
+    df = pd.read_csv(file, header=None, comment='#')
     num_windows = len(df) // window_size
     trimmed_len = num_windows * window_size
     